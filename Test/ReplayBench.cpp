@@ -0,0 +1,173 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#include <algorithm>
+#include <cstring>
+#include "ReplayBench.h"
+
+#undef LOCAL_LOG_LEVEL
+#include "Logging.h"
+
+namespace {
+
+// hexNibble: one hex character to its value, 0xFF if invalid
+uint8_t hexNibble(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return 0xFF;
+}
+
+// findValue: locate the character behind "key": within [line, end)
+const char *findValue(const char *line, const char *end, const char *key) {
+  size_t klen = strlen(key);
+  for (const char *p = line; p + klen + 3 < end; ++p) {
+    if (*p == '"' && memcmp(p + 1, key, klen) == 0 && p[klen + 1] == '"' && p[klen + 2] == ':') {
+      return p + klen + 3;
+    }
+  }
+  return nullptr;
+}
+
+// parseHex: quoted hex byte string into a ModbusMessage; false on malformed data
+bool parseHex(const char *p, const char *end, ModbusMessage& m) {
+  if (p >= end || *p != '"') return false;
+  p++;
+  while (p + 1 < end && *p != '"') {
+    uint8_t hi = hexNibble(p[0]);
+    uint8_t lo = hexNibble(p[1]);
+    if (hi > 0x0F || lo > 0x0F) return false;
+    m.push_back((hi << 4) | lo);
+    p += 2;
+  }
+  return p < end && *p == '"';
+}
+
+}  // namespace
+
+ReplayBench::ReplayBench(ModbusClient& client) :
+  RBclient(client),
+  RBdone(0),
+  RBerrors(0),
+  RBmismatches(0) { }
+
+// load: parse jsonl capture text, one record per line
+uint32_t ReplayBench::load(const char *text, size_t len) {
+  uint32_t accepted = 0;
+  const char *end = text + len;
+  const char *line = text;
+  while (line < end) {
+    const char *eol = (const char *)memchr(line, '\n', end - line);
+    if (!eol) eol = end;
+
+    Record r;
+    r.at = 0;
+    const char *v = findValue(line, eol, "t");
+    if (v) {
+      while (v < eol && *v >= '0' && *v <= '9') {
+        r.at = r.at * 10 + (*v - '0');
+        v++;
+      }
+    }
+    v = findValue(line, eol, "req");
+    if (v && parseHex(v, eol, r.request) && r.request.size() >= 2) {
+      // "res" is optional - without it the response goes unverified
+      v = findValue(line, eol, "res");
+      if (v) parseHex(v, eol, r.expected);
+      RBrecords.push_back(std::move(r));
+      accepted++;
+    } else if (eol - line > 1) {
+      LOG_W("Capture line %u malformed - skipped\n", (uint32_t)RBrecords.size() + 1);
+    }
+    line = eol + 1;
+  }
+  LOG_D("%u capture records loaded\n", accepted);
+  return accepted;
+}
+
+// add: append a single record programmatically
+void ReplayBench::add(uint32_t at, ModbusMessage request, ModbusMessage expected) {
+  Record r;
+  r.at = at;
+  r.request = std::move(request);
+  r.expected = std::move(expected);
+  RBrecords.push_back(std::move(r));
+}
+
+// clear: drop the loaded capture
+void ReplayBench::clear() {
+  RBrecords.clear();
+}
+
+// handleResponse: onResponse callback, completing the record behind 'token'
+void ReplayBench::handleResponse(ModbusMessage response, uint32_t token) {
+  RBlatUs[token] = (uint32_t)micros() - RBsentUs[token];
+  if (response.getError() != SUCCESS) {
+    RBerrors++;
+  } else if (RBrecords[token].expected.size() && response != RBrecords[token].expected) {
+    RBmismatches++;
+  }
+  RBdone++;
+}
+
+// run: replay the capture and collect the numbers
+ReplayBench::Report ReplayBench::run(bool originalPacing) {
+  Report report = {};
+  uint32_t n = RBrecords.size();
+  if (n == 0) return report;
+
+  RBsentUs.assign(n, 0);
+  RBlatUs.assign(n, 0);
+  RBdone = 0;
+  RBerrors = 0;
+  RBmismatches = 0;
+
+  // Claim the response path - every response, errors included, comes through here
+  RBclient.onResponseHandler([this](ModbusMessage m, uint32_t token) {
+    handleResponse(std::move(m), token);
+  });
+
+  uint32_t startMs = millis();
+  for (uint32_t i = 0; i < n; ++i) {
+    // Original pacing? Then hold the request back until its captured time
+    if (originalPacing) {
+      while (millis() - startMs < RBrecords[i].at) delay(1);
+    }
+    // Requests are copied out of the capture, so it stays replayable
+    RBsentUs[i] = (uint32_t)micros();
+    Error rc;
+    while ((rc = RBclient.addRequest(RBrecords[i].request, i)) == REQUEST_QUEUE_FULL) {
+      // Queue full - give the worker room, then re-stamp and retry
+      delay(1);
+      RBsentUs[i] = (uint32_t)micros();
+    }
+    if (rc != SUCCESS) {
+      // Unsendable request - no response will ever come, so complete it here
+      RBerrors++;
+      RBdone++;
+    }
+  }
+  // Await the outstanding responses - stragglers are timed out by the client
+  while (RBdone < n) delay(1);
+  uint32_t durationMs = millis() - startMs;
+
+  // Latency percentiles over the sorted completion times
+  std::vector<uint32_t> lat(RBlatUs);
+  std::sort(lat.begin(), lat.end());
+  report.transactions = n;
+  report.errors = RBerrors;
+  report.mismatches = RBmismatches;
+  report.durationMs = durationMs;
+  report.tps = durationMs ? (uint32_t)((uint64_t)n * 1000 / durationMs) : 0;
+  report.p50us = lat[(n - 1) / 2];
+  report.p95us = lat[((uint64_t)(n - 1) * 95) / 100];
+  report.p99us = lat[((uint64_t)(n - 1) * 99) / 100];
+  report.maxUs = lat[n - 1];
+
+  LOG_I("Replay: %u transactions in %ums = %u tps, p50/p95/p99/max %u/%u/%u/%uus, %u errors, %u mismatches\n",
+        report.transactions, report.durationMs, report.tps,
+        report.p50us, report.p95us, report.p99us, report.maxUs,
+        report.errors, report.mismatches);
+  return report;
+}
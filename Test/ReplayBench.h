@@ -0,0 +1,74 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _REPLAY_BENCH_H
+#define _REPLAY_BENCH_H
+#include <vector>
+#include <atomic>
+#include "ModbusClient.h"
+
+// ReplayBench: drive a captured request stream through a ModbusClient and
+// measure throughput plus latency, e.g. against the TCPstub fake server or a
+// real device. A capture is a sequence of (timestamp, request, expected
+// response) records, loadable from jsonl text with one record per line,
+//   {"t":<ms>,"req":"<hex bytes>","res":"<hex bytes>"}
+// ("res" may be omitted to skip verification), or filled programmatically via
+// add(). run() issues the requests - flooding the queue as fast as it accepts,
+// or paced by the captured timestamps - and reports transactions/s along with
+// latency percentiles. The bench claims the client's onResponse handler while
+// running, so it cannot share the client with handler-based application code.
+class ReplayBench {
+public:
+  // One captured transaction
+  struct Record {
+    uint32_t at;               // Capture timestamp in ms, relative to capture start
+    ModbusMessage request;     // Request to issue
+    ModbusMessage expected;    // Expected response; empty = do not verify
+  };
+
+  // Result of one replay run
+  struct Report {
+    uint32_t transactions;     // Number of requests issued
+    uint32_t errors;           // Responses carrying an error code (TIMEOUT included)
+    uint32_t mismatches;       // Data responses differing from the expected message
+    uint32_t durationMs;       // Wall time from first send to last response
+    uint32_t tps;              // Transactions per second
+    uint32_t p50us;            // Median latency in microseconds
+    uint32_t p95us;            // 95th percentile latency
+    uint32_t p99us;            // 99th percentile latency
+    uint32_t maxUs;            // Worst-case latency
+  };
+
+  explicit ReplayBench(ModbusClient& client);
+
+  // load: parse jsonl capture text; returns the number of records accepted
+  uint32_t load(const char *text, size_t len);
+
+  // add: append a single record programmatically
+  void add(uint32_t at, ModbusMessage request, ModbusMessage expected = ModbusMessage());
+
+  // clear: drop the loaded capture
+  void clear();
+
+  // size: number of loaded records
+  uint32_t size() { return RBrecords.size(); }
+
+  // run: replay the capture. originalPacing = true issues every request at its
+  // captured timestamp, false floods the client at maximum speed.
+  Report run(bool originalPacing = false);
+
+protected:
+  // handleResponse: onResponse callback, completing the record behind 'token'
+  void handleResponse(ModbusMessage response, uint32_t token);
+
+  ModbusClient& RBclient;             // Client under test
+  std::vector<Record> RBrecords;      // The capture
+  std::vector<uint32_t> RBsentUs;     // Send timestamps of the running replay
+  std::vector<uint32_t> RBlatUs;      // Completion latencies
+  std::atomic<uint32_t> RBdone;       // Number of responses received
+  std::atomic<uint32_t> RBerrors;     // Error responses seen
+  std::atomic<uint32_t> RBmismatches; // Responses differing from the expectation
+};
+
+#endif
@@ -214,6 +214,11 @@ interrupted:
 // bool operator: return connected() state
 Client::operator bool() { return connected() == 1; }
 
+// fd: expose the socket descriptor, so callers can poll() on it instead of probing
+int Client::fd() {
+  return sockfd;
+}
+
 // setNoDelay: disable Nagle algorithm for fast handling of small data packets
 void Client::setNoDelay(bool yesNo) {
   int yes = (yesNo ? 1 : 0);
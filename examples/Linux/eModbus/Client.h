@@ -35,6 +35,7 @@ public:
   void flush();
   void stop();
   void setNoDelay(bool yesNo);
+  int fd();
   uint8_t connected();
   operator bool();
   static IPAddress hostname_to_ip(const char *hostname);
@@ -483,6 +483,142 @@ bool CoilData::setVector(const char *initVector) {
   return false;
 }
 
+// setRange: bulk set or clear a run of coils
+bool CoilData::setRange(uint16_t start, uint16_t length, bool value) {
+  // Does the requested range fit in the buffer?
+  if (length == 0 || (start + length) > CDsize) return false;
+
+  uint16_t last = start + length - 1;
+  uint8_t firstByte = byteIndex(start);
+  uint8_t lastByte = byteIndex(last);
+
+  // Mask of the affected bits in the first byte...
+  uint8_t headMask = 0xFF << bitIndex(start);
+  // ...and in the last byte
+  uint8_t tailMask = CDfilter[bitIndex(last)];
+
+  // Does the range live in a single byte?
+  if (firstByte == lastByte) {
+    // Yes, both masks apply to the same byte
+    uint8_t mask = headMask & tailMask;
+    if (value) {
+      CDbuffer[firstByte] |= mask;
+    } else {
+      CDbuffer[firstByte] &= ~mask;
+    }
+    return true;
+  }
+
+  // No - the edge bytes are masked bit-wise...
+  if (value) {
+    CDbuffer[firstByte] |= headMask;
+    CDbuffer[lastByte] |= tailMask;
+  } else {
+    CDbuffer[firstByte] &= ~headMask;
+    CDbuffer[lastByte] &= ~tailMask;
+  }
+  // ...and all bytes in between are stamped in one go
+  if (lastByte - firstByte > 1) {
+    memset(CDbuffer + firstByte + 1, value ? 0xFF : 0, lastByte - firstByte - 1);
+  }
+  return true;
+}
+
+// findDiff: locate the first coil differing from another coil set
+int32_t CoilData::findDiff(const CoilData& other, uint16_t from) const {
+  // Only coil sets of identical size can be compared sensibly
+  if (CDsize == 0 || CDsize != other.CDsize || from >= CDsize) return -1;
+
+  uint16_t byPtr = byteIndex(from);
+
+  // The first byte may be partial - mask out the bits before 'from'
+  uint8_t x = (CDbuffer[byPtr] ^ other.CDbuffer[byPtr]) & (0xFF << bitIndex(from));
+  // Any difference already?
+  if (x) {
+    // Yes, count-trailing-zeros pinpoints the bit
+    return (byPtr << 3) + __builtin_ctz(x);
+  }
+  byPtr++;
+
+  // Compare word-wise as long as full words remain.
+  // Overhang bits beyond CDsize are kept zero by all set operations, so they
+  // can never produce a false difference.
+  while ((uint16_t)(byPtr + 4) <= CDbyteSize) {
+    uint32_t a;
+    uint32_t b;
+    memcpy(&a, CDbuffer + byPtr, 4);
+    memcpy(&b, other.CDbuffer + byPtr, 4);
+    uint32_t w = a ^ b;
+    // Any difference in this word?
+    if (w) {
+      // Yes - on our little-endian targets ctz directly yields the bit offset
+      return (byPtr << 3) + __builtin_ctz(w);
+    }
+    byPtr += 4;
+  }
+
+  // Compare the remaining tail bytes
+  while (byPtr < CDbyteSize) {
+    x = CDbuffer[byPtr] ^ other.CDbuffer[byPtr];
+    if (x) {
+      return (byPtr << 3) + __builtin_ctz(x);
+    }
+    byPtr++;
+  }
+  // No difference found
+  return -1;
+}
+
+// CoilDataView constructor: reference a bit range of a parent CoilData
+CoilDataView::CoilDataView(const CoilData& parent, uint16_t start, uint16_t length) :
+  CVbuffer(parent.data()),
+  CVstart(start),
+  CVlength(0) {
+  // Is the start within the parent's coils?
+  if (start < parent.coils()) {
+    // Yes. length default is all up to the end
+    if (length == 0) length = parent.coils() - start;
+    // Does the requested range fit?
+    if ((start + length) <= parent.coils()) {
+      // Yes, the view is valid
+      CVlength = length;
+    }
+  }
+}
+
+// operator[]: return value of a single coil, relative to the view start
+bool CoilDataView::operator[](uint16_t index) const {
+  if (index < CVlength) {
+    uint16_t bit = CVstart + index;
+    return (CVbuffer[bit >> 3] & (1 << (bit & 0x07))) ? true : false;
+  }
+  // Wrong parameter -> always return false
+  return false;
+}
+
+// packedByte: return byte n of the view as it appears on the wire
+uint8_t CoilDataView::packedByte(uint8_t n) const {
+  uint16_t base = (uint16_t)n << 3;
+  // Beyond the view? Read as zero
+  if (base >= CVlength) return 0;
+
+  uint16_t bit = CVstart + base;
+  uint8_t shift = bit & 0x07;
+  uint16_t byIdx = bit >> 3;
+
+  // Gather the byte from (up to) two source bytes
+  uint8_t by = CVbuffer[byIdx] >> shift;
+  if (shift && (bit + (8 - shift)) < (CVstart + CVlength)) {
+    by |= CVbuffer[byIdx + 1] << (8 - shift);
+  }
+  // Mask out overhang bits past the view length
+  uint16_t remaining = CVlength - base;
+  if (remaining < 8) {
+    by &= (1 << remaining) - 1;
+  }
+  return by;
+}
+
 // init: set all coils to 1 or 0 (default)
 void CoilData::init(bool value) {
   if (CDsize > 0) {
@@ -493,20 +629,22 @@ void CoilData::init(bool value) {
 }
 
 // Return number of coils set to 1 (or not)
-// Uses Brian Kernighan's algorithm!
+// Counts word-wise with the compiler's population count
 uint16_t CoilData::coilsSetON() const {
   uint16_t count = 0;
-
-  // Do we have coils at all?
-  if (CDbyteSize) {
-    // Yes. Loop over all bytes summing up the '1' bits
-    for (uint8_t i = 0; i < CDbyteSize; ++i) {
-      uint8_t by = CDbuffer[i];
-      while (by) {
-        by &= by - 1; // this clears the LSB-most set bit
-        count++;
-      }
-    }
+  uint16_t i = 0;
+
+  // Sum up the '1' bits a word at a time
+  while ((uint16_t)(i + 4) <= CDbyteSize) {
+    uint32_t w;
+    memcpy(&w, CDbuffer + i, 4);
+    count += __builtin_popcount(w);
+    i += 4;
+  }
+  // Add the remaining tail bytes
+  while (i < CDbyteSize) {
+    count += __builtin_popcount(CDbuffer[i]);
+    i++;
   }
   return count;
 }
@@ -79,6 +79,18 @@ public:
   // Setting stops when either target storage or source bits are exhausted
   bool set(uint16_t index, const char *initVector);
 
+  // setRange: bulk set or clear a run of coils - the bytes in between the two
+  // edge bytes are stamped in one memset instead of bit-by-bit
+  bool setRange(uint16_t start, uint16_t length, bool value);
+
+  // findDiff: scan for the first coil differing from another coil set of the
+  // same size, beginning at coil 'from'. Compares word-at-a-time (XOR plus
+  // count-trailing-zeros), so diffing a full 2000-coil image takes a handful
+  // of word operations instead of 2000 operator[] calls.
+  // Returns the coil index of the first difference, or -1 if there is none
+  // (or the sizes do not match).
+  int32_t findDiff(const CoilData& other, uint16_t from = 0) const;
+
   // (Re-)init complete coil set to 1 or 0
   void init(bool value = false);
 
@@ -98,7 +110,7 @@ public:
   // Return number of coils set to 0 (or OFF)
   uint16_t coilsSetOFF() const;
 
-#if !ISLINUX
+#if !IS_LINUX
   // Helper function to dump out coils in logical order
   void print(const char *label, Print& s);
 #endif
@@ -119,4 +131,39 @@ protected:
   uint8_t *CDbuffer;       // Pointer to bit storage
 };
 
+// CoilDataView: non-owning view on a bit range of a CoilData object.
+// Other than slice(), no storage is allocated and no bits are copied - the
+// view keeps a pointer into the parent's buffer and bits are shifted only
+// when they are written out, e.g. by ModbusMessage::add(CoilDataView).
+// The view must not outlive its parent CoilData!
+class CoilDataView {
+public:
+  // Constructor: reference a bit range of a parent CoilData.
+  // Default start is first coil, default length all to the end.
+  // An invalid range yields an empty view.
+  explicit CoilDataView(const CoilData& parent, uint16_t start = 0, uint16_t length = 0);
+
+  // coils: length of the view in bits
+  inline uint16_t coils() const { return CVlength; }
+
+  // size: number of packed bytes the view covers (= FC 0x01 response byte count)
+  inline uint8_t size() const { return CVlength ? (((CVlength - 1) >> 3) + 1) : 0; }
+
+  // Test if there are any coils in the view
+  inline bool empty() const { return CVlength == 0; }
+  inline operator bool () const { return !empty(); }
+
+  // operator[]: return value of a single coil, relative to the view start
+  bool operator[](uint16_t index) const;
+
+  // packedByte: return byte n of the view as it appears on the wire - bits
+  // shifted so the first viewed coil is bit 0, overhang bits read as zero
+  uint8_t packedByte(uint8_t n) const;
+
+protected:
+  const uint8_t *CVbuffer; // Parent bit storage
+  uint16_t CVstart;        // First viewed coil within the parent
+  uint16_t CVlength;       // Size of the view in bits
+};
+
 #endif
@@ -4,8 +4,18 @@
 // =================================================================================================
 #include "Logging.h"
 #include <cinttypes>
+#if USE_MUTEX
+#include <mutex>     // NOLINT
+#endif
+#if MODBUS_DEFERRED_LOGGING
+#include <cstdarg>
+#include <atomic>
+#include "RequestQueue.h"
+#include "MessagePool.h"
+#endif
 
 int MBUlogLvl = LOG_LEVEL;
+uint16_t MBUhexDumpLimit = 0;
 #if IS_LINUX
 #define PrintOut printf
 
@@ -16,32 +26,48 @@ Print *LOGDEVICE = &Serial;
 
 void logHexDump(Print *output, const char *letter, const char *label, const uint8_t *data, const size_t length) {
 #endif
-  size_t cnt = 0;
-  size_t step = 0;
-  char limiter = '|';
-  // Use line buffer to speed up output
-  const uint16_t BUFLEN(80);
+  const uint16_t ROWLEN(79);      // One formatted row of 16 bytes, including '\n'
   const uint16_t ascOffset(61);
-  char linebuf[BUFLEN];
-  char *cp = linebuf;
+  char limiter = '|';
   const char HEXDIGIT[] = "0123456789ABCDEF";
+  // Preallocated buffer for a complete dump - header line, 16 rows, truncation
+  // note - so the whole dump goes out in one single write. A Modbus frame is
+  // 256 bytes at most; longer data is capped to what the buffer holds.
+  const size_t DUMPCAP(256);
+  static char dumpbuf[96 + (DUMPCAP / 16) * ROWLEN + 48];
+#if USE_MUTEX
+  // The buffer is shared - serialize concurrent dumping tasks
+  static std::mutex dumpLock;
+  LOCK_GUARD(lg, dumpLock);
+#endif
 
-  // Print out header
-  PrintOut ("[%s] %s: @%" PRIXPTR "/%" PRIu32 ":\n", letter, label, (uintptr_t)data, (uint32_t)(length & 0xFFFFFFFF));
+  // Apply the byte-count caps: the global knob first, the buffer cap second
+  size_t shown = length;
+  if (MBUhexDumpLimit && shown > MBUhexDumpLimit) shown = MBUhexDumpLimit;
+  if (shown > DUMPCAP) shown = DUMPCAP;
+
+  // Format the header line
+  char *cp = dumpbuf;
+  int n = snprintf(cp, 96, "[%s] %s: @%" PRIXPTR "/%" PRIu32 ":\n", letter, label, (uintptr_t)data, (uint32_t)(length & 0xFFFFFFFF));
+  if (n > 95) n = 95;
+  cp += n;
 
   // loop over data in steps of 16
-  for (cnt = 0; cnt < length; ++cnt) {
+  char *row = cp;
+  size_t step = 0;
+  for (size_t cnt = 0; cnt < shown; ++cnt) {
     step = cnt % 16;
-    // New line?
+    // New row?
     if (step == 0) {
-      // Yes. Clear line and print address header
-      memset(linebuf, ' ', BUFLEN);
-      linebuf[60] = limiter;
-      linebuf[77] = limiter;
-      linebuf[78] = '\n';
-      linebuf[BUFLEN - 1] = 0;
-      snprintf(linebuf, BUFLEN, "  %c %04X: ", limiter, (uint16_t)(cnt & 0xFFFF));
-      cp = linebuf + strlen(linebuf);
+      // Yes. Blank it and format the address header
+      row = cp;
+      memset(row, ' ', ROWLEN);
+      row[60] = limiter;
+      row[77] = limiter;
+      row[78] = '\n';
+      snprintf(row, 12, "  %c %04X: ", limiter, (uint16_t)(cnt & 0xFFFF));
+      row[10] = ' ';   // strip the NUL snprintf left behind
+      cp = row + 10;
       // No, but first block of 8 done?
     } else if (step == 8) {
       // Yes, put out additional space
@@ -52,17 +78,237 @@ void logHexDump(Print *output, const char *letter, const char *label, const uint
     *cp++ = HEXDIGIT[(c >> 4) & 0x0F];
     *cp++ = HEXDIGIT[c & 0x0F];
     *cp++ = ' ';
-    if (c >= 32 && c <= 127) linebuf[ascOffset + step] = c;
-    else                     linebuf[ascOffset + step] = '.';
-    // Line end?
-    if (step == 15) {
-      // Yes, print line
-      PrintOut ("%s", linebuf);
+    if (c >= 32 && c <= 127) row[ascOffset + step] = c;
+    else                     row[ascOffset + step] = '.';
+    // Row complete?
+    if (step == 15) cp = row + ROWLEN;
+  }
+  // Unfinished row?
+  if (shown && step != 15) cp = row + ROWLEN;
+  // Were bytes left out?
+  if (shown < length) {
+    n = snprintf(cp, 48, "  ... (%u of %u bytes shown)\n", (uint32_t)(shown & 0xFFFFFFFF), (uint32_t)(length & 0xFFFFFFFF));
+    if (n > 47) n = 47;
+    cp += n;
+  }
+  *cp = 0;
+
+  // Emit the complete dump in one single write
+  PrintOut ("%s", dumpbuf);
+}
+
+#if MODBUS_DEFERRED_LOGGING
+// ===============================================================================================
+// Deferred logging: the LOG_*/HEXDUMP_* macros capture records here instead of writing to the
+// log device synchronously. Records travel through the same lock-free MessagePool/RequestQueue
+// machinery the clients use for their request queues, so capturing is wait-free and allocation
+// free in steady state. A low-priority drain task does the device I/O.
+// Text records hold the readily formatted line - formatting into RAM costs microseconds, it is
+// the device I/O that stalls the caller. Hex dump records hold the raw bytes instead and are
+// formatted entirely by the drain task.
+// ===============================================================================================
+#if IS_LINUX
+#include <pthread.h>
+#endif
+
+struct LogRecord {
+  enum Kind : uint8_t { TEXT = 0, HEXDUMP = 1 };
+  Kind kind;
+  uint16_t used;                 // valid bytes in data
+  size_t full;                   // original length of a hex dump (may exceed used)
+  char letter[4];                // hex dump log level letter
+  char label[32];                // hex dump label
+  uint8_t data[256];             // formatted text or raw dump bytes
+  LogRecord() : kind(TEXT), used(0), full(0) {
+    letter[0] = 0;
+    label[0] = 0;
+  }
+};
+
+static RequestQueue<LogRecord> *logRing = nullptr;
+static MessagePool<LogRecord> logPool;
+static std::atomic<uint32_t> logDropped(0);
+static bool logDrainRunning = false;
+#if HAS_FREERTOS
+static TaskHandle_t logDrainHandle = nullptr;
+#elif IS_LINUX
+static pthread_t logDrainHandle;
+#endif
+
+// logEmitRecord: format and write one record to the log device
+static void logEmitRecord(LogRecord *r) {
+  // A readily formatted text line?
+  if (r->kind == LogRecord::TEXT) {
+    // Yes, just push it out
+#if IS_LINUX
+    fputs(reinterpret_cast<const char *>(r->data), stdout);
+#else
+    LOGDEVICE->print(reinterpret_cast<const char *>(r->data));
+#endif
+  } else {
+    // No, a raw hex dump - format it now
+#if IS_LINUX
+    logHexDump(r->letter, r->label, r->data, r->used);
+    if (r->full > r->used) printf("  (truncated to %u of %u bytes)\n", r->used, (uint32_t)(r->full & 0xFFFFFFFF));
+#else
+    logHexDump(LOGDEVICE, r->letter, r->label, r->data, r->used);
+    if (r->full > r->used) LOGDEVICE->printf("  (truncated to %u of %u bytes)\n", r->used, (uint32_t)(r->full & 0xFFFFFFFF));
+#endif
+  }
+}
+
+// logDrainLoop: drain task main loop - emit queued records, report drops when idle
+static void logDrainLoop() {
+  while (logDrainRunning) {
+    LogRecord *r = logRing->pop();
+    // Anything queued?
+    if (r) {
+      // Yes, emit and recycle it
+      logEmitRecord(r);
+      logPool.release(r);
+    } else {
+      // No - a good moment to report records dropped on overflow, if any
+      uint32_t drops = logDropped.exchange(0, std::memory_order_relaxed);
+      if (drops) {
+#if IS_LINUX
+        printf("[log] ring buffer overflow - %u records dropped\n", drops);
+#else
+        LOGDEVICE->printf("[log] ring buffer overflow - %u records dropped\n", drops);
+#endif
+      }
+      delay(1);
     }
   }
-  // Unfinished line?
-  if (length && step != 15) {
-      // Yes, print line
-      PrintOut ("%s", linebuf);
+}
+
+#if HAS_FREERTOS
+static void logDrainTask(void *) {
+  logDrainLoop();
+  vTaskDelete(NULL);
+}
+#elif IS_LINUX
+static void *logDrainTask(void *) {
+  logDrainLoop();
+  return nullptr;
+}
+#endif
+
+// startDeferredLogging: allocate the ring and start the drain task.
+// Until this was called, records are emitted synchronously as in classic mode.
+bool startDeferredLogging(uint16_t slots) {
+#if HAS_FREERTOS || IS_LINUX
+  // Already running?
+  if (logRing) return true;
+  if (slots < 2) slots = 2;
+  // Two spare pool slots: one record in flight in the drain task, one being captured
+  logPool.resize(slots + 2);
+  logRing = new RequestQueue<LogRecord>(slots);
+  logDrainRunning = true;
+#if HAS_FREERTOS
+  xTaskCreatePinnedToCore((TaskFunction_t)&logDrainTask, "ModbusLog", 4096, NULL, 1, &logDrainHandle, NULL);
+  bool ok = (logDrainHandle != nullptr);
+#else
+  bool ok = (pthread_create(&logDrainHandle, NULL, &logDrainTask, NULL) == 0);
+#endif
+  // Could the drain task not be started?
+  if (!ok) {
+    // No - fall back to synchronous mode again
+    logDrainRunning = false;
+    delete logRing;
+    logRing = nullptr;
+    logPool.resize(0);
+  }
+  return ok;
+#else
+  // No task support on this platform - records keep being emitted synchronously
+  return false;
+#endif
+}
+
+// stopDeferredLogging: stop the drain task, flush leftovers and free the ring
+void stopDeferredLogging() {
+  if (!logRing) return;
+  logDrainRunning = false;
+#if HAS_FREERTOS
+  // Give the drain task room to run off its loop and delete itself
+  delay(50);
+#elif IS_LINUX
+  pthread_join(logDrainHandle, NULL);
+#endif
+  // Emit what is still queued, synchronously
+  LogRecord *r = nullptr;
+  while ((r = logRing->pop()) != nullptr) {
+    logEmitRecord(r);
+    logPool.release(r);
+  }
+  // Report drops the drain task did not get to any more
+  uint32_t drops = logDropped.exchange(0, std::memory_order_relaxed);
+  if (drops) {
+#if IS_LINUX
+    printf("[log] ring buffer overflow - %u records dropped\n", drops);
+#else
+    LOGDEVICE->printf("[log] ring buffer overflow - %u records dropped\n", drops);
+#endif
+  }
+  delete logRing;
+  logRing = nullptr;
+  logPool.resize(0);
+}
+
+// logDeferredPrintf: LOG_* macro target - capture one formatted text record
+void logDeferredPrintf(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  // Is the drain task up?
+  if (logRing && logDrainRunning) {
+    // Yes. Format into a recycled record and queue it
+    LogRecord *rec = logPool.acquire();
+    rec->kind = LogRecord::TEXT;
+    vsnprintf(reinterpret_cast<char *>(rec->data), sizeof(rec->data), format, args);
+    // Ring full?
+    if (!logRing->push(rec)) {
+      // Yes - drop the record rather than stall the caller
+      logPool.release(rec);
+      logDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  } else {
+    // No - emit synchronously as in classic mode
+    char line[256];
+    vsnprintf(line, sizeof(line), format, args);
+#if IS_LINUX
+    fputs(line, stdout);
+#else
+    LOGDEVICE->print(line);
+#endif
+  }
+  va_end(args);
+}
+
+// logDeferredHexDump: HEXDUMP_* macro target - capture the raw bytes, format later
+void logDeferredHexDump(const char *letter, const char *label, const uint8_t *data, size_t length) {
+  // Is the drain task up?
+  if (logRing && logDrainRunning) {
+    // Yes. Copy the bytes into a recycled record and queue it
+    LogRecord *rec = logPool.acquire();
+    rec->kind = LogRecord::HEXDUMP;
+    snprintf(rec->letter, sizeof(rec->letter), "%s", letter);
+    snprintf(rec->label, sizeof(rec->label), "%s", label);
+    rec->full = length;
+    rec->used = length > sizeof(rec->data) ? sizeof(rec->data) : length;
+    memcpy(rec->data, data, rec->used);
+    // Ring full?
+    if (!logRing->push(rec)) {
+      // Yes - drop the record rather than stall the caller
+      logPool.release(rec);
+      logDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  } else {
+    // No - emit synchronously as in classic mode
+#if IS_LINUX
+    logHexDump(letter, label, data, length);
+#else
+    logHexDump(LOGDEVICE, letter, label, data, length);
+#endif
   }
 }
+#endif  // MODBUS_DEFERRED_LOGGING
@@ -56,6 +56,23 @@ extern Print *LOGDEVICE;
 void logHexDump(Print *output, const char *letter, const char *label, const uint8_t *data, const size_t length);
 #endif
 extern int MBUlogLvl;
+// Byte-count cap for hex dumps: dumps longer than this show the first
+// MBUhexDumpLimit bytes plus a note. 0 = no cap (dumps are always capped at one
+// Modbus frame, 256 bytes). Keeps production verbose tracing of long frames cheap.
+extern uint16_t MBUhexDumpLimit;
+
+#if MODBUS_DEFERRED_LOGGING
+// Deferred logging mode: the macros below capture log records into a lock-free
+// ring buffer and a low-priority drain task does formatting and device I/O.
+// startDeferredLogging() allocates the ring and starts the drain task; before
+// it was called (or if it failed) records are emitted synchronously as usual.
+// When the ring overflows, records are dropped and the drain task reports the
+// count once it catches up - the hot path never blocks on the log device.
+bool startDeferredLogging(uint16_t slots = 32);
+void stopDeferredLogging();
+void logDeferredPrintf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+void logDeferredHexDump(const char *letter, const char *label, const uint8_t *data, size_t length);
+#endif
 #endif  // _MODBUS_LOGGING
 
 // The remainder may need to be redefined if LOCAL_LOG_LEVEL was set differently before
@@ -91,7 +108,15 @@ extern int MBUlogLvl;
 #endif
 
 // Now we can define the macros based on LOCAL_LOG_LEVEL
-#if IS_LINUX
+#if MODBUS_DEFERRED_LOGGING
+#define LOG_LINE_C(level, x, format, ...) if (MBUlogLvl >= level) logDeferredPrintf(LL_RED LOG_HEADER(x) format LL_NORM, millis(), file_name(__FILE__), __LINE__, __func__, ##__VA_ARGS__)
+#define LOG_LINE_E(level, x, format, ...) if (MBUlogLvl >= level) logDeferredPrintf(LL_YELLOW LOG_HEADER(x) format LL_NORM, millis(), file_name(__FILE__), __LINE__, __func__, ##__VA_ARGS__)
+#define LOG_LINE_T(level, x, format, ...) if (MBUlogLvl >= level) logDeferredPrintf(LOG_HEADER(x) format, millis(), file_name(__FILE__), __LINE__, __func__, ##__VA_ARGS__)
+#define LOG_RAW_C(level, x, format, ...) if (MBUlogLvl >= level) logDeferredPrintf(LL_RED format LL_NORM, ##__VA_ARGS__)
+#define LOG_RAW_E(level, x, format, ...) if (MBUlogLvl >= level) logDeferredPrintf(LL_YELLOW format LL_NORM, ##__VA_ARGS__)
+#define LOG_RAW_T(level, x, format, ...) if (MBUlogLvl >= level) logDeferredPrintf(format, ##__VA_ARGS__)
+#define HEX_DUMP_T(x, level, label, address, length) if (MBUlogLvl >= level) logDeferredHexDump(#x, label, address, length)
+#elif IS_LINUX
 #define LOG_LINE_C(level, x, format, ...) if (MBUlogLvl >= level) printf(LL_RED LOG_HEADER(x) format LL_NORM, millis(), file_name(__FILE__), __LINE__, __func__, ##__VA_ARGS__)
 #define LOG_LINE_E(level, x, format, ...) if (MBUlogLvl >= level) printf(LL_YELLOW LOG_HEADER(x) format LL_NORM, millis(), file_name(__FILE__), __LINE__, __func__, ##__VA_ARGS__)
 #define LOG_LINE_T(level, x, format, ...) if (MBUlogLvl >= level) printf(LOG_HEADER(x) format, millis(), file_name(__FILE__), __LINE__, __func__, ##__VA_ARGS__)
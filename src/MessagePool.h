@@ -0,0 +1,114 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _MESSAGE_POOL_H
+#define _MESSAGE_POOL_H
+
+#include "options.h"
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#if USE_MUTEX
+#include <mutex>                    // NOLINT
+#endif
+
+// MessagePool: fixed-size recycling allocator for the short-lived objects on the
+// request/response hot path (request queue entries, server outbox messages).
+// A single slab is allocated up front - typically at begin()/start() time, sized
+// from the queue limit - and objects are recycled through a free list instead of
+// being returned to the heap. This gives zero steady-state allocations and no
+// heap fragmentation over long uptimes.
+// Should the pool ever run dry, acquire() falls back to plain heap allocation,
+// so functionality is never impaired - release() tells both kinds apart.
+template <typename T>
+class MessagePool {
+public:
+  // Constructor: start without a slab - resize() will provide one
+  MessagePool() :
+    PLslab(nullptr),
+    PLfreeList(nullptr),
+    PLslots(0) { }
+
+  // Destructor: drop the slab. All pooled objects must have been released before!
+  ~MessagePool() {
+    delete[] PLslab;
+  }
+
+  // No copying - the pool hands out pointers into its slab
+  MessagePool(const MessagePool&) = delete;
+  MessagePool& operator=(const MessagePool&) = delete;
+
+  // resize: (re-)allocate the slab for the given number of objects.
+  // Must not be called while objects from the previous slab are still in use!
+  void resize(uint16_t slots) {
+    LOCK_GUARD(lg, PLlock);
+    delete[] PLslab;
+    PLslab = nullptr;
+    PLfreeList = nullptr;
+    PLslots = slots;
+    if (slots) {
+      PLslab = new Slot[slots];
+      // Chain all slots into the free list
+      for (uint16_t i = 0; i < slots; ++i) {
+        PLslab[i].next = PLfreeList;
+        PLfreeList = &PLslab[i];
+      }
+    }
+  }
+
+  // acquire: construct an object in a recycled slot (or on the heap, if exhausted)
+  template <typename... Args>
+  T *acquire(Args&&... args) {
+    Slot *s = nullptr;
+    {
+      LOCK_GUARD(lg, PLlock);
+      if (PLfreeList) {
+        s = PLfreeList;
+        PLfreeList = s->next;
+      }
+    }
+    // Did we get a free slot?
+    if (s) {
+      // Yes. Construct the object in place
+      return new(&s->storage) T(std::forward<Args>(args) ...);
+    }
+    // No - pool is dry (or was never sized). Fall back to the heap.
+    return new T(std::forward<Args>(args) ...);
+  }
+
+  // release: destroy an object and recycle its slot (or free it, if heap-allocated)
+  void release(T *obj) {
+    if (!obj) return;
+    Slot *s = reinterpret_cast<Slot *>(obj);
+    // Is the pointer part of our slab?
+    if (PLslab && s >= PLslab && s < PLslab + PLslots) {
+      // Yes. Destroy the object and return the slot to the free list
+      obj->~T();
+      LOCK_GUARD(lg, PLlock);
+      s->next = PLfreeList;
+      PLfreeList = s;
+    } else {
+      // No, this one came from the heap fallback
+      delete obj;
+    }
+  }
+
+protected:
+  // A slot either holds a live object or a link in the free list
+  union Slot {
+    Slot *next;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    Slot() : next(nullptr) { }
+    ~Slot() { }
+  };
+
+  Slot *PLslab;                  // Single block holding all slots
+  Slot *PLfreeList;              // Head of the list of unused slots
+  uint16_t PLslots;              // Number of slots in the slab
+#if USE_MUTEX
+  std::mutex PLlock;             // Mutex protecting the free list
+#endif
+};
+
+#endif
@@ -6,6 +6,7 @@
 #define _MODBUS_BRIDGE_TEMP_H
 
 #include <map>
+#include <set>
 #include <functional>
 #include "ModbusClient.h"
 #include "ModbusClientTCP.h"  // Needed for client.setTarget()
@@ -35,7 +36,11 @@ public:
   // Destructor
   ~ModbusBridge();
 
-  // Method to link external servers to the bridge
+  // Method to link external servers to the bridge.
+  // With several TCP targets attached behind a single ModbusClientTCP, enable
+  // the client's useConnectionPool() - every attached server then keeps its own
+  // warm socket and a target switch costs a pool lookup instead of a reconnect,
+  // so the bridge-added latency stays independent of the number of targets.
   bool attachServer(uint8_t aliasID, uint8_t serverID, uint8_t functionCode, ModbusClient *client, IPAddress host = IPAddress(0, 0, 0, 0), uint16_t port = 0);
 
   // Link another function code to the server
@@ -44,6 +49,16 @@ public:
   // Block a function code (respond with ILLEGAL_FUNCTION error)
   bool denyFunctionCode(uint8_t aliasID, uint8_t functionCode);
 
+  // useResponseCache: serve repeated read requests (FC 01..04) from memory for up to
+  // ttl milliseconds instead of re-asking the downstream server. Identical concurrent
+  // requests are collapsed into a single downstream transaction - waiters are served
+  // from the cache once the fetching task got its response. maxEntries bounds the
+  // cache size; the oldest entry is evicted when it is full. ttl = 0 disables again.
+  void useResponseCache(uint32_t ttl, uint16_t maxEntries = 32);
+
+  // clearResponseCache: drop all cached responses, e.g. after a known data change
+  void clearResponseCache();
+
 protected:
   // ServerData holds all data necessary to address a single server
   struct ServerData {
@@ -52,6 +67,7 @@ protected:
     ServerType serverType;        // TCP_SERVER or RTU_SERVER
     IPAddress host;               // TCP: host IP address, else 0.0.0.0
     uint16_t port;                // TCP: host port number, else 0
+    uint32_t allowedFC[4];        // Allow bitmap, one bit per function code (7 bit FCs)
 
     // RTU constructor
     ServerData(uint8_t sid, ModbusClient *c) :
@@ -59,7 +75,8 @@ protected:
       client(c),
       serverType(RTU_SERVER),
       host(IPAddress(0, 0, 0, 0)),
-      port(0) {}
+      port(0),
+      allowedFC{0, 0, 0, 0} {}
     
     // TCP constructor
     ServerData(uint8_t sid, ModbusClient *c, IPAddress h, uint16_t p) :
@@ -67,15 +84,62 @@ protected:
       client(c),
       serverType(TCP_SERVER),
       host(h),
-      port(p) {}
+      port(p),
+      allowedFC{0, 0, 0, 0} {}
+
+    // allowFC/denyFC/isAllowedFC: maintain and test the allow bitmap.
+    // ANY_FUNCTION_CODE switches all codes at once.
+    void allowFC(uint8_t fc) {
+      if (fc == ANY_FUNCTION_CODE) {
+        allowedFC[0] = allowedFC[1] = allowedFC[2] = allowedFC[3] = 0xFFFFFFFF;
+      } else {
+        allowedFC[(fc & 0x7F) >> 5] |= 1UL << (fc & 0x1F);
+      }
+    }
+    void denyFC(uint8_t fc) {
+      if (fc == ANY_FUNCTION_CODE) {
+        allowedFC[0] = allowedFC[1] = allowedFC[2] = allowedFC[3] = 0;
+      } else {
+        allowedFC[(fc & 0x7F) >> 5] &= ~(1UL << (fc & 0x1F));
+      }
+    }
+    bool isAllowedFC(uint8_t fc) const {
+      return (allowedFC[(fc & 0x7F) >> 5] >> (fc & 0x1F)) & 1;
+    }
   };
 
   // Default worker functions
-  ModbusMessage bridgeWorker(ModbusMessage msg);
-  ModbusMessage bridgeDenyWorker(ModbusMessage msg);
+  ModbusMessage bridgeWorker(ModbusMessage& msg);
+  ModbusMessage bridgeDenyWorker(ModbusMessage& msg);
 
-  // Map of servers attached
-  std::map<uint8_t, ServerData *> servers;
+  // Flat routing table: attached servers by alias ID, nullptr = alias not attached
+  ServerData *servers[256] = { nullptr };
+
+  // One cached response. Responses are stored mapped back to the alias ID already.
+  struct CacheEntry {
+    ModbusMessage response;       // the cached response
+    uint32_t cachedAt;            // millis() timestamp the response arrived
+  };
+
+  // cacheKey: pack alias ID, FC and the 4 PDU data bytes (address/count) into one value
+  static uint64_t cacheKey(ModbusMessage& msg) {
+    return ((uint64_t)msg[0] << 40) | ((uint64_t)msg[1] << 32) |
+           ((uint64_t)msg[2] << 24) | ((uint64_t)msg[3] << 16) |
+           ((uint64_t)msg[4] << 8)  |  (uint64_t)msg[5];
+  }
+
+  // isCacheableRead: plain read requests (FC 01..04, address + count) only
+  static bool isCacheableRead(ModbusMessage& msg) {
+    return msg.getFunctionCode() >= READ_COIL && msg.getFunctionCode() <= READ_INPUT_REGISTER && msg.size() == 6;
+  }
+
+  uint32_t cacheTTL = 0;          // Cache time-to-live in ms; 0 = caching disabled
+  uint16_t cacheLimit = 0;        // Maximum number of cached responses
+  std::map<uint64_t, CacheEntry> cache;  // Cached responses by request key
+  std::set<uint64_t> cacheFetching;      // Keys with a downstream transaction under way
+  #if USE_MUTEX
+  std::mutex cacheLock;           // mutex protecting cache and cacheFetching
+  #endif
 };
 
 // Constructor for TCP variants
@@ -97,10 +161,10 @@ ModbusBridge<SERVERCLASS>::ModbusBridge(HardwareSerial& serial, uint32_t timeout
 template<typename SERVERCLASS>
 ModbusBridge<SERVERCLASS>::~ModbusBridge() { 
   // Release ServerData storage in servers array
-  for (auto itr = servers.begin(); itr != servers.end(); itr++) {
-    delete (itr->second);
+  for (auto& server : servers) {
+    delete server;
+    server = nullptr;
   }
-  servers.clear();
 }
 
 // attachServer: memorize the access data for an external server with ID serverID under bridge ID aliasID
@@ -108,8 +172,8 @@ template<typename SERVERCLASS>
 bool ModbusBridge<SERVERCLASS>::attachServer(uint8_t aliasID, uint8_t serverID, uint8_t functionCode, ModbusClient *client, IPAddress host, uint16_t port) {
 
   // Is there already an entry for the aliasID?
-  if (servers.find(aliasID) == servers.end()) {
-    // No. Store server data in map.
+  if (servers[aliasID] == nullptr) {
+    // No. Store server data in routing table.
 
     // Do we have a port number?
     if (port != 0) {
@@ -131,8 +195,9 @@ bool ModbusBridge<SERVERCLASS>::attachServer(uint8_t aliasID, uint8_t serverID,
 template<typename SERVERCLASS>
 bool ModbusBridge<SERVERCLASS>::addFunctionCode(uint8_t aliasID, uint8_t functionCode) {
   // Is there already an entry for the aliasID?
-  if (servers.find(aliasID) != servers.end()) {
-    // Yes. Link server to own worker function
+  if (servers[aliasID] != nullptr) {
+    // Yes. Allow the FC and link server to own worker function
+    servers[aliasID]->allowFC(functionCode);
     this->registerWorker(aliasID, functionCode, std::bind(&ModbusBridge<SERVERCLASS>::bridgeWorker, this, std::placeholders::_1));
     LOG_D("FC %02X added for server %02X\n", functionCode, aliasID);
   } else {
@@ -145,8 +210,9 @@ bool ModbusBridge<SERVERCLASS>::addFunctionCode(uint8_t aliasID, uint8_t functio
 template<typename SERVERCLASS>
 bool ModbusBridge<SERVERCLASS>::denyFunctionCode(uint8_t aliasID, uint8_t functionCode) {
   // Is there already an entry for the aliasID?
-  if (servers.find(aliasID) != servers.end()) {
-    // Yes. Link server to own worker function
+  if (servers[aliasID] != nullptr) {
+    // Yes. Deny the FC and link server to own worker function
+    servers[aliasID]->denyFC(functionCode);
     this->registerWorker(aliasID, functionCode, std::bind(&ModbusBridge<SERVERCLASS>::bridgeDenyWorker, this, std::placeholders::_1));
     LOG_D("FC %02X blocked for server %02X\n", functionCode, aliasID);
   } else {
@@ -156,41 +222,117 @@ bool ModbusBridge<SERVERCLASS>::denyFunctionCode(uint8_t aliasID, uint8_t functi
   return true;
 }
 
-// bridgeWorker: default worker function to process bridge requests
+// useResponseCache: enable (or ttl = 0: disable) the response cache
+template<typename SERVERCLASS>
+void ModbusBridge<SERVERCLASS>::useResponseCache(uint32_t ttl, uint16_t maxEntries) {
+  LOCK_GUARD(cl, cacheLock);
+  cacheTTL = ttl;
+  cacheLimit = maxEntries ? maxEntries : 1;
+  if (!ttl) cache.clear();
+  LOG_D("Response cache %s: TTL %dms, %d entries\n", ttl ? "enabled" : "disabled", ttl, maxEntries);
+}
+
+// clearResponseCache: drop all cached responses
 template<typename SERVERCLASS>
-ModbusMessage ModbusBridge<SERVERCLASS>::bridgeWorker(ModbusMessage msg) {
+void ModbusBridge<SERVERCLASS>::clearResponseCache() {
+  LOCK_GUARD(cl, cacheLock);
+  cache.clear();
+}
+
+// bridgeWorker: default worker function to process bridge requests.
+// The request comes in by reference - the only copy made is the one the
+// downstream client's queue has to own anyway.
+template<typename SERVERCLASS>
+ModbusMessage ModbusBridge<SERVERCLASS>::bridgeWorker(ModbusMessage& msg) {
   uint8_t aliasID = msg.getServerID();
   uint8_t functionCode = msg.getFunctionCode();
   ModbusMessage response;
 
-  // Find the (alias) serverID
-  if (servers.find(aliasID) != servers.end()) {
-    // Found it. We may use servers[aliasID] now without allocating a new map slot
+  // Resolve the (alias) serverID - a single indexed load
+  ServerData *target = servers[aliasID];
+  // Attached, and the FC allowed? (one bit test)
+  if (target && target->isAllowedFC(functionCode)) {
+
+    // Cache enabled and a cacheable read request?
+    bool cacheable = (cacheTTL > 0) && isCacheableRead(msg);
+    bool fetchOwner = false;
+    uint64_t key = 0;
+    if (cacheable) {
+      key = cacheKey(msg);
+      // Waiting on another task's downstream transaction is bounded - should the
+      // fetching task die on us, we go downstream ourselves
+      uint32_t waitStart = millis();
+      while (true) {
+        {
+          LOCK_GUARD(cl, cacheLock);
+          // Do we have a live cached response?
+          auto it = cache.find(key);
+          if (it != cache.end() && millis() - it->second.cachedAt < cacheTTL) {
+            // Yes. Serve it without a downstream transaction
+            LOG_D("Cache hit (%02X/%02X)\n", aliasID, functionCode);
+            return it->second.response;
+          }
+          // No. Is another task already fetching this very response?
+          if (cacheFetching.count(key) == 0) {
+            // No - we will do it, and the others shall wait for us
+            cacheFetching.insert(key);
+            fetchOwner = true;
+            break;
+          }
+        }
+        // A concurrent identical request is under way - wait for its response
+        if (millis() - waitStart >= cacheTTL + 2000) break;
+        delay(1);
+      }
+    }
 
     // Set real target server ID
-    msg.setServerID(servers[aliasID]->serverID);
+    msg.setServerID(target->serverID);
 
     // Issue the request
-    LOG_D("Request (%02X/%02X) sent\n", servers[aliasID]->serverID, functionCode);
+    LOG_D("Request (%02X/%02X) sent\n", target->serverID, functionCode);
     // TCP servers have a target host/port that needs to be set in the client
-    if (servers[aliasID]->serverType == TCP_SERVER) {
-      response = reinterpret_cast<ModbusClientTCP *>(servers[aliasID]->client)->syncRequestMT(msg, (uint32_t)millis(), servers[aliasID]->host, servers[aliasID]->port);
+    if (target->serverType == TCP_SERVER) {
+      response = reinterpret_cast<ModbusClientTCP *>(target->client)->syncRequestMT(msg, (uint32_t)millis(), target->host, target->port);
     } else {
-      response = servers[aliasID]->client->syncRequestM(msg, (uint32_t)millis());
+      response = target->client->syncRequestM(msg, (uint32_t)millis());
     }
 
-    // Re-set the requested server ID
+    // Re-set the requested server ID - in the response, and in the request,
+    // which we only borrowed from the server
     response.setServerID(aliasID);
+    msg.setServerID(aliasID);
+
+    if (cacheable) {
+      LOCK_GUARD(cl, cacheLock);
+      // Cache data responses only - errors shall be seen by every requester
+      if (response.getError() == SUCCESS) {
+        // Cache full and the key not stored yet?
+        if (cache.size() >= cacheLimit && cache.count(key) == 0) {
+          // Yes - evict the oldest entry
+          auto oldest = cache.begin();
+          for (auto it = cache.begin(); it != cache.end(); ++it) {
+            if (millis() - it->second.cachedAt > millis() - oldest->second.cachedAt) oldest = it;
+          }
+          cache.erase(oldest);
+        }
+        CacheEntry& e = cache[key];
+        e.response = response;
+        e.cachedAt = millis();
+      }
+      // Release the waiters, if we held the fetch
+      if (fetchOwner) cacheFetching.erase(key);
+    }
   } else {
-    // If we get here, something has gone wrong internally. We send back an error response anyway.
-    response.setError(aliasID, functionCode, INVALID_SERVER);
+    // Not attached, or the FC is not allowed for the alias
+    response.setError(aliasID, functionCode, target ? ILLEGAL_FUNCTION : INVALID_SERVER);
   }
   return response;
 }
 
 // bridgeDenyWorker: worker function to block function codes
 template<typename SERVERCLASS>
-ModbusMessage ModbusBridge<SERVERCLASS>::bridgeDenyWorker(ModbusMessage msg) {
+ModbusMessage ModbusBridge<SERVERCLASS>::bridgeDenyWorker(ModbusMessage& msg) {
   ModbusMessage response;
   response.setError(msg.getServerID(), msg.getFunctionCode(), ILLEGAL_FUNCTION);
   return response;
@@ -2,6 +2,7 @@
 // eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
 //               MIT license - see license.md for details
 // =================================================================================================
+#include <algorithm>
 #include "ModbusClient.h"
 #undef LOCAL_LOG_LEVEL
 #include "Logging.h"
@@ -19,7 +20,22 @@ ModbusClient::ModbusClient() :
   #endif
   onData(nullptr),
   onError(nullptr),
-  onResponse(nullptr) { instanceCounter++; }
+  onResponse(nullptr),
+  gatherSeq(0) { instanceCounter++; }
+
+// Destructor: free logical reads that never completed
+ModbusClient::~ModbusClient() {
+  // Several chunks share one op - collect each only once
+  std::vector<GatherOp *> ops;
+  for (auto& chunk : gatherChunks) {
+    if (std::find(ops.begin(), ops.end(), chunk.second.op) == ops.end()) {
+      ops.push_back(chunk.second.op);
+    }
+  }
+  for (auto *op : ops) {
+    delete op;
+  }
+}
 
 // onDataHandler: register callback for data responses
 bool ModbusClient::onDataHandler(MBOnData handler) {
@@ -67,11 +83,167 @@ uint32_t ModbusClient::getErrorCount() {
 
 // resetCounts: Set both message and error counts to zero
 void ModbusClient::resetCounts() {
+  messageCount = 0;
+  errorCount = 0;
+  stats.reset();
+}
+
+// addRequests: enqueue a whole batch of (request, token) pairs in one call.
+// The request queues being lock-free rings, entries go in back to back without
+// any lock handover or per-entry worker wakeup in between.
+std::vector<Error> ModbusClient::addRequests(std::vector<std::pair<ModbusMessage, uint32_t>>&& batch, RequestPriority priority) {
+  std::vector<Error> results;
+  results.reserve(batch.size());
+  for (auto& entry : batch) {
+    // Is the message valid at all?
+    if (!entry.first) {
+      // No - reject it here; addRequestM() would silently skip it
+      results.push_back(EMPTY_MESSAGE);
+      continue;
+    }
+    results.push_back(addRequestMP(std::move(entry.first), entry.second, priority));
+  }
+  batch.clear();
+  return results;
+}
+
+// readRegisters: split an oversized logical read into chunks and fire them
+Error ModbusClient::readRegisters(uint32_t token, uint8_t serverID, uint8_t functionCode, uint16_t address, uint16_t words, MBOnGather handler, RequestPriority priority) {
+  // Only plain register reads can be gathered
+  if (functionCode != READ_HOLD_REGISTER && functionCode != READ_INPUT_REGISTER) {
+    return ILLEGAL_FUNCTION;
+  }
+  // We need at least one register and a handler to deliver the buffer to
+  if (words == 0 || !handler) {
+    return PARAMETER_COUNT_ERROR;
+  }
+  // The span must fit the register address space
+  if ((uint32_t)address + words > 0x10000) {
+    return PARAMETER_LIMIT_ERROR;
+  }
+
+  // Set up the gather buffer and the chunk layout
+  GatherOp *op = new GatherOp();
+  op->token = token;
+  op->serverID = serverID;
+  op->functionCode = functionCode;
+  op->values.resize(words);
+  uint16_t numChunks = (words + 124) / 125;
+  op->chunksLeft = numChunks;
+  op->firstError = SUCCESS;
+  op->handler = handler;
+
+  // Register all chunks up front - responses may arrive while we still enqueue
+  std::vector<uint32_t> chunkTokens(numChunks);
   {
-    LOCK_GUARD(cntLock, countAccessM);
-    messageCount = 0;
-    errorCount = 0;
+    LOCK_GUARD(lg, gatherLock);
+    uint16_t offset = 0;
+    for (uint16_t i = 0; i < numChunks; ++i) {
+      uint16_t chunkWords = (uint16_t)(words - offset) > 125 ? 125 : (uint16_t)(words - offset);
+      chunkTokens[i] = 0xA6000000 | (gatherSeq++ & 0x00FFFFFF);
+      gatherChunks[chunkTokens[i]] = GatherChunk{ op, offset, chunkWords };
+      offset += chunkWords;
+    }
+  }
+
+  // Fire the chunk requests back to back - the transport pipelines them
+  Error rc = SUCCESS;
+  uint16_t offset = 0;
+  for (uint16_t i = 0; i < numChunks; ++i) {
+    uint16_t chunkWords = (uint16_t)(words - offset) > 125 ? 125 : (uint16_t)(words - offset);
+    ModbusMessage m;
+    m.setMessage(serverID, functionCode, (uint16_t)(address + offset), chunkWords);
+    rc = addRequestMP(std::move(m), chunkTokens[i], priority);
+    // Enqueue failed?
+    if (rc != SUCCESS) {
+      // Yes. Withdraw this and all remaining chunks
+      bool done = false;
+      {
+        LOCK_GUARD(lg, gatherLock);
+        for (uint16_t k = i; k < numChunks; ++k) {
+          gatherChunks.erase(chunkTokens[k]);
+        }
+        op->chunksLeft -= numChunks - i;
+        if (op->firstError == SUCCESS) op->firstError = rc;
+        done = (op->chunksLeft == 0);
+      }
+      // Nothing made it onto the queue at all? Then the error return covers it
+      if (done) {
+        delete op;
+      }
+      break;
+    }
+    offset += chunkWords;
+  }
+  return rc;
+}
+
+// gatherResponse: route a chunk response of a logical read into its gather buffer
+bool ModbusClient::gatherResponse(uint32_t token, ModbusMessage& response) {
+  // Cheap namespace test before touching the map
+  if ((token & 0xFF000000) != 0xA6000000) return false;
+  GatherChunk chunk;
+  {
+    LOCK_GUARD(lg, gatherLock);
+    auto it = gatherChunks.find(token);
+    // A user token that merely looks like a chunk token?
+    if (it == gatherChunks.end()) return false;
+    chunk = it->second;
+    gatherChunks.erase(it);
+  }
+  GatherOp *op = chunk.op;
+
+  // A data response carrying all registers the chunk asked for?
+  Error chunkError = response.getError();
+  if (chunkError == SUCCESS && (response.size() < 3u + chunk.words * 2 || response[2] != chunk.words * 2)) {
+    chunkError = PACKET_LENGTH_ERROR;
+  }
+  if (chunkError == SUCCESS) {
+    // Yes. Fill the chunk's slice of the gather buffer in place
+    for (uint16_t i = 0; i < chunk.words; ++i) {
+      op->values[chunk.offsetWords + i] = (response[3 + 2 * i] << 8) | response[4 + 2 * i];
+    }
+  }
+  bool done = false;
+  {
+    LOCK_GUARD(lg, gatherLock);
+    // Keep the first error for the completion handler
+    if (chunkError != SUCCESS && op->firstError == SUCCESS) op->firstError = chunkError;
+    done = (--op->chunksLeft == 0);
+  }
+  // Last chunk in?
+  if (done) {
+    // Yes. Hand the buffer over and drop the op
+    op->handler(op->firstError, std::move(op->values), op->token);
+    delete op;
   }
+  return true;
+}
+
+// isPlainRead: is the message a plain FC 03/04 register read (address plus count)?
+bool ModbusClient::isPlainRead(ModbusMessage& msg) {
+  return (msg.getFunctionCode() == READ_HOLD_REGISTER || msg.getFunctionCode() == READ_INPUT_REGISTER)
+    && msg.size() == 6;
+}
+
+// sliceReadResponse: cut the part of a coalesced read response that belongs to one
+// of the original requests, rebuilt as a response of its own
+ModbusMessage ModbusClient::sliceReadResponse(ModbusMessage& merged, uint16_t spanStart, ModbusMessage& originalRequest) {
+  ModbusMessage response;
+  uint16_t start = (originalRequest[2] << 8) | originalRequest[3];
+  uint16_t count = (originalRequest[4] << 8) | originalRequest[5];
+  // Register values start behind serverID, FC and length byte
+  uint32_t offset = 3 + (start - spanStart) * 2;
+  // Are all requested register values present in the merged response?
+  if (offset + count * 2 <= merged.size()) {
+    // Yes. Rebuild the response the requester would have gotten on its own
+    response.add(merged.getServerID(), merged.getFunctionCode(), (uint8_t)(count * 2));
+    response.add(merged.data() + offset, count * 2);
+  } else {
+    // No, the server returned fewer bytes than the span required
+    response.setError(merged.getServerID(), merged.getFunctionCode(), PACKET_LENGTH_ERROR);
+  }
+  return response;
 }
 
 // waitSync: wait for response on syncRequest to arrive
@@ -82,6 +254,14 @@ ModbusMessage ModbusClient::waitSync(uint8_t serverID, uint8_t functionCode, uin
   // Default response is TIMEOUT
   response.setError(serverID, functionCode, TIMEOUT);
 
+#if HAS_FREERTOS
+  // Register ourselves as waiter for the token, so the worker task can wake us up
+  {
+    LOCK_GUARD(lg, syncRespM);
+    syncWaiters[token] = xTaskGetCurrentTaskHandle();
+  }
+#endif
+
   // Loop 60 seconds, if unlucky
   while (millis() - lostPatience < 60000) {
     {
@@ -90,14 +270,104 @@ ModbusMessage ModbusClient::waitSync(uint8_t serverID, uint8_t functionCode, uin
       auto sR = syncResponse.find(token);
       // Is it there?
       if (sR != syncResponse.end()) {
-        // Yes. get the response, delete it from the map and return
-        response = sR->second;
+        // Yes. Move the response out of the map, delete the entry and return
+        response = std::move(sR->second);
         syncResponse.erase(sR);
         break;
       }
     }
-    // Give the watchdog time to act
+#if HAS_FREERTOS
+    // Sleep until the worker task posts our response - re-check once a second regardless,
+    // to be independent of stray notifications
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+#elif IS_LINUX
+    // Sleep until the worker thread posts a response - re-check once a second regardless
+    {
+      std::unique_lock<std::mutex> lk(syncRespM);
+      syncRespCV.wait_for(lk, std::chrono::milliseconds(1000),
+        [this, token]() { return syncResponse.count(token) != 0; });
+    }
+#else
+    // No scheduling primitives available - poll, giving the watchdog time to act
     delay(10);
+#endif
   }
+
+#if HAS_FREERTOS
+  // De-register as waiter again - mandatory in case we timed out
+  {
+    LOCK_GUARD(lg, syncRespM);
+    syncWaiters.erase(token);
+  }
+#endif
   return response;
 }
+
+// postSyncResponse: hand in a response for a waiting syncRequest and wake the waiter
+void ModbusClient::postSyncResponse(uint32_t token, ModbusMessage response) {
+#if HAS_FREERTOS
+  TaskHandle_t waiter = nullptr;
+  {
+    LOCK_GUARD(lg, syncRespM);
+    syncResponse[token] = std::move(response);
+    // Is the requesting task waiting already?
+    auto w = syncWaiters.find(token);
+    if (w != syncWaiters.end()) {
+      waiter = w->second;
+    }
+  }
+  // Wake the waiting task, if any - else it will find the response on its first look
+  if (waiter) {
+    xTaskNotifyGive(waiter);
+  }
+#elif IS_LINUX
+  {
+    LOCK_GUARD(lg, syncRespM);
+    // Is a requestAsync() future waiting for this token?
+    auto fp = futurePromises.find(token);
+    if (fp != futurePromises.end()) {
+      // Yes. Fulfill its promise instead of parking the response
+      fp->second.set_value(std::move(response));
+      futurePromises.erase(fp);
+      return;
+    }
+    syncResponse[token] = std::move(response);
+  }
+  syncRespCV.notify_all();
+#else
+  LOCK_GUARD(lg, syncRespM);
+  syncResponse[token] = std::move(response);
+#endif
+}
+
+#if IS_LINUX
+// requestAsync: future-returning request. The response travels the sync request
+// plumbing, but fulfills the filed promise instead of waking a blocked waiter.
+std::future<ModbusMessage> ModbusClient::requestAsync(ModbusMessage m, uint32_t token) {
+  std::promise<ModbusMessage> p;
+  std::future<ModbusMessage> f = p.get_future();
+  // Remember the header data - the message is moved into the queue
+  uint8_t serverID = m.getServerID();
+  uint8_t functionCode = m.getFunctionCode();
+
+  // File the promise first - the response may arrive before we are back
+  {
+    LOCK_GUARD(lg, syncRespM);
+    futurePromises[token] = std::move(p);
+  }
+
+  Error rc = m ? queueSyncRequestM(std::move(m), token) : EMPTY_MESSAGE;
+  if (rc != SUCCESS) {
+    // Not queued - take the promise back and fail it with an error response
+    LOCK_GUARD(lg, syncRespM);
+    auto fp = futurePromises.find(token);
+    if (fp != futurePromises.end()) {
+      ModbusMessage response;
+      response.setError(serverID, functionCode, rc);
+      fp->second.set_value(std::move(response));
+      futurePromises.erase(fp);
+    }
+  }
+  return f;
+}
+#endif
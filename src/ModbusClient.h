@@ -5,10 +5,18 @@
 #ifndef _MODBUS_CLIENT_H
 #define _MODBUS_CLIENT_H
 
-#include <functional> 
+#include <functional>
 #include <map>
+#include <vector>
+#include <utility>
+#include <atomic>
 #include "options.h"
 #include "ModbusMessage.h"
+#include "RequestTemplate.h"
+#include "ModbusStats.h"
+#if MODBUS_LATENCY_STATS
+#include "ModbusLatency.h"
+#endif
 
 #if HAS_FREERTOS
 extern "C" {
@@ -17,6 +25,8 @@ extern "C" {
 }
 #elif IS_LINUX
 #include <pthread.h>
+#include <condition_variable>       // NOLINT
+#include <future>                   // NOLINT
 #endif
 
 #if USE_MUTEX
@@ -25,9 +35,21 @@ using std::mutex;
 using std::lock_guard;
 #endif
 
+// Priority lanes for client requests - see addRequest()/syncRequest().
+// Higher lanes are drained first by interfaces supporting them (currently the
+// RTU client); others treat every request as PRIO_NORMAL.
+enum RequestPriority : uint8_t {
+  PRIO_NORMAL = 0,   // Telemetry and bulk requests (the default)
+  PRIO_HIGH   = 1,   // Time-sensitive requests
+  PRIO_URGENT = 2,   // Operator/control-path commands - jump all queued polls
+};
+
 typedef std::function<void(ModbusMessage msg, uint32_t token)> MBOnData;
 typedef std::function<void(Modbus::Error errorCode, uint32_t token)> MBOnError;
 typedef std::function<void(ModbusMessage msg, uint32_t token)> MBOnResponse;
+// Completion handler for readRegisters(): the gathered values (moved in), the
+// first error encountered (SUCCESS if none) and the token of the logical read
+typedef std::function<void(Modbus::Error errorCode, std::vector<uint16_t> values, uint32_t token)> MBOnGather;
 
 class ModbusClient {
 public:
@@ -37,8 +59,49 @@ public:
   uint32_t getMessageCount();             // Informative: return number of messages created
   uint32_t getErrorCount();              // Informative: return number of errors received
   void resetCounts();                    // Set both message and error counts to zero
-  inline Error addRequest(ModbusMessage m, uint32_t token) { return addRequestM(m, token); }
-  inline ModbusMessage syncRequest(ModbusMessage m, uint32_t token) { return syncRequestM(m, token); }
+  // getCounts: coherent snapshot of the per-FC statistics for one addressed serverID,
+  // readable at any time without stopping the worker
+  ModbusStats::Snapshot getCounts(uint8_t serverID) const { return stats.getSnapshot(serverID); }
+#if MODBUS_LATENCY_STATS
+  // getLatencyStats: per-phase latency histograms for one addressed serverID
+  ModbusLatency::Snapshot getLatencyStats(uint8_t serverID) const { return latency.getSnapshot(serverID); }
+#endif
+  inline Error addRequest(ModbusMessage m, uint32_t token, RequestPriority priority = PRIO_NORMAL) { return addRequestMP(std::move(m), token, priority); }
+  // addRequests: enqueue a whole batch of (request, token) pairs in one call - e.g. a
+  // complete poll cycle at its start. The messages are moved, not copied, into the
+  // queue, and one Error per entry is returned, in batch order, so a rejected entry
+  // (invalid message, queue full) is attributable. The batch is left empty.
+  std::vector<Error> addRequests(std::vector<std::pair<ModbusMessage, uint32_t>>&& batch, RequestPriority priority = PRIO_NORMAL);
+  // readRegisters: logical read of a register span of arbitrary length. A span
+  // beyond the protocol limit of 125 registers per request is split into
+  // protocol-legal chunks, enqueued back to back so the transport pipelines
+  // them, and every completing chunk fills its slice of one preallocated
+  // buffer in place - no per-chunk reallocation, no stitching pass in the
+  // application. The handler is called exactly once, with the complete buffer
+  // (moved in) and the first chunk error encountered - on error, slices of
+  // failed chunks are left zeroed. functionCode must be READ_HOLD_REGISTER or
+  // READ_INPUT_REGISTER. Internal chunk tokens use the 0xA6 namespace, so
+  // application tokens with high byte 0xA6 are to be avoided. If not all
+  // chunks fit the request queue, the enqueue error is returned; the handler
+  // still reports the chunks that did go out, unless none did.
+  Error readRegisters(uint32_t token, uint8_t serverID, uint8_t functionCode, uint16_t address, uint16_t words, MBOnGather handler, RequestPriority priority = PRIO_NORMAL);
+  inline ModbusMessage syncRequest(ModbusMessage m, uint32_t token, RequestPriority priority = PRIO_NORMAL) { return syncRequestMP(std::move(m), token, priority); }
+
+  // addRequest/syncRequest from a precompiled RequestTemplate: validation and
+  // byte assembly happened once in RequestTemplate::create(), so enqueuing a
+  // poll cycle is just a copy of the prebuilt bytes per request
+  inline Error addRequest(const RequestTemplate& tmpl, uint32_t token, RequestPriority priority = PRIO_NORMAL) {
+    if (!tmpl.valid()) return tmpl.error();
+    return addRequestTP(tmpl, token, priority);
+  }
+  inline ModbusMessage syncRequest(const RequestTemplate& tmpl, uint32_t token, RequestPriority priority = PRIO_NORMAL) {
+    if (!tmpl.valid()) {
+      ModbusMessage m;
+      m.setError(tmpl.message().getServerID(), tmpl.message().getFunctionCode(), tmpl.error());
+      return m;
+    }
+    return syncRequestTP(tmpl, token, priority);
+  }
 
   // Template function to generate syncRequest functions as long as there is a 
   // matching ModbusMessage::setMessage() call
@@ -51,13 +114,14 @@ public:
 
     // Add it to the queue and wait for a response, if valid
     if (rc == SUCCESS) {
-      return syncRequestM(m, token);
+      return syncRequestM(std::move(m), token);
     } 
     // Else return the error as a message
     return buildErrorMsg(rc, std::forward<Args>(args) ...);
   }
 
-  // Template function to create an error response message from a variadic pattern
+  // Template function to create an error response message from a variadic pattern.
+  // The three error PDU bytes fit the message's inline buffer - no allocation here.
   template <typename... Args>
   ModbusMessage buildErrorMsg(Error e, uint8_t serverID, uint8_t functionCode, Args&&... args) {
     ModbusMessage m;
@@ -77,24 +141,131 @@ public:
 
     // Add it to the queue, if valid
     if (rc == SUCCESS) {
-      return addRequestM(m, token);
+      return addRequestM(std::move(m), token);
+    }
+    // Else return the error
+    return rc;
+  }
+
+  // Priority lane variants of the generator templates, priority first
+  template <typename... Args>
+  Error addRequest(RequestPriority priority, uint32_t token, Args&&... args) {
+    Error rc = SUCCESS;        // Return value
+
+    // Create request, if valid
+    ModbusMessage m;
+    rc = m.setMessage(std::forward<Args>(args) ...);
+
+    // Add it to the queue, if valid
+    if (rc == SUCCESS) {
+      return addRequestMP(std::move(m), token, priority);
     }
     // Else return the error
     return rc;
   }
 
+  template <typename... Args>
+  ModbusMessage syncRequest(RequestPriority priority, uint32_t token, Args&&... args) {
+    Error rc = SUCCESS;
+    // Create request, if valid
+    ModbusMessage m;
+    rc = m.setMessage(std::forward<Args>(args) ...);
+
+    // Add it to the queue and wait for a response, if valid
+    if (rc == SUCCESS) {
+      return syncRequestMP(std::move(m), token, priority);
+    }
+    // Else return the error as a message
+    return buildErrorMsg(rc, std::forward<Args>(args) ...);
+  }
+
+#if IS_LINUX
+  // requestAsync: future-returning variant of addRequest(). The request is
+  // queued without blocking the caller; the returned std::future yields the
+  // response once it arrives - error responses (TIMEOUT included) come as
+  // regular error messages. Any number of requests can be kept in flight with
+  // structured completion, no thread blocked per outstanding call and no token
+  // bookkeeping in handlers. The token must be unique among the outstanding
+  // requests, as with every other request variant.
+  std::future<ModbusMessage> requestAsync(ModbusMessage m, uint32_t token);
+
+  // Template function to generate requestAsync functions as long as there is a
+  // matching ModbusMessage::setMessage() call
+  template <typename... Args>
+  std::future<ModbusMessage> requestAsync(uint32_t token, Args&&... args) {
+    // Create request, if valid
+    ModbusMessage m;
+    Error rc = m.setMessage(std::forward<Args>(args) ...);
+    if (rc != SUCCESS) {
+      // Invalid - return a future holding the error as a message
+      std::promise<ModbusMessage> p;
+      p.set_value(buildErrorMsg(rc, std::forward<Args>(args) ...));
+      return p.get_future();
+    }
+    return requestAsync(std::move(m), token);
+  }
+#endif
+
 protected:
   ModbusClient();             // Default constructor
+  ~ModbusClient();            // Destructor: free logical reads that never completed
   virtual void isInstance() = 0;   // Make class abstract
   ModbusMessage waitSync(uint8_t serverID, uint8_t functionCode, uint32_t token); // wait for syncRequest response to arrive
+  void postSyncResponse(uint32_t token, ModbusMessage response); // hand in a response (moved in) and wake the waiting task
   // Virtual addRequest variant needed internally. All others done by template!
   virtual Error addRequestM(ModbusMessage msg, uint32_t token) = 0;
   // Virtual syncRequest variant following the same pattern
   virtual ModbusMessage syncRequestM(ModbusMessage msg, uint32_t token) = 0;
-  
+  // Priority-aware variants. Interfaces without priority lanes fall back to
+  // the plain single queue, ignoring the priority
+  virtual Error addRequestMP(ModbusMessage msg, uint32_t token, RequestPriority) { return addRequestM(std::move(msg), token); }
+  virtual ModbusMessage syncRequestMP(ModbusMessage msg, uint32_t token, RequestPriority) { return syncRequestM(std::move(msg), token); }
+  // RequestTemplate variants - a transport may override to reuse wire extras
+  // cached in the template (the RTU client caches the frame's CRC16)
+  virtual Error addRequestTP(const RequestTemplate& tmpl, uint32_t token, RequestPriority priority) { return addRequestMP(tmpl.message(), token, priority); }
+  virtual ModbusMessage syncRequestTP(const RequestTemplate& tmpl, uint32_t token, RequestPriority priority) { return syncRequestMP(tmpl.message(), token, priority); }
+#if IS_LINUX
+  // queueSyncRequestM: enqueue a request whose response is to be delivered via
+  // postSyncResponse(), but return instead of waiting - backing for requestAsync().
+  // Interfaces not overriding it do not support futures.
+  virtual Error queueSyncRequestM(ModbusMessage msg, uint32_t token) { return UNDEFINED_ERROR; }
+#endif
+
+  // One oversized logical read in flight - see readRegisters()
+  struct GatherOp {
+    uint32_t token;                 // The application's token
+    uint8_t serverID;
+    uint8_t functionCode;
+    std::vector<uint16_t> values;   // The gather buffer, chunks fill it in place
+    uint16_t chunksLeft;            // Outstanding chunk responses
+    Error firstError;               // First chunk error seen, SUCCESS if none
+    MBOnGather handler;             // Completion callback
+  };
+  // One protocol-legal chunk of a GatherOp, keyed by its internal request token
+  struct GatherChunk {
+    GatherOp *op;                   // The logical read the chunk belongs to
+    uint16_t offsetWords;           // First word of the chunk within the buffer
+    uint16_t words;                 // Number of registers the chunk reads
+  };
+  // gatherResponse: route a chunk response into its gather buffer. Returns true
+  // if the token belonged to a logical read, so the transports' respond() must
+  // skip the user handlers for it.
+  bool gatherResponse(uint32_t token, ModbusMessage& response);
 
-  uint32_t messageCount;           // Number of requests generated. Used for transactionID in TCPhead
-  uint32_t errorCount;             // Number of errors received
+  // isPlainRead: is the message a plain FC 03/04 register read (address plus count)?
+  // Only these are candidates for read coalescing in the interface clients.
+  static bool isPlainRead(ModbusMessage& msg);
+  // sliceReadResponse: cut the part of a coalesced read response that belongs to one
+  // of the original requests, rebuilt as a response of its own
+  static ModbusMessage sliceReadResponse(ModbusMessage& merged, uint16_t spanStart, ModbusMessage& originalRequest);
+
+
+  std::atomic<uint32_t> messageCount; // Number of requests generated. Used for transactionID in TCPhead
+  std::atomic<uint32_t> errorCount;   // Number of errors received
+  ModbusStats stats;               // Per-serverID/per-FC tallies
+#if MODBUS_LATENCY_STATS
+  ModbusLatency latency;           // Per-serverID latency histograms
+#endif
 #if HAS_FREERTOS
   TaskHandle_t worker;             // Interface instance worker task
 #elif IS_LINUX
@@ -105,13 +276,23 @@ protected:
   MBOnResponse onResponse;         // Uniform response handler
   static uint16_t instanceCounter; // Number of ModbusClients created
   std::map<uint32_t, ModbusMessage> syncResponse; // Map to hold response messages on synchronous requests
+  std::map<uint32_t, GatherChunk> gatherChunks; // Logical read chunks in flight, by internal token
+  uint32_t gatherSeq;              // Internal chunk token sequence for readRegisters()
+#if HAS_FREERTOS
+  std::map<uint32_t, TaskHandle_t> syncWaiters; // Tasks blocked in waitSync(), by token
+#elif IS_LINUX
+  std::condition_variable syncRespCV; // Signalled whenever a sync response is posted
+  std::map<uint32_t, std::promise<ModbusMessage>> futurePromises; // requestAsync() promises awaiting their response, by token
+#endif
 #if USE_MUTEX
   std::mutex syncRespM;            // Mutex protecting syncResponse map against race conditions
-  std::mutex countAccessM;         // Mutex protecting access to the message and error counts
+  std::mutex gatherLock;           // Protects gatherChunks and the GatherOp bookkeeping
 #endif
 
   // Let any ModbusBridge class use protected members
   template<typename SERVERCLASS> friend class ModbusBridge;
+  // The poll scheduler enqueues due requests via addRequestM()
+  friend class ModbusPoller;
 };
 
 #endif
@@ -10,9 +10,16 @@
 // #define LOCAL_LOG_LEVEL LOG_LEVEL_VERBOSE
 #include "Logging.h"
 
+// Init shared worker state
+TaskHandle_t ModbusClientRTU::sharedWorker = nullptr;
+std::vector<ModbusClientRTU::SharedBus> *ModbusClientRTU::sharedBuses = nullptr;
+
 // Constructor takes Serial reference and optional DE/RE pin
 ModbusClientRTU::ModbusClientRTU(HardwareSerial& serial, int8_t rtsPin, uint16_t queueLimit) :
   ModbusClient(),
+  requests(queueLimit),
+  requestsHigh(queueLimit),
+  requestsUrgent(queueLimit),
   MR_serial(serial),
   MR_lastMicros(micros()),
   MR_interval(2000),
@@ -20,7 +27,10 @@ ModbusClientRTU::ModbusClientRTU(HardwareSerial& serial, int8_t rtsPin, uint16_t
   MR_qLimit(queueLimit),
   MR_timeoutValue(DEFAULTTIMEOUT),
   MR_useASCII(false),
-  MR_skipLeadingZeroByte(false) {
+  MR_skipLeadingZeroByte(false),
+  MR_coalesceReads(false),
+  MR_highRate(false),
+  MR_burst(nullptr) {
     if (MR_rtsPin >= 0) {
       pinMode(MR_rtsPin, OUTPUT);
       MTRSrts = [this](bool level) {
@@ -35,6 +45,9 @@ ModbusClientRTU::ModbusClientRTU(HardwareSerial& serial, int8_t rtsPin, uint16_t
 // Alternative constructor takes Serial reference and RTS callback function
 ModbusClientRTU::ModbusClientRTU(HardwareSerial& serial, RTScallback rts, uint16_t queueLimit) :
   ModbusClient(),
+  requests(queueLimit),
+  requestsHigh(queueLimit),
+  requestsUrgent(queueLimit),
   MR_serial(serial),
   MR_lastMicros(micros()),
   MR_interval(2000),
@@ -42,7 +55,10 @@ ModbusClientRTU::ModbusClientRTU(HardwareSerial& serial, RTScallback rts, uint16
   MR_qLimit(queueLimit),
   MR_timeoutValue(DEFAULTTIMEOUT),
   MR_useASCII(false),
-  MR_skipLeadingZeroByte(false) {
+  MR_skipLeadingZeroByte(false),
+  MR_coalesceReads(false),
+  MR_highRate(false),
+  MR_burst(nullptr) {
     MR_rtsPin = -1;
     MTRSrts(LOW);
 }
@@ -53,15 +69,23 @@ ModbusClientRTU::~ModbusClientRTU() {
   end();
 }
 
-// begin: start worker task
+// begin: start worker task with the default tuning
 void ModbusClientRTU::begin(int coreID, uint32_t interval) {
+  begin(TaskConfig(6, 4096, coreID), interval);
+}
+
+// begin: start worker task with full task tuning
+void ModbusClientRTU::begin(TaskConfig tc, uint32_t interval) {
   // Only start worker if HardwareSerial has been initialized!
   if (MR_serial.baudRate()) {
     // Pull down RTS toggle, if necessary
     MTRSrts(LOW);
 
+    // Provide recycled storage for up to queue limit request entries
+    MR_pool.resize(MR_qLimit);
+
     // Set minimum interval time
-    MR_interval = RTUutils::calculateInterval(MR_serial, interval);
+    MR_interval = RTUutils::calculateInterval(MR_serial, interval, MR_highRate);
 
     // Switch serial FIFO buffer copy threshold to 1 byte (normally is 112!)
     RTUutils::UARTinit(MR_serial, 1);
@@ -70,7 +94,7 @@ void ModbusClientRTU::begin(int coreID, uint32_t interval) {
     char taskName[18];
     snprintf(taskName, 18, "Modbus%02XRTU", instanceCounter);
     // Start task to handle the queue
-    xTaskCreatePinnedToCore((TaskFunction_t)&handleConnection, taskName, 4096, this, 6, &worker, coreID >= 0 ? coreID : NULL);
+    xTaskCreatePinnedToCore((TaskFunction_t)&handleConnection, taskName, tc.stackSize, this, tc.priority, &worker, tc.coreID >= 0 ? tc.coreID : NULL);
 
     LOG_D("Worker task %d started. Interval=%d\n", (uint32_t)worker, MR_interval);
   } else {
@@ -78,25 +102,122 @@ void ModbusClientRTU::begin(int coreID, uint32_t interval) {
   }
 }
 
+// stackHighWaterMark: unused worker stack in bytes, 0 if not running
+uint32_t ModbusClientRTU::stackHighWaterMark() {
+  return worker ? uxTaskGetStackHighWaterMark(worker) : 0;
+}
+
 // end: stop worker task
 void ModbusClientRTU::end() {
   if (worker) {
-    // Clean up queue
-    {
-      // Safely lock access
-      LOCK_GUARD(lockGuard, qLock);
-      // Get all queue entries one by one
-      while (!requests.empty()) {
-        // Remove front entry
-        requests.pop();
-      }
+    // Clean up queues - get all entries one by one and recycle them
+    RequestEntry *re = nullptr;
+    while ((re = requests.pop()) != nullptr) {
+      MR_pool.release(re);
+    }
+    while ((re = requestsHigh.pop()) != nullptr) {
+      MR_pool.release(re);
+    }
+    while ((re = requestsUrgent.pop()) != nullptr) {
+      MR_pool.release(re);
     }
+    // Drop a broadcast burst that never got sent
+    delete MR_burst.exchange(nullptr);
     // Kill task
     vTaskDelete(worker);
     LOG_D("Worker task %d killed.\n", (uint32_t)worker);
   }
 }
 
+// beginShared: start the shared worker task with the default tuning
+bool ModbusClientRTU::beginShared(std::vector<ModbusClientRTU *> buses, uint32_t interval) {
+  return beginShared(buses, TaskConfig(6, 4096), interval);
+}
+
+// beginShared: start one worker task multiplexing all given buses
+bool ModbusClientRTU::beginShared(std::vector<ModbusClientRTU *> buses, TaskConfig tc, uint32_t interval) {
+  // Is a shared worker running already?
+  if (sharedWorker) {
+    LOG_E("Shared worker task is running already!\n");
+    return false;
+  }
+  // We need at least one bus
+  if (buses.empty()) {
+    LOG_E("No buses given for shared worker task!\n");
+    return false;
+  }
+  // All serial interfaces must have been initialized!
+  for (auto *client : buses) {
+    if (!client->MR_serial.baudRate()) {
+      LOG_E("Shared worker could not be started! HardwareSerial not initialized?\n");
+      return false;
+    }
+  }
+
+  // Set up every bus the way begin() would, minus the task
+  sharedBuses = new std::vector<SharedBus>();
+  sharedBuses->reserve(buses.size());
+  for (auto *client : buses) {
+    // Pull down RTS toggle, if necessary
+    client->MTRSrts(LOW);
+    // Provide recycled storage for up to queue limit request entries
+    client->MR_pool.resize(client->MR_qLimit);
+    // Set minimum interval time
+    client->MR_interval = RTUutils::calculateInterval(client->MR_serial, interval, client->MR_highRate);
+    // Switch serial FIFO buffer copy threshold to 1 byte (normally is 112!)
+    RTUutils::UARTinit(client->MR_serial, 1);
+    sharedBuses->emplace_back(client);
+  }
+
+  // Start the one task to handle all queues
+  xTaskCreatePinnedToCore((TaskFunction_t)&handleSharedConnection, "ModbusShRTU", tc.stackSize, sharedBuses, tc.priority, &sharedWorker, tc.coreID >= 0 ? tc.coreID : NULL);
+
+  LOG_D("Shared worker task %d started for %d buses.\n", (uint32_t)sharedWorker, (uint32_t)buses.size());
+  return true;
+}
+
+// endShared: stop the shared worker task and clean up all bus queues
+void ModbusClientRTU::endShared() {
+  if (sharedWorker) {
+    // Kill task first - nothing may touch the queues while we drain them
+    vTaskDelete(sharedWorker);
+    LOG_D("Shared worker task %d killed.\n", (uint32_t)sharedWorker);
+    sharedWorker = nullptr;
+    for (auto& bus : *sharedBuses) {
+      // Recycle an in-flight request (or requests, if reads were merged)
+      if (bus.request) {
+        if (bus.parts.empty()) {
+          bus.client->MR_pool.release(bus.request);
+        } else {
+          for (auto *part : bus.parts) {
+            bus.client->MR_pool.release(part);
+          }
+        }
+      }
+      // Clean up queues - get all entries one by one and recycle them
+      RequestEntry *re = nullptr;
+      while ((re = bus.client->requests.pop()) != nullptr) {
+        bus.client->MR_pool.release(re);
+      }
+      while ((re = bus.client->requestsHigh.pop()) != nullptr) {
+        bus.client->MR_pool.release(re);
+      }
+      while ((re = bus.client->requestsUrgent.pop()) != nullptr) {
+        bus.client->MR_pool.release(re);
+      }
+      // Drop a broadcast burst that never got sent
+      delete bus.client->MR_burst.exchange(nullptr);
+    }
+    delete sharedBuses;
+    sharedBuses = nullptr;
+  }
+}
+
+// sharedStackHighWaterMark: unused shared worker stack in bytes, 0 if not running
+uint32_t ModbusClientRTU::sharedStackHighWaterMark() {
+  return sharedWorker ? uxTaskGetStackHighWaterMark(sharedWorker) : 0;
+}
+
 // setTimeOut: set/change the default interface timeout
 void ModbusClientRTU::setTimeout(uint32_t TOV) {
   MR_timeoutValue = TOV;
@@ -105,9 +226,14 @@ void ModbusClientRTU::setTimeout(uint32_t TOV) {
 
 // Toggle protocol to ModbusASCII
 void ModbusClientRTU::useModbusASCII(unsigned long timeout) {
+#if EMODBUS_ASCII
   MR_useASCII = true;
   MR_timeoutValue = timeout; // Switch timeout to ASCII's value
   LOG_D("Protocol mode: ASCII\n");
+#else
+  // ASCII support was pruned from this build - stay in RTU mode
+  LOG_E("ASCII support compiled out (EMODBUS_NO_ASCII)\n");
+#endif
 }
 
 // Toggle protocol to ModbusRTU
@@ -127,13 +253,30 @@ void ModbusClientRTU::skipLeading0x00(bool onOff) {
   LOG_D("Skip leading 0x00 mode = %s\n", onOff ? "ON" : "OFF");
 }
 
-// Return number of unprocessed requests in queue
+// Toggle coalescing of adjacent FC 03/04 reads into single wire requests
+void ModbusClientRTU::useReadCoalescing(bool onOff) {
+  MR_coalesceReads = onOff;
+  LOG_D("Read coalescing mode = %s\n", onOff ? "ON" : "OFF");
+}
+
+// Toggle high-rate bus mode - takes effect with the next begin()
+void ModbusClientRTU::useHighRateMode(bool onOff) {
+  MR_highRate = onOff;
+  LOG_D("High-rate mode = %s\n", onOff ? "ON" : "OFF");
+}
+
+// Return number of unprocessed requests in queue, all lanes counted
 uint32_t ModbusClientRTU::pendingRequests() {
-  return requests.size();
+  return requests.size() + requestsHigh.size() + requestsUrgent.size();
 }
 
 // Base addRequest taking a preformatted data buffer and length as parameters
 Error ModbusClientRTU::addRequestM(ModbusMessage msg, uint32_t token) {
+  return addRequestMP(msg, token, PRIO_NORMAL);
+}
+
+// Priority lane variant of addRequest
+Error ModbusClientRTU::addRequestMP(ModbusMessage msg, uint32_t token, RequestPriority priority) {
   Error rc = SUCCESS;        // Return value
 
   LOG_D("request for %02X/%02X\n", msg.getServerID(), msg.getFunctionCode());
@@ -141,7 +284,7 @@ Error ModbusClientRTU::addRequestM(ModbusMessage msg, uint32_t token) {
   // Add it to the queue, if valid
   if (msg) {
     // Queue add successful?
-    if (!addToQueue(token, msg)) {
+    if (!addToQueue(token, std::move(msg), priority)) {
       // No. Return error after deleting the allocated request.
       rc = REQUEST_QUEUE_FULL;
     }
@@ -151,18 +294,46 @@ Error ModbusClientRTU::addRequestM(ModbusMessage msg, uint32_t token) {
   return rc;
 }
 
+// RequestTemplate variant of addRequest: reuse the CRC cached in the template
+Error ModbusClientRTU::addRequestTP(const RequestTemplate& tmpl, uint32_t token, RequestPriority priority) {
+  Error rc = SUCCESS;        // Return value
+
+  LOG_D("template request for %02X/%02X\n", tmpl.message().getServerID(), tmpl.message().getFunctionCode());
+
+  // First enqueue of this template? Then compute the frame's CRC16 once
+  if (!tmpl.crcCached()) {
+    tmpl.cacheCRC(RTUutils::calcCRC(tmpl.message()));
+  }
+  // Queue add successful? ASCII frames carry an LRC, so the CRC only counts for RTU
+  if (!addToQueue(token, tmpl.message(), priority, false, tmpl.crc(), !MR_useASCII)) {
+    // No. Return error after deleting the allocated request.
+    rc = REQUEST_QUEUE_FULL;
+  }
+
+  LOG_D("RC=%02X\n", rc);
+  return rc;
+}
+
 // Base syncRequest follows the same pattern
 ModbusMessage ModbusClientRTU::syncRequestM(ModbusMessage msg, uint32_t token) {
+  return syncRequestMP(msg, token, PRIO_NORMAL);
+}
+
+// Priority lane variant of syncRequest
+ModbusMessage ModbusClientRTU::syncRequestMP(ModbusMessage msg, uint32_t token, RequestPriority priority) {
   ModbusMessage response;
 
   if (msg) {
+    // Remember the header data - the message is moved into the queue
+    uint8_t serverID = msg.getServerID();
+    uint8_t functionCode = msg.getFunctionCode();
     // Queue add successful?
-    if (!addToQueue(token, msg, true)) {
+    if (!addToQueue(token, std::move(msg), priority, true)) {
       // No. Return error after deleting the allocated request.
-      response.setError(msg.getServerID(), msg.getFunctionCode(), REQUEST_QUEUE_FULL);
+      response.setError(serverID, functionCode, REQUEST_QUEUE_FULL);
     } else {
       // Request is queued - wait for the result.
-      response = waitSync(msg.getServerID(), msg.getFunctionCode(), token);
+      response = waitSync(serverID, functionCode, token);
     }
   } else {
     response.setError(msg.getServerID(), msg.getFunctionCode(), EMPTY_MESSAGE);
@@ -170,6 +341,27 @@ ModbusMessage ModbusClientRTU::syncRequestM(ModbusMessage msg, uint32_t token) {
   return response;
 }
 
+// RequestTemplate variant of syncRequest
+ModbusMessage ModbusClientRTU::syncRequestTP(const RequestTemplate& tmpl, uint32_t token, RequestPriority priority) {
+  ModbusMessage response;
+
+  // First enqueue of this template? Then compute the frame's CRC16 once
+  if (!tmpl.crcCached()) {
+    tmpl.cacheCRC(RTUutils::calcCRC(tmpl.message()));
+  }
+  uint8_t serverID = tmpl.message().getServerID();
+  uint8_t functionCode = tmpl.message().getFunctionCode();
+  // Queue add successful?
+  if (!addToQueue(token, tmpl.message(), priority, true, tmpl.crc(), !MR_useASCII)) {
+    // No. Return error after deleting the allocated request.
+    response.setError(serverID, functionCode, REQUEST_QUEUE_FULL);
+  } else {
+    // Request is queued - wait for the result.
+    response = waitSync(serverID, functionCode, token);
+  }
+  return response;
+}
+
 // addBroadcastMessage: create a fire-and-forget message to all servers on the RTU bus
 Error ModbusClientRTU::addBroadcastMessage(const uint8_t *data, uint8_t len) {
   Error rc = SUCCESS;        // Return value
@@ -188,7 +380,7 @@ Error ModbusClientRTU::addBroadcastMessage(const uint8_t *data, uint8_t len) {
     msg.add(data, len);
 
     // Queue add successful?
-    if (!addToQueue(token, msg)) {
+    if (!addToQueue(token, std::move(msg))) {
       // No. Return error after deleting the allocated request.
       rc = REQUEST_QUEUE_FULL;
     }
@@ -200,29 +392,209 @@ Error ModbusClientRTU::addBroadcastMessage(const uint8_t *data, uint8_t len) {
   return rc;
 }
 
+// addBroadcastBurst: hand a set of broadcast frames to the worker for back-to-back transmission
+Error ModbusClientRTU::addBroadcastBurst(std::vector<ModbusMessage> frames, std::function<void()> onDone) {
+  LOG_D("Broadcast burst of %d frames\n", (uint32_t)frames.size());
 
-// addToQueue: send freshly created request to queue
-bool ModbusClientRTU::addToQueue(uint32_t token, ModbusMessage request, bool syncReq) {
+  // An empty burst makes no sense
+  if (frames.empty()) {
+    return BROADCAST_ERROR;
+  }
+  // Every frame must be a complete broadcast request: server ID 0x00, data and CRC fitting 256 bytes
+  for (auto& frame : frames) {
+    if (frame.size() < 2 || frame.size() > 253 || frame.getServerID() != 0) {
+      LOG_E("Invalid broadcast frame in burst\n");
+      return BROADCAST_ERROR;
+    }
+  }
+  // Install the burst - unless another one is still pending
+  BroadcastBurst *burst = new BroadcastBurst(std::move(frames), onDone);
+  BroadcastBurst *expected = nullptr;
+  if (!MR_burst.compare_exchange_strong(expected, burst)) {
+    LOG_E("Another broadcast burst is still pending\n");
+    delete burst;
+    return REQUEST_QUEUE_FULL;
+  }
+  return SUCCESS;
+}
+
+// pumpBroadcastBurst: send out a pending burst, if there is one
+bool ModbusClientRTU::pumpBroadcastBurst() {
+  // Take the burst, if any - the exchange keeps producer and worker apart
+  BroadcastBurst *burst = MR_burst.exchange(nullptr);
+  // None pending?
+  if (!burst) {
+    // No. Done here
+    return false;
+  }
+  // Send all frames in one go. send() itself holds each frame back until the
+  // minimum silent interval has passed, so back-to-back calls put the frames
+  // on the wire at exactly the theoretical minimum spacing
+  for (auto& frame : burst->frames) {
+    RTUutils::send(MR_serial, MR_lastMicros, MR_interval, MTRSrts, frame, MR_useASCII);
+  }
+  LOG_D("Broadcast burst of %d frames sent\n", (uint32_t)burst->frames.size());
+  // Burst has drained - tell the requester, if asked to
+  if (burst->onDone) {
+    burst->onDone();
+  }
+  delete burst;
+  return true;
+}
+
+// addToQueue: send freshly created request to its priority lane
+bool ModbusClientRTU::addToQueue(uint32_t token, ModbusMessage request, RequestPriority priority, bool syncReq, uint16_t crc16, bool crcKnown) {
   bool rc = false;
+  // Pick the lane matching the priority
+  RequestQueue<RequestEntry>& lane =
+    (priority == PRIO_URGENT) ? requestsUrgent :
+    (priority == PRIO_HIGH)   ? requestsHigh : requests;
   // Did we get one?
   if (request) {
-    RequestEntry re(token, request, syncReq);
-    if (requests.size()<MR_qLimit) {
-      // Yes. Safely lock queue and push request to queue
-      rc = true;
-      LOCK_GUARD(lockGuard, qLock);
-      requests.push(re);
-    }
-    {
-      LOCK_GUARD(cntLock, countAccessM);
-      messageCount++;
+    // Remember the header data - the message is moved into the entry
+    uint8_t serverID = request.getServerID();
+    uint8_t functionCode = request.getFunctionCode();
+    if (lane.size()<MR_qLimit) {
+      // Yes. Push the request - wait-free, no lock to contend on
+      RequestEntry *re = MR_pool.acquire(token, std::move(request), syncReq, crc16, crcKnown);
+#if MODBUS_LATENCY_STATS
+      re->enqueuedMicros = (uint32_t)micros();
+#endif
+      rc = lane.push(re);
+      // Ring full after all (several producers raced past the limit check)?
+      if (!rc) {
+        // Yes - recycle the entry, the request is rejected
+        MR_pool.release(re);
+      }
     }
+    messageCount++;
+    stats.countMessage(serverID, functionCode);
   }
 
   LOG_D("RC=%02X\n", rc);
   return rc;
 }
 
+// fetchRequest: pop the next queued request, highest priority lane first
+ModbusClientRTU::RequestEntry *ModbusClientRTU::fetchRequest(RequestQueue<RequestEntry> **lane) {
+  *lane = &requestsUrgent;
+  RequestEntry *request = (*lane)->pop();
+  if (!request) {
+    *lane = &requestsHigh;
+    request = (*lane)->pop();
+  }
+  if (!request) {
+    *lane = &requests;
+    request = (*lane)->pop();
+  }
+  return request;
+}
+
+// dispatchWire: build the wire message and send it
+bool ModbusClientRTU::dispatchWire(RequestEntry *request, RequestQueue<RequestEntry> *lane,
+                                   ModbusMessage& wire, std::vector<RequestEntry *>& parts, uint16_t& spanStart) {
+  // The message that goes on the wire - the request itself, or a merged read span
+  wire = request->msg;
+  spanStart = 0;
+  // Read coalescing enabled and a plain register read at hand?
+  if (MR_coalesceReads && request->msg.getServerID() != 0 && isPlainRead(request->msg)) {
+    // Yes. Collect directly following queue entries whose ranges adjoin the span
+    spanStart = (request->msg[2] << 8) | request->msg[3];
+    uint16_t spanEnd = spanStart + ((request->msg[4] << 8) | request->msg[5]);
+    RequestEntry *next = nullptr;
+    while ((next = lane->peek()) != nullptr) {
+      // The same kind of read to the same server?
+      if (!isPlainRead(next->msg)) break;
+      if (next->msg.getServerID() != request->msg.getServerID()) break;
+      if (next->msg.getFunctionCode() != request->msg.getFunctionCode()) break;
+      uint16_t nextStart = (next->msg[2] << 8) | next->msg[3];
+      uint16_t nextEnd = nextStart + ((next->msg[4] << 8) | next->msg[5]);
+      // The range must adjoin or overlap the span - a gap would read registers nobody asked for
+      if (nextStart < spanStart || nextStart > spanEnd) break;
+      // The merged span must stay within the FC 03/04 limit of 125 registers
+      if ((nextEnd > spanEnd ? nextEnd : spanEnd) - spanStart > 125) break;
+      if (nextEnd > spanEnd) spanEnd = nextEnd;
+      // Merge it - the head request rides along with its followers
+      if (parts.empty()) parts.push_back(request);
+      lane->pop();
+      parts.push_back(next);
+    }
+    // Anything merged?
+    if (!parts.empty()) {
+      // Yes. Put the whole span into a single wire request
+      wire.setMessage(request->msg.getServerID(), request->msg.getFunctionCode(), spanStart, (uint16_t)(spanEnd - spanStart));
+      LOG_D("Coalesced %d reads into span %04X/%04X\n", (uint32_t)parts.size(), spanStart, (uint16_t)(spanEnd - spanStart));
+    }
+  }
+
+  // Send it via Serial - an unmerged frame with a template-cached CRC skips the CRC pass
+  if (request->crcKnown && parts.empty() && !MR_useASCII) {
+    RTUutils::send(MR_serial, MR_lastMicros, MR_interval, MTRSrts, wire.data(), wire.size(), false, request->crc16);
+  } else {
+    RTUutils::send(MR_serial, MR_lastMicros, MR_interval, MTRSrts, wire, MR_useASCII);
+  }
+
+  LOG_D("Request sent.\n");
+  // HEXDUMP_V("Data", request.msg.data(), request.msg.size());
+
+  // For a broadcast, we will not wait for a response
+  return request->msg.getServerID() != 0 || ((request->token & 0xFF000000) != 0xBC000000);
+}
+
+// completeRequest: validate a raw receive() result, dispatch it and recycle the entries
+void ModbusClientRTU::completeRequest(RequestEntry *request, ModbusMessage response,
+                                      std::vector<RequestEntry *>& parts, uint16_t spanStart) {
+  // No error in receive()?
+  if (response.size() > 1) {
+    // No. Check message contents
+    // Does the serverID match the requested?
+    if (request->msg.getServerID() != response.getServerID()) {
+      // No. Return error response
+      response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), SERVER_ID_MISMATCH);
+    // ServerID ok, but does the FC match as well?
+    } else if (request->msg.getFunctionCode() != (response.getFunctionCode() & 0x7F)) {
+      // No. Return error response
+      response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), FC_MISMATCH);
+    }
+  } else {
+    // No, we got an error code from receive()
+    // Return it as error response
+    response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), static_cast<Error>(response[0]));
+  }
+
+  LOG_D("Response generated.\n");
+  HEXDUMP_V("Response packet", response.data(), response.size());
+
+  // Just the one request on the wire?
+  if (parts.empty()) {
+    // Yes, dispatch the response as is
+    respond(request, response);
+  } else {
+    // No, a coalesced read - every requester gets its own slice of the span
+    for (auto *part : parts) {
+      ModbusMessage partResponse;
+      // Did the span read fail?
+      if (response.getError() != SUCCESS) {
+        // Yes - every requester gets the error
+        partResponse.setError(part->msg.getServerID(), part->msg.getFunctionCode(), response.getError());
+      } else {
+        // No - cut the slice this requester asked for
+        partResponse = sliceReadResponse(response, spanStart, part->msg);
+      }
+      respond(part, partResponse);
+    }
+  }
+
+  // Clean-up time - recycle the request entry (or entries, for a coalesced read)
+  if (parts.empty()) {
+    MR_pool.release(request);
+  } else {
+    for (auto *part : parts) {
+      MR_pool.release(part);
+    }
+  }
+}
+
 // handleConnection: worker task
 // This was created in begin() to handle the queue entries
 void ModbusClientRTU::handleConnection(ModbusClientRTU *instance) {
@@ -232,100 +604,181 @@ void ModbusClientRTU::handleConnection(ModbusClientRTU *instance) {
 
   // Loop forever - or until task is killed
   while (1) {
-    // Do we have a reuest in queue?
-    if (!instance->requests.empty()) {
-      // Yes. pull it.
-      RequestEntry request = instance->requests.front();
+    // A pending broadcast burst goes out first, ahead of the queues
+    if (instance->pumpBroadcastBurst()) continue;
+    // Do we have a request in one of the queues? Highest lane first
+    RequestQueue<RequestEntry> *lane = nullptr;
+    RequestEntry *request = instance->fetchRequest(&lane);
+    if (request) {
 
       LOG_D("Pulled request from queue\n");
 
-      // Send it via Serial
-      RTUutils::send(instance->MR_serial, instance->MR_lastMicros, instance->MR_interval, instance->MTRSrts, request.msg, instance->MR_useASCII);
-
-      LOG_D("Request sent.\n");
-      // HEXDUMP_V("Data", request.msg.data(), request.msg.size());
-
-      // For a broadcast, we will not wait for a response
-      if (request.msg.getServerID() != 0 || ((request.token & 0xFF000000) != 0xBC000000)) {
-        // This is a regular request, Get the response - if any
+#if MODBUS_LATENCY_STATS
+      uint32_t sentMicros = (uint32_t)micros();
+      instance->latency.record(request->msg.getServerID(), ModbusLatency::QUEUE_WAIT, sentMicros - request->enqueuedMicros);
+#endif
+
+      ModbusMessage wire;
+      // For a coalesced read: the head request plus the merged followers
+      std::vector<RequestEntry *> parts;
+      uint16_t spanStart = 0;
+      // Build the wire message and send it. Is a response to be awaited?
+      if (instance->dispatchWire(request, lane, wire, parts, spanStart)) {
+        // Yes, this is a regular request. Get the response - if any
         ModbusMessage response = RTUutils::receive(
-          instance->MR_serial, 
-          instance->MR_timeoutValue, 
-          instance->MR_lastMicros, 
-          instance->MR_interval, 
+          instance->MR_serial,
+          instance->MR_timeoutValue,
+          instance->MR_lastMicros,
+          instance->MR_interval,
           instance->MR_useASCII,
           instance->MR_skipLeadingZeroByte);
-  
+
         LOG_D("%s response (%d bytes) received.\n", response.size()>1 ? "Data" : "Error", response.size());
         HEXDUMP_V("Data", response.data(), response.size());
-  
-        // No error in receive()?
-        if (response.size() > 1) {
-          // No. Check message contents
-          // Does the serverID match the requested?
-          if (request.msg.getServerID() != response.getServerID()) {
-            // No. Return error response
-            response.setError(request.msg.getServerID(), request.msg.getFunctionCode(), SERVER_ID_MISMATCH);
-          // ServerID ok, but does the FC match as well?
-          } else if (request.msg.getFunctionCode() != (response.getFunctionCode() & 0x7F)) {
-            // No. Return error response
-            response.setError(request.msg.getServerID(), request.msg.getFunctionCode(), FC_MISMATCH);
-          } 
-        } else {
-          // No, we got an error code from receive()
-          // Return it as error response
-          response.setError(request.msg.getServerID(), request.msg.getFunctionCode(), static_cast<Error>(response[0]));
-        }
-  
-        LOG_D("Response generated.\n");
-        HEXDUMP_V("Response packet", response.data(), response.size());
 
-        // If we got an error, count it
-        if (response.getError() != SUCCESS) {
-          instance->errorCount++;
+#if MODBUS_LATENCY_STATS
+        instance->latency.record(request->msg.getServerID(), ModbusLatency::WIRE_TIME, (uint32_t)micros() - sentMicros);
+#endif
+
+        instance->completeRequest(request, response, parts, spanStart);
+      } else {
+        // No, a broadcast - nothing will come back. Recycle the entry
+        instance->MR_pool.release(request);
+      }
+    } else {
+      delay(1);
+    }
+  }
+}
+
+// handleSharedConnection: shared worker task
+// This was created in beginShared() to multiplex all given buses. While one bus
+// waits for the addressed server to respond, the others keep being served.
+void ModbusClientRTU::handleSharedConnection(std::vector<SharedBus> *buses) {
+  // initially clean all serial buffers
+  for (auto& bus : *buses) {
+    while (bus.client->MR_serial.available()) bus.client->MR_serial.read();
+  }
+  delay(100);
+
+  // Loop forever - or until task is killed
+  while (1) {
+    bool didWork = false;
+    for (auto& bus : *buses) {
+      ModbusClientRTU *client = bus.client;
+      // Is a request in flight on this bus?
+      if (bus.request) {
+        // Yes. Has the response started to arrive?
+        if (client->MR_serial.available()) {
+          // Yes - read it out. The frame is short against the wait for its first
+          // byte, so finishing it in one piece does not starve the other buses
+          ModbusMessage response = RTUutils::receive(
+            client->MR_serial,
+            client->MR_timeoutValue,
+            client->MR_lastMicros,
+            client->MR_interval,
+            client->MR_useASCII,
+            client->MR_skipLeadingZeroByte);
+
+          LOG_D("%s response (%d bytes) received.\n", response.size()>1 ? "Data" : "Error", response.size());
+          HEXDUMP_V("Data", response.data(), response.size());
+
+#if MODBUS_LATENCY_STATS
+          client->latency.record(bus.request->msg.getServerID(), ModbusLatency::WIRE_TIME, (uint32_t)micros() - bus.sentMicros);
+#endif
+
+          client->completeRequest(bus.request, response, bus.parts, bus.spanStart);
+          bus.request = nullptr;
+          didWork = true;
+        } else if (millis() - bus.sentMillis > client->MR_timeoutValue) {
+          // No - and the server had its time. Report the timeout
+          ModbusMessage response;
+          response.push_back(TIMEOUT);
+          client->completeRequest(bus.request, response, bus.parts, bus.spanStart);
+          bus.request = nullptr;
+          didWork = true;
         }
-  
-        // Was it a synchronous request?
-        if (request.isSyncRequest) {
-          // Yes. Put it into the response map
-          {
-            LOCK_GUARD(sL, instance->syncRespM);
-            instance->syncResponse[request.token] = response;
-          }
-        // No, an async request. Do we have an onResponse handler?
-        } else if (instance->onResponse) {
-          // Yes. Call it
-          instance->onResponse(response, request.token);
-        } else {
-          // No, but we may have onData or onError handlers
-          // Did we get a normal response?
-          if (response.getError()==SUCCESS) {
-            // Yes. Do we have an onData handler registered?
-            if (instance->onData) {
-              // Yes. call it
-              instance->onData(response, request.token);
-            }
+      } else {
+        // No. A pending broadcast burst goes out first, ahead of the queues
+        if (client->pumpBroadcastBurst()) {
+          didWork = true;
+          continue;
+        }
+        // Do we have a request in one of this bus' queues?
+        RequestQueue<RequestEntry> *lane = nullptr;
+        RequestEntry *request = client->fetchRequest(&lane);
+        if (request) {
+
+          LOG_D("Pulled request from queue\n");
+
+#if MODBUS_LATENCY_STATS
+          bus.sentMicros = (uint32_t)micros();
+          client->latency.record(request->msg.getServerID(), ModbusLatency::QUEUE_WAIT, bus.sentMicros - request->enqueuedMicros);
+#endif
+
+          bus.parts.clear();
+          // Build the wire message and send it. Is a response to be awaited?
+          if (client->dispatchWire(request, lane, bus.wire, bus.parts, bus.spanStart)) {
+            // Yes. Note the send time and move on - the next pass will look
+            // for the response while the other buses are served
+            bus.request = request;
+            bus.sentMillis = millis();
           } else {
-            // No, something went wrong. All we have is an error
-            // Do we have an onError handler?
-            if (instance->onError) {
-              // Yes. Forward the error code to it
-              instance->onError(response.getError(), request.token);
-            }
+            // No, a broadcast - nothing will come back. Recycle the entry
+            client->MR_pool.release(request);
           }
+          didWork = true;
         }
       }
-      // Clean-up time. 
-      {
-        // Safely lock the queue
-        LOCK_GUARD(lockGuard, instance->qLock);
-        // Remove the front queue entry
-        instance->requests.pop();
+    }
+    // Give scheduler room to breathe, if nothing was going on
+    if (!didWork) delay(1);
+  }
+}
+
+// respond: dispatch a response to the requester - sync response map or handler callbacks
+void ModbusClientRTU::respond(RequestEntry *request, ModbusMessage& response) {
+  // If we got an error, count it
+  if (response.getError() != SUCCESS) {
+    errorCount++;
+    stats.countError(request->msg.getServerID());
+  }
+
+  // A chunk of a logical read? Then it is consumed internally - see readRegisters()
+  if (gatherResponse(request->token, response)) return;
+
+#if MODBUS_LATENCY_STATS
+  uint32_t dispatchMicros = (uint32_t)micros();
+#endif
+  // Was it a synchronous request?
+  if (request->isSyncRequest) {
+    // Yes. Move it into the response map and wake the waiting task
+    postSyncResponse(request->token, std::move(response));
+  // No, an async request. Do we have an onResponse handler?
+  } else if (onResponse) {
+    // Yes. Call it - the response is moved, not copied, into its parameter
+    onResponse(std::move(response), request->token);
+  } else {
+    // No, but we may have onData or onError handlers
+    // Did we get a normal response?
+    if (response.getError()==SUCCESS) {
+      // Yes. Do we have an onData handler registered?
+      if (onData) {
+        // Yes. call it
+        onData(std::move(response), request->token);
       }
     } else {
-      delay(1);
+      // No, something went wrong. All we have is an error
+      // Do we have an onError handler?
+      if (onError) {
+        // Yes. Forward the error code to it
+        onError(response.getError(), request->token);
+      }
     }
   }
+#if MODBUS_LATENCY_STATS
+  latency.record(request->msg.getServerID(), ModbusLatency::DISPATCH_TIME, (uint32_t)micros() - dispatchMicros);
+#endif
 }
 
 #endif  // HAS_FREERTOS
@@ -10,12 +10,14 @@
 #if HAS_FREERTOS
 
 #include "ModbusClient.h"
+#include "MessagePool.h"
+#include "RequestQueue.h"
 #include "HardwareSerial.h"
 #include "RTUutils.h"
-#include <queue>
+#include "TaskConfig.h"
 #include <vector>
-
-using std::queue;
+#include <atomic>
+#include <functional>
 
 #define DEFAULTTIMEOUT 2000
 
@@ -33,9 +35,36 @@ public:
   // begin: start worker task
   void begin(int coreID = -1, uint32_t interval = 0);
 
+  // begin with full task tuning - priority, stack size and core pin.
+  // Default is TaskConfig(6, 4096); raise the priority above the network
+  // housekeeping tasks if the worker loses its inter-frame timing under load.
+  void begin(TaskConfig tc, uint32_t interval = 0);
+
+  // stackHighWaterMark: unused stack of the worker task in bytes, as reported
+  // by FreeRTOS - 0 if the worker is not running. Use it to right-size the
+  // TaskConfig stack.
+  uint32_t stackHighWaterMark();
+
   // end: stop the worker
   void end();
 
+  // beginShared: run several RTU clients off one single shared worker task.
+  // An RTU bus is idle most of the time, waiting for the addressed server to
+  // respond - so while one bus waits, the shared worker serves the others,
+  // and several mostly-idle buses do not each cost a task and its stack.
+  // Call instead of begin() - none of the clients may run its own worker.
+  // Default is TaskConfig(6, 4096). Returns false if the shared worker is
+  // running already, the list is empty or a serial interface is not initialized.
+  static bool beginShared(std::vector<ModbusClientRTU *> buses, uint32_t interval = 0);
+  static bool beginShared(std::vector<ModbusClientRTU *> buses, TaskConfig tc, uint32_t interval = 0);
+
+  // endShared: stop the shared worker task and clean up all bus queues
+  static void endShared();
+
+  // sharedStackHighWaterMark: unused stack of the shared worker task in bytes,
+  // 0 if it is not running
+  static uint32_t sharedStackHighWaterMark();
+
   // Set default timeout value for interface
   void setTimeout(uint32_t TOV);
 
@@ -51,41 +80,123 @@ public:
   // Toggle skipping of leading 0x00 byte
   void skipLeading0x00(bool onOff = true);
 
+  // Toggle coalescing of adjacent FC 03/04 reads: directly following queued reads to
+  // the same server whose register ranges adjoin each other are merged into a single
+  // wire request of up to 125 registers, saving a full bus round-trip per merge.
+  // Every requester still gets its own response, cut from the merged one.
+  void useReadCoalescing(bool onOff = true);
+
+  // Toggle high-rate bus mode - call before begin(). The silent interval is
+  // taken as the true 3.5 character time instead of the standard's 1750µs
+  // floor (~76µs at 460800 baud), and sub-millisecond gaps are enforced by
+  // busy-waiting. Costs CPU while waiting on the bus - use where throughput
+  // matters more than the worker core's idle time.
+  void useHighRateMode(bool onOff = true);
+
   // Return number of unprocessed requests in queue
   uint32_t pendingRequests();
 
   // addBroadcastMessage: create a fire-and-forget message to all servers on the RTU bus
   Error addBroadcastMessage(const uint8_t *data, uint8_t len);
 
+  // addBroadcastBurst: transmit a set of complete broadcast frames (first byte
+  // 0x00, no CRC) back-to-back. The worker sends them in one go, spaced at
+  // exactly the minimum silent interval, without the per-request queue overhead -
+  // bus occupancy for a parameter fan-out drops to the theoretical minimum.
+  // The optional onDone callback is called from the worker task once the last
+  // frame has left the wire. Only one burst may be pending at a time; a second
+  // one is refused with REQUEST_QUEUE_FULL until the first has drained.
+  Error addBroadcastBurst(std::vector<ModbusMessage> frames, std::function<void()> onDone = nullptr);
+
 protected:
   struct RequestEntry {
     uint32_t token;
     ModbusMessage msg;
     bool isSyncRequest;
-    RequestEntry(uint32_t t, ModbusMessage m, bool syncReq = false) :
+    uint16_t crc16;                // Precomputed frame CRC (from a RequestTemplate)
+    bool crcKnown;                 // Is crc16 valid for msg as-is?
+#if MODBUS_LATENCY_STATS
+    uint32_t enqueuedMicros;       // Timestamp taken in addToQueue()
+#endif
+    RequestEntry(uint32_t t, ModbusMessage m, bool syncReq = false, uint16_t crc = 0, bool crcValid = false) :
       token(t),
-      msg(m),
-      isSyncRequest(syncReq) {}
+      msg(std::move(m)),
+      isSyncRequest(syncReq),
+      crc16(crc),
+      crcKnown(crcValid) {}
   };
 
   // Base addRequest and syncRequest must be present
   Error addRequestM(ModbusMessage msg, uint32_t token);
   ModbusMessage syncRequestM(ModbusMessage msg, uint32_t token);
+  // Priority-aware variants feeding the three lanes
+  Error addRequestMP(ModbusMessage msg, uint32_t token, RequestPriority priority) override;
+  ModbusMessage syncRequestMP(ModbusMessage msg, uint32_t token, RequestPriority priority) override;
+  // RequestTemplate variants: compute the frame's CRC16 once, cache it in the
+  // template and ride it along the queue, so send() can skip the CRC pass
+  Error addRequestTP(const RequestTemplate& tmpl, uint32_t token, RequestPriority priority) override;
+  ModbusMessage syncRequestTP(const RequestTemplate& tmpl, uint32_t token, RequestPriority priority) override;
+
+  // addToQueue: send freshly created request to its priority lane
+  bool addToQueue(uint32_t token, ModbusMessage msg, RequestPriority priority = PRIO_NORMAL, bool syncReq = false, uint16_t crc16 = 0, bool crcKnown = false);
+
+  // One bus of a shared worker group
+  struct SharedBus {
+    ModbusClientRTU *client;            // The bus' client
+    RequestEntry *request;              // In-flight request, nullptr = bus is idle
+    ModbusMessage wire;                 // What went on the wire (may be a merged span)
+    std::vector<RequestEntry *> parts;  // Head plus merged followers of a coalesced read
+    uint16_t spanStart;                 // First register of a coalesced span
+    uint32_t sentMillis;                // millis() time stamp of the request send
+#if MODBUS_LATENCY_STATS
+    uint32_t sentMicros;                // Timestamp for the WIRE_TIME share
+#endif
+    explicit SharedBus(ModbusClientRTU *c) : client(c), request(nullptr), spanStart(0), sentMillis(0) {}
+  };
+
+  // One pending burst of broadcast frames, handed to the worker as a whole
+  struct BroadcastBurst {
+    std::vector<ModbusMessage> frames;  // Complete broadcast frames, first byte 0x00
+    std::function<void()> onDone;       // Called from the worker after the last frame
+    BroadcastBurst(std::vector<ModbusMessage> f, std::function<void()> cb) :
+      frames(std::move(f)),
+      onDone(cb) {}
+  };
 
-  // addToQueue: send freshly created request to queue
-  bool addToQueue(uint32_t token, ModbusMessage msg, bool syncReq = false);
+  // pumpBroadcastBurst: send out a pending burst, if there is one.
+  // Returns true if a burst was transmitted
+  bool pumpBroadcastBurst();
 
   // handleConnection: worker task method
   static void handleConnection(ModbusClientRTU *instance);
 
+  // handleSharedConnection: shared worker task method, multiplexing several buses
+  static void handleSharedConnection(std::vector<SharedBus> *buses);
+
+  // fetchRequest: pop the next queued request, highest priority lane first
+  RequestEntry *fetchRequest(RequestQueue<RequestEntry> **lane);
+
+  // dispatchWire: build the wire message (merging adjacent reads, if enabled) and
+  // send it. Returns true if a response is to be awaited
+  bool dispatchWire(RequestEntry *request, RequestQueue<RequestEntry> *lane,
+                    ModbusMessage& wire, std::vector<RequestEntry *>& parts, uint16_t& spanStart);
+
+  // completeRequest: validate a raw receive() result, dispatch it to the
+  // requester(s) and recycle the request entry (or entries, if reads were merged)
+  void completeRequest(RequestEntry *request, ModbusMessage response,
+                       std::vector<RequestEntry *>& parts, uint16_t spanStart);
+
+  // respond: dispatch a response to the requester (sync map or handler callbacks)
+  void respond(RequestEntry *request, ModbusMessage& response);
+
   // receive: get response via Serial
   ModbusMessage receive(const ModbusMessage request);
 
   void isInstance() { return; }   // make class instantiable
-  queue<RequestEntry> requests;   // Queue to hold requests to be processed
-  #if USE_MUTEX
-  mutex qLock;                    // Mutex to protect queue
-  #endif
+  RequestQueue<RequestEntry> requests; // Lock-free MPSC queue to hold requests to be processed
+  RequestQueue<RequestEntry> requestsHigh;   // PRIO_HIGH lane, drained before requests
+  RequestQueue<RequestEntry> requestsUrgent; // PRIO_URGENT lane, drained before all others
+  MessagePool<RequestEntry> MR_pool; // Recycling storage for queue entries, sized in begin()
   HardwareSerial& MR_serial;      // Ptr to the serial interface used
   unsigned long MR_lastMicros;    // Microseconds since last bus activity
   uint32_t MR_interval;           // Modbus RTU bus quiet time
@@ -95,7 +206,12 @@ protected:
   uint32_t MR_timeoutValue;       // Interface default timeout
   bool MR_useASCII;               // true=ModbusASCII, false=ModbusRTU
   bool MR_skipLeadingZeroByte;    // true=skip the first byte if it is 0x00, false=accept all bytes
+  bool MR_coalesceReads;          // true=merge adjacent queued FC 03/04 reads into one wire request
+  bool MR_highRate;               // true=use the true 3.5 character time, not the 1750µs floor
+  std::atomic<BroadcastBurst *> MR_burst; // Pending broadcast burst, nullptr = none
 
+  static TaskHandle_t sharedWorker;          // The one shared worker task, if started
+  static std::vector<SharedBus> *sharedBuses; // The buses it multiplexes
 };
 
 #endif  // HAS_FREERTOS
@@ -3,6 +3,12 @@
 //               MIT license - see license.md for details
 // =================================================================================================
 #include "ModbusClientTCP.h"
+#include <cstring>
+#if IS_LINUX
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
 
 #if HAS_FREERTOS || IS_LINUX
 
@@ -13,43 +19,75 @@
 // Constructor takes reference to Client (EthernetClient or WiFiClient)
 ModbusClientTCP::ModbusClientTCP(Client& client, uint16_t queueLimit) :
   ModbusClient(),
+  requests(queueLimit),
   MT_client(client),
+  MT_activeClient(&client),
+  MT_maxConnections(0),
+  MT_idleTimeout(0),
   MT_lastTarget(IPAddress(0, 0, 0, 0), 0, DEFAULTTIMEOUT, TARGETHOSTINTERVAL),
   MT_target(IPAddress(0, 0, 0, 0), 0, DEFAULTTIMEOUT, TARGETHOSTINTERVAL),
   MT_defaultTimeout(DEFAULTTIMEOUT),
   MT_defaultInterval(TARGETHOSTINTERVAL),
-  MT_qLimit(queueLimit)
-  { }
+  MT_qLimit(queueLimit),
+  MT_maxInflight(1),
+  MT_coalesceReads(false)
+  {
+#if IS_LINUX
+    // Wakeup channel for the worker's kernel wait
+    MT_wakeFD = eventfd(0, EFD_NONBLOCK);
+#endif
+  }
 
 // Alternative Constructor takes reference to Client (EthernetClient or WiFiClient) plus initial target host
 ModbusClientTCP::ModbusClientTCP(Client& client, IPAddress host, uint16_t port, uint16_t queueLimit) :
   ModbusClient(),
+  requests(queueLimit),
   MT_client(client),
+  MT_activeClient(&client),
+  MT_maxConnections(0),
+  MT_idleTimeout(0),
   MT_lastTarget(IPAddress(0, 0, 0, 0), 0, DEFAULTTIMEOUT, TARGETHOSTINTERVAL),
   MT_target(host, port, DEFAULTTIMEOUT, TARGETHOSTINTERVAL),
   MT_defaultTimeout(DEFAULTTIMEOUT),
   MT_defaultInterval(TARGETHOSTINTERVAL),
-  MT_qLimit(queueLimit)
-  { }
+  MT_qLimit(queueLimit),
+  MT_maxInflight(1),
+  MT_coalesceReads(false)
+  {
+#if IS_LINUX
+    // Wakeup channel for the worker's kernel wait
+    MT_wakeFD = eventfd(0, EFD_NONBLOCK);
+#endif
+  }
 
 // Destructor: clean up queue, task etc.
 ModbusClientTCP::~ModbusClientTCP() {
-  // Clean up queue
+  // Clean up queue - get all entries one by one and recycle them
   {
-    // Safely lock access
-    LOCK_GUARD(lockGuard, qLock);
-    // Get all queue entries one by one
-    while (!requests.empty()) {
-      requests.pop();
+    RequestEntry *re = nullptr;
+    while ((re = requests.pop()) != nullptr) {
+      MT_pool.release(re);
+    }
+  }
+  // Release requests parked behind coalesced wire requests, if any
+  for (auto& mp : MT_mergedParts) {
+    for (auto *part : mp.second) {
+      MT_pool.release(part);
     }
   }
   LOG_D("TCP client worker killed.\n");
   // Kill task
 #if IS_LINUX
   pthread_cancel(worker);
+  if (MT_wakeFD >= 0) ::close(MT_wakeFD);
 #else
   vTaskDelete(worker);
 #endif
+  // Close and delete pooled connections, if any
+  for (auto& entry : MT_connPool) {
+    entry.client->stop();
+    delete entry.client;
+  }
 }
 
 // begin: start worker task
@@ -62,23 +100,38 @@ void *ModbusClientTCP::pHandle(void *p) {
 
 void ModbusClientTCP::begin(int coreID) {
 #if IS_LINUX
+  // Provide recycled storage for up to queue limit request entries
+  MT_pool.resize(MT_qLimit);
   int rc = pthread_create(&worker, NULL, &pHandle, this);
   if (rc) {
     LOG_E("Error creating TCP client thread: %d\n", rc);
   } else {
     LOG_D("TCP client worker started.\n");
   }
-
 #else
+  begin(TaskConfig(5, 4096, coreID));
+#endif
+}
+
+#if HAS_FREERTOS
+// begin: start worker task with full task tuning
+void ModbusClientTCP::begin(TaskConfig tc) {
+  // Provide recycled storage for up to queue limit request entries
+  MT_pool.resize(MT_qLimit);
   // Create unique task name
   char taskName[18];
   snprintf(taskName, 18, "Modbus%02XTCP", instanceCounter);
   // Start task to handle the queue
-  xTaskCreatePinnedToCore((TaskFunction_t)&handleConnection, taskName, 4096, this, 5, &worker, coreID >= 0 ? coreID : NULL);
+  xTaskCreatePinnedToCore((TaskFunction_t)&handleConnection, taskName, tc.stackSize, this, tc.priority, &worker, tc.coreID >= 0 ? tc.coreID : NULL);
   LOG_D("TCP client worker %s started\n", taskName);
-#endif
 }
 
+// stackHighWaterMark: unused worker stack in bytes, 0 if not running
+uint32_t ModbusClientTCP::stackHighWaterMark() {
+  return worker ? uxTaskGetStackHighWaterMark(worker) : 0;
+}
+#endif
+
 // Set default timeout value (and interval)
 void ModbusClientTCP::setTimeout(uint32_t timeout, uint32_t interval) {
   MT_defaultTimeout = timeout;
@@ -97,6 +150,27 @@ bool ModbusClientTCP::setTarget(IPAddress host, uint16_t port, uint32_t timeout,
   return true;
 }
 
+// Set maximum number of requests kept in flight on the socket (pipelining window)
+void ModbusClientTCP::setMaxInflightRequests(uint16_t maxInflightRequests) {
+  MT_maxInflight = maxInflightRequests ? maxInflightRequests : 1;
+  LOG_D("Max inflight requests set: %d\n", MT_maxInflight);
+}
+
+// Toggle coalescing of adjacent FC 03/04 reads into single wire requests
+void ModbusClientTCP::useReadCoalescing(bool onOff) {
+  MT_coalesceReads = onOff;
+  LOG_D("Read coalescing mode = %s\n", onOff ? "ON" : "OFF");
+}
+
+// Enable the keep-alive connection pool (must be called before begin()!)
+void ModbusClientTCP::useConnectionPool(std::function<Client *()> clientFactory, uint8_t maxConnections, uint32_t idleTimeout) {
+  MT_clientFactory = clientFactory;
+  MT_maxConnections = maxConnections ? maxConnections : 1;
+  MT_idleTimeout = idleTimeout;
+  MT_connPool.reserve(MT_maxConnections);
+  LOG_D("Connection pool enabled: %d connections, %d ms idle timeout\n", MT_maxConnections, MT_idleTimeout);
+}
+
 // Return number of unprocessed requests in queue
 uint32_t ModbusClientTCP::pendingRequests() {
   return requests.size();
@@ -109,7 +183,7 @@ Error ModbusClientTCP::addRequestM(ModbusMessage msg, uint32_t token) {
   // Add it to the queue, if valid
   if (msg) {
     // Queue add successful?
-    if (!addToQueue(token, msg, MT_target)) {
+    if (!addToQueue(token, std::move(msg), MT_target)) {
       // No. Return error after deleting the allocated request.
       rc = REQUEST_QUEUE_FULL;
     }
@@ -128,7 +202,7 @@ Error ModbusClientTCP::addRequestMT(ModbusMessage msg, uint32_t token, IPAddress
     // Set up adhoc target 
     TargetHost adhocTarget(targetHost, targetPort, MT_defaultTimeout, MT_defaultInterval);
     // Queue add successful?
-    if (!addToQueue(token, msg, adhocTarget, true)) {
+    if (!addToQueue(token, std::move(msg), adhocTarget, true)) {
       // No. Return error after deleting the allocated request.
       rc = REQUEST_QUEUE_FULL;
     }
@@ -143,13 +217,16 @@ ModbusMessage ModbusClientTCP::syncRequestM(ModbusMessage msg, uint32_t token) {
   ModbusMessage response;
 
   if (msg) {
+    // Remember the header data - the message is moved into the queue
+    uint8_t serverID = msg.getServerID();
+    uint8_t functionCode = msg.getFunctionCode();
     // Queue add successful?
-    if (!addToQueue(token, msg, MT_target, true)) {
+    if (!addToQueue(token, std::move(msg), MT_target, true)) {
       // No. Return error after deleting the allocated request.
-      response.setError(msg.getServerID(), msg.getFunctionCode(), REQUEST_QUEUE_FULL);
+      response.setError(serverID, functionCode, REQUEST_QUEUE_FULL);
     } else {
       // Request is queued - wait for the result.
-      response = waitSync(msg.getServerID(), msg.getFunctionCode(), token);
+      response = waitSync(serverID, functionCode, token);
     }
   } else {
     response.setError(msg.getServerID(), msg.getFunctionCode(), EMPTY_MESSAGE);
@@ -157,6 +234,27 @@ ModbusMessage ModbusClientTCP::syncRequestM(ModbusMessage msg, uint32_t token) {
   return response;
 }
 
+#if IS_LINUX
+// queueSyncRequestM: enqueue like a sync request, but return instead of waiting.
+// The response will fulfill the requestAsync() promise via postSyncResponse().
+Error ModbusClientTCP::queueSyncRequestM(ModbusMessage msg, uint32_t token) {
+  Error rc = SUCCESS;        // Return value
+
+  if (msg) {
+    // Queue add successful?
+    if (!addToQueue(token, std::move(msg), MT_target, true)) {
+      // No. Report the queue is full.
+      rc = REQUEST_QUEUE_FULL;
+    }
+  } else {
+    rc = EMPTY_MESSAGE;
+  }
+
+  LOG_D("Queue async TCP request result: %02X\n", rc);
+  return rc;
+}
+#endif
+
 // TCP syncRequest with adhoc target parameters
 ModbusMessage ModbusClientTCP::syncRequestMT(ModbusMessage msg, uint32_t token, IPAddress targetHost, uint16_t targetPort) {
   ModbusMessage response;
@@ -164,13 +262,16 @@ ModbusMessage ModbusClientTCP::syncRequestMT(ModbusMessage msg, uint32_t token,
   if (msg) {
     // Set up adhoc target 
     TargetHost adhocTarget(targetHost, targetPort, MT_defaultTimeout, MT_defaultInterval);
+    // Remember the header data - the message is moved into the queue
+    uint8_t serverID = msg.getServerID();
+    uint8_t functionCode = msg.getFunctionCode();
     // Queue add successful?
-    if (!addToQueue(token, msg, adhocTarget, true)) {
+    if (!addToQueue(token, std::move(msg), adhocTarget, true)) {
       // No. Return error after deleting the allocated request.
-      response.setError(msg.getServerID(), msg.getFunctionCode(), REQUEST_QUEUE_FULL);
+      response.setError(serverID, functionCode, REQUEST_QUEUE_FULL);
     } else {
       // Request is queued - wait for the result.
-      response = waitSync(msg.getServerID(), msg.getFunctionCode(), token);
+      response = waitSync(serverID, functionCode, token);
     }
   } else {
     response.setError(msg.getServerID(), msg.getFunctionCode(), EMPTY_MESSAGE);
@@ -186,14 +287,30 @@ bool ModbusClientTCP::addToQueue(uint32_t token, ModbusMessage request, TargetHo
   HEXDUMP_D("Enqueue", request.data(), request.size());
   if (request) {
     if (requests.size()<MT_qLimit) {
-      RequestEntry *re = new RequestEntry(token, request, target, syncReq);
+      // Remember the header data - the message is moved into the entry
+      uint16_t len = request.size();
+      stats.countMessage(request.getServerID(), request.getFunctionCode());
+      RequestEntry *re = MT_pool.acquire(token, std::move(request), target, syncReq);
+#if MODBUS_LATENCY_STATS
+      re->enqueuedMicros = (uint32_t)micros();
+#endif
       // inject proper transactionID
       re->head.transactionID = messageCount++;
-      re->head.len = request.size();
-      // Safely lock queue and push request to queue
-      rc = true;
-      LOCK_GUARD(lockGuard, qLock);
-      requests.push(re);
+      re->head.len = len;
+      // Push the request - wait-free, no lock to contend on
+      rc = requests.push(re);
+      // Ring full after all (several producers raced past the limit check)?
+      if (!rc) {
+        // Yes - recycle the entry, the request is rejected
+        MT_pool.release(re);
+      }
+#if IS_LINUX
+      else if (MT_wakeFD >= 0) {
+        // Nudge the worker out of its kernel wait - there is work now
+        uint64_t one = 1;
+        (void)!::write(MT_wakeFD, &one, sizeof(one));
+      }
+#endif
     }
   }
 
@@ -201,126 +318,285 @@ bool ModbusClientTCP::addToQueue(uint32_t token, ModbusMessage request, TargetHo
 }
 
 // handleConnection: worker task
-// This was created in begin() to handle the queue entries
+// This was created in begin() to handle the queue entries.
+// Up to MT_maxInflight requests are kept on the wire at the same time; responses
+// are matched back to their requests by the MBAP transactionID.
 void ModbusClientTCP::handleConnection(ModbusClientTCP *instance) {
-  bool doNotPop;
-  unsigned long lastRequest = millis();
+  // Last send time per target, keyed by packed address and port. Tracking the
+  // inter-request interval per target keeps several attached hosts (bridge with
+  // pooled connections!) from serializing on one shared interval clock.
+  std::map<uint64_t, uint32_t> lastRequest;
+  auto targetKey = [](TargetHost& t) {
+    uint32_t addr = ((uint32_t)t.host[0] << 24) | ((uint32_t)t.host[1] << 16) | ((uint32_t)t.host[2] << 8) | (uint32_t)t.host[3];
+    return ((uint64_t)addr << 16) | t.port;
+  };
+  std::map<uint16_t, RequestEntry *> inFlight;  // sent requests awaiting a response, by transactionID
+  TimerWheel<uint16_t> timeouts;                // deadlines of the in-flight requests, by transactionID
+  std::vector<uint16_t> expired;                // transactionIDs the wheel found overdue
 
   // Loop forever - or until task is killed
   while (1) {
-    // Do we have a request in queue?
-    if (!instance->requests.empty()) {
-      // Yes. pull it.
-      RequestEntry *request = instance->requests.front();
-      doNotPop = false;
-      LOG_D("Got request from queue\n");
-
-      // Do we have a connection open?
-      if (instance->MT_client.connected()) {
-        // Empty the RX buffer in case there is a stray response left
-        while (instance->MT_client.read() != -1) {}
-        // check if lastHost/lastPort!=host/port off the queued request
-        if (instance->MT_lastTarget != request->target) {
-          // It is different. Disconnect it.
-          instance->MT_client.stop();
-          LOG_D("Target different, disconnect\n");
-          delay(1);  // Give scheduler room to breathe
+    bool didWork = false;
+
+    // 1. Send another request, if one is queued and the pipeline window has room
+    RequestEntry *request = nullptr;
+    if (inFlight.size() < instance->MT_maxInflight && (request = instance->requests.peek()) != nullptr) {
+
+      // Is the connection up and pointing to the request's target?
+      bool targetMatch = instance->MT_activeClient->connected() && !(instance->MT_lastTarget != request->target);
+
+      // A target switch may only happen once all pending responses are in
+      if (!targetMatch && inFlight.empty()) {
+        if (instance->MT_clientFactory) {
+          // Pooling enabled: switching targets is a pool lookup - the previous
+          // socket stays open for the next time its target comes around
+          Client *conn = instance->getConnection(request->target);
+          if (conn) {
+            instance->MT_activeClient = conn;
+            instance->MT_rxBuffer.clear();
+            instance->MT_lastTarget = request->target;
+            targetMatch = true;
+          }
         } else {
-          // it is the same host/port.
-          // Give it some slack to get ready again
-          while (millis() - lastRequest < request->target.interval) { delay(1); }
+          if (instance->MT_activeClient->connected()) {
+            // Wrong target connected - disconnect it first
+            instance->MT_activeClient->stop();
+            LOG_D("Target different, disconnect\n");
+            delay(1);  // Give scheduler room to breathe
+          }
+          // Connect to host/port of the queued request
+          instance->MT_activeClient->connect(request->target.host, request->target.port);
+          LOG_D("Target connect (%d.%d.%d.%d:%d).\n", request->target.host[0], request->target.host[1], request->target.host[2], request->target.host[3], request->target.port);
+          delay(1);  // Give scheduler room to breathe
+          // Are we connected now?
+          if (instance->MT_activeClient->connected()) {
+            // Yes. Empty the RX buffer in case there is a stray response left
+            while (instance->MT_activeClient->available() && instance->MT_activeClient->read() != -1) {}
+            instance->MT_rxBuffer.clear();
+            instance->MT_lastTarget = request->target;
+            targetMatch = true;
+          }
+        }
+        if (!targetMatch) {
+          // Connection failed - respond with an error and drop the request
+          ModbusMessage response;
+          response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), IP_CONNECTION_FAILED);
+          instance->respond(request, response);
+          // Remove the front entry and recycle it
+          instance->requests.pop();
+          instance->MT_pool.release(request);
+          didWork = true;
         }
       }
-      // if client is disconnected (we will have to switch hosts)
-      if (!instance->MT_client.connected()) {
-        // Serial.println("Client reconnecting");
-        // It is disconnected. connect to host/port from queue
-        instance->MT_client.connect(request->target.host, request->target.port);
-        LOG_D("Target connect (%d.%d.%d.%d:%d).\n", request->target.host[0], request->target.host[1], request->target.host[2], request->target.host[3], request->target.port);
 
-        delay(1);  // Give scheduler room to breathe
-      }
-      // Are we connected (again)?
-      if (instance->MT_client.connected()) {
+      // Connection fits the request - give this target some slack, then send
+      uint32_t& lastSent = lastRequest[targetKey(request->target)];
+      if (targetMatch && (millis() - lastSent >= request->target.interval)) {
         LOG_D("Is connected. Send request.\n");
-        // Yes. Send the request via IP
-        instance->send(request);
-
-        // Get the response - if any
-        ModbusMessage response = instance->receive(request);
-
-        // Did we get a normal response?
-        if (response.getError()==SUCCESS) {
-          LOG_D("Data response.\n");
-          // Yes. Is it a synchronous request?
-          if (request->isSyncRequest) {
-            // Yes. Put the response into the response map
-            {
-              LOCK_GUARD(sL, instance->syncRespM);
-              instance->syncResponse[request->token] = response;
-            }
-          // No, async request. Do we have an onResponse handler?
-          } else if (instance->onResponse) {
-            // Yes. Call it.
-            instance->onResponse(response, request->token);
-          // No, but do we have an onData handler registered?
-          } else if (instance->onData) {
-            // Yes. call it
-            instance->onData(response, request->token);
+        // Remove the front entry from the queue
+        instance->requests.pop();
+        // The entry that goes on the wire - the request itself, or a synthesized merged read
+        RequestEntry *wire = request;
+        // Read coalescing enabled and a plain register read at hand?
+        if (instance->MT_coalesceReads && isPlainRead(request->msg)) {
+          wire = instance->coalesceReads(request);
+        }
+        instance->send(wire);
+        wire->sentTime = millis();
+#if MODBUS_LATENCY_STATS
+        wire->sentMicros = (uint32_t)micros();
+        instance->latency.record(request->msg.getServerID(), ModbusLatency::QUEUE_WAIT, wire->sentMicros - request->enqueuedMicros);
+#endif
+        // Park the request until its response arrives, deadline on the wheel
+        inFlight[wire->head.transactionID] = wire;
+        timeouts.schedule(wire->head.transactionID, request->target.timeout, wire->sentTime);
+        lastSent = millis();
+        didWork = true;
+      }
+    }
+
+    // 2. Check for a response frame, if any requests are outstanding
+    if (!inFlight.empty()) {
+      ModbusMessage frame;
+      if (instance->receiveFrame(frame)) {
+        // Frame is complete (MBAP header plus PDU). Find the matching request
+        uint16_t tid = (frame[0] << 8) | frame[1];
+        auto f = inFlight.find(tid);
+        if (f != inFlight.end()) {
+          RequestEntry *request = f->second;
+          inFlight.erase(f);
+          timeouts.cancel(tid);
+          ModbusMessage response;
+          // Protocol ID shall be 0x0000, server ID and FC shall match the request
+          if (frame[2] != 0 || frame[3] != 0) {
+            response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), TCP_HEAD_MISMATCH);
+          } else if (frame[6] != request->msg.getServerID()) {
+            response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), SERVER_ID_MISMATCH);
+          } else if ((frame[7] & 0x7F) != request->msg.getFunctionCode()) {
+            response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), FC_MISMATCH);
           } else {
-            LOG_D("No handler for response!\n");
-          }
-        } else {
-          // No, something went wrong. All we have is an error
-          LOG_D("Error response.\n");
-          // Count it
-          {
-            LOCK_GUARD(responseCnt, instance->countAccessM);
-            instance->errorCount++;
+            // Looks good - hand over the PDU
+            response.add(frame.data() + 6, frame.size() - 6);
           }
-          // Is it a synchronous request?
-          if (request->isSyncRequest) {
-            // Yes. Put the response into the response map
-            {
-              LOCK_GUARD(sL, instance->syncRespM);
-              instance->syncResponse[request->token] = response;
-            }
-          // No, but do we have an onResponse handler?
-          } else if (instance->onResponse) {
-            // Yes, call it.
-            instance->onResponse(response, request->token);
-          // No, but do we have an onError handler?
-          } else if (instance->onError) {
-            // Yes. Forward the error code to it
-            instance->onError(response.getError(), request->token);
+#if MODBUS_LATENCY_STATS
+          instance->latency.record(request->msg.getServerID(), ModbusLatency::WIRE_TIME, (uint32_t)micros() - request->sentMicros);
+#endif
+          // A coalesced wire request?
+          auto mp = instance->MT_mergedParts.find(tid);
+          if (mp != instance->MT_mergedParts.end()) {
+            // Yes - every requester behind it gets its slice of the span
+            instance->respondMerged(request, mp->second, response);
+            instance->MT_mergedParts.erase(mp);
           } else {
-            LOG_D("No onError handler\n");
+            instance->respond(request, response);
           }
+          instance->MT_pool.release(request);
+        } else {
+          // No pending request with that ID - drop the frame
+          LOG_D("Unexpected transactionID %04X - frame dropped\n", tid);
         }
-        //   set lastHost/lastPort tp host/port
-        instance->MT_lastTarget = request->target;
-      } else {
-        // Oops. Connection failed
-        // Do we have an onError handler?
-        if (instance->onError) {
-          // Yes. Forward the error code to it
-          instance->onError(IP_CONNECTION_FAILED, request->token);
+        didWork = true;
+      }
+
+      // 3. Time out overdue requests - the wheel hands over the due transactionIDs,
+      //    no per-request scanning involved
+      expired.clear();
+      timeouts.advance(millis(), expired);
+      for (uint16_t overdue : expired) {
+        auto it = inFlight.find(overdue);
+        // Still in flight? (Responses cancel their deadline, so it should be.)
+        if (it == inFlight.end()) continue;
+        RequestEntry *request = it->second;
+        ModbusMessage response;
+        response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), TIMEOUT);
+        // A coalesced wire request?
+        auto mp = instance->MT_mergedParts.find(overdue);
+        if (mp != instance->MT_mergedParts.end()) {
+          // Yes - every requester behind it gets the timeout
+          instance->respondMerged(request, mp->second, response);
+          instance->MT_mergedParts.erase(mp);
+        } else {
+          instance->respond(request, response);
         }
+        inFlight.erase(it);
+        instance->MT_pool.release(request);
+        didWork = true;
       }
-      // Clean-up time. 
-      if (!doNotPop)
-      {
-        // Safely lock the queue
-        LOCK_GUARD(lockGuard, instance->qLock);
-        // Remove the front queue entry
-        instance->requests.pop();
-        // Delete request
-        delete request;
-        LOG_D("Request popped from queue.\n");
+    }
+
+    // Nothing happened in this turn?
+    if (!didWork) {
+      // Use the breather to retire pooled connections that sat idle for too long
+      if (instance->MT_clientFactory) {
+        instance->checkIdleConnections();
       }
-      lastRequest = millis();
-    } else {
+#if IS_LINUX
+      // Pick the wait bound: a queued but throttled request must be re-checked
+      // soon, pending responses within one timeout wheel tick, a fully idle
+      // client may park for long stretches - socket data and freshly queued
+      // requests end the wait early in any case
+      uint32_t bound = 100;
+      if (instance->requests.size()) bound = 1;
+      else if (!inFlight.empty()) bound = timeouts.tickMs();
+      instance->waitEvent(bound);
+#else
       delay(1);  // Give scheduler room to breathe
+#endif
+    }
+  }
+}
+
+#if IS_LINUX
+// waitEvent: block in the kernel until the socket turns readable, addToQueue()
+// signals a fresh request or maxWaitMs passed. This replaces the former 1 ms
+// sleep-and-probe turns - an idle client instance uses no CPU at all while
+// parked here, instead of a wakeup syscall every millisecond.
+void ModbusClientTCP::waitEvent(uint32_t maxWaitMs) {
+  struct pollfd fds[2];
+  nfds_t numFDs = 0;
+  // The wakeup channel, if we got one
+  if (MT_wakeFD >= 0) {
+    fds[numFDs].fd = MT_wakeFD;
+    fds[numFDs].events = POLLIN;
+    numFDs++;
+  }
+  // The active socket, if it is open
+  int sock = MT_activeClient->fd();
+  if (sock >= 0) {
+    fds[numFDs].fd = sock;
+    fds[numFDs].events = POLLIN;
+    numFDs++;
+  }
+  // poll() with no descriptors (neither channel is open) still is a plain sleep
+  ::poll(fds, numFDs, (int)maxWaitMs);
+  // Drain the wakeup counter - its job is done once we are awake
+  if (MT_wakeFD >= 0 && (fds[0].revents & POLLIN)) {
+    uint64_t counter;
+    (void)!::read(MT_wakeFD, &counter, sizeof(counter));
+  }
+}
+#endif
+
+// getConnection: fetch (or open) the pooled connection for a target
+Client *ModbusClientTCP::getConnection(TargetHost& target) {
+  // Is the target in the pool already?
+  for (auto& entry : MT_connPool) {
+    if (entry.target == target) {
+      entry.lastUsed = millis();
+      // Still connected? The peer may have dropped us in the meantime
+      if (!entry.client->connected()) {
+        LOG_D("Pooled connection lost, reconnect\n");
+        entry.client->connect(target.host, target.port);
+        delay(1);  // Give scheduler room to breathe
+        if (!entry.client->connected()) return nullptr;
+      } else {
+        // Empty the RX buffer in case there is a stray response left
+        while (entry.client->available() && entry.client->read() != -1) {}
+        LOG_D("Pooled connection reused\n");
+      }
+      return entry.client;
+    }
+  }
+  // Not pooled yet. Make room first, if the pool is full
+  if (MT_connPool.size() >= MT_maxConnections) {
+    // Evict the least recently used connection - but never the active one
+    auto lru = MT_connPool.end();
+    uint32_t now = millis();
+    for (auto it = MT_connPool.begin(); it != MT_connPool.end(); ++it) {
+      if (it->client == MT_activeClient) continue;
+      if (lru == MT_connPool.end() || now - it->lastUsed > now - lru->lastUsed) lru = it;
+    }
+    if (lru != MT_connPool.end()) {
+      LOG_D("Evicting LRU pooled connection\n");
+      lru->client->stop();
+      delete lru->client;
+      MT_connPool.erase(lru);
+    }
+  }
+  // Open a fresh connection to the target
+  Client *conn = MT_clientFactory();
+  if (!conn) return nullptr;
+  conn->connect(target.host, target.port);
+  LOG_D("Pool connect (%d.%d.%d.%d:%d).\n", target.host[0], target.host[1], target.host[2], target.host[3], target.port);
+  delay(1);  // Give scheduler room to breathe
+  if (!conn->connected()) {
+    delete conn;
+    return nullptr;
+  }
+  MT_connPool.push_back(PoolEntry(conn, target));
+  return conn;
+}
+
+// checkIdleConnections: close pooled connections unused for too long
+void ModbusClientTCP::checkIdleConnections() {
+  for (auto it = MT_connPool.begin(); it != MT_connPool.end();) {
+    if (it->client != MT_activeClient && millis() - it->lastUsed > MT_idleTimeout) {
+      LOG_D("Closing idle pooled connection\n");
+      it->client->stop();
+      delete it->client;
+      it = MT_connPool.erase(it);
+    } else {
+      ++it;
     }
   }
 }
@@ -328,68 +604,166 @@ void ModbusClientTCP::handleConnection(ModbusClientTCP *instance) {
 // send: send request via Client connection
 void ModbusClientTCP::send(RequestEntry *request) {
   // We have a established connection here, so we can write right away.
-  // Move tcpHead and request into one continuous buffer, since the very first request tends to 
-  // take too long to be sent to be recognized.
-  ModbusMessage m;
-  m.add((const uint8_t *)request->head, 6);
-  m.append(request->msg);
+  // Assemble tcpHead and request in one stack buffer, so that the complete packet
+  // hits the socket in a single write() - no separate segment for the header, no
+  // heap allocation per request. A PDU has 253 bytes at most, so MBAP(6) + serverID,
+  // FC and payload always fit.
+  uint8_t packet[262];
+  uint16_t len = request->msg.size();
+  // Guard against nonsense message sizes (cf. receiveFrame())
+  if (len + 6u > sizeof(packet)) {
+    LOG_E("Oversized request (%d bytes) - not sent\n", len);
+    return;
+  }
+  memcpy(packet, (const uint8_t *)request->head, 6);
+  memcpy(packet + 6, request->msg.data(), len);
 
-  MT_client.write(m.data(), m.size());
+  MT_activeClient->write(packet, len + 6);
   // Done. Are we?
-  MT_client.flush();
-  HEXDUMP_V("Request packet", m.data(), m.size());
+  MT_activeClient->flush();
+  HEXDUMP_V("Request packet", packet, len + 6);
 }
 
-// receive: get response via Client connection
-ModbusMessage ModbusClientTCP::receive(RequestEntry *request) {
-  unsigned long lastMillis = millis();     // Timer to check for timeout
-  bool hadData = false;               // flag data received
-  const uint16_t dataLen(300);        // Modbus Packet supposedly will fit (260<300)
-  uint8_t data[dataLen];              // Local buffer to collect received data
-  uint16_t dataPtr = 0;               // Pointer into data
-  ModbusMessage response;             // Response structure to be returned
-
-  // wait for packet data, overflow or timeout
-  while (millis() - lastMillis < request->target.timeout && dataPtr < dataLen && !hadData) {
-    // Is there data waiting?
-    if (MT_client.available()) {
-      // Yes. catch as much as is there and fits into buffer
-      while (MT_client.available() && dataPtr < dataLen) {
-        data[dataPtr++] = MT_client.read();
+// receiveFrame: collect the bytes of the next MBAP frame as they arrive.
+// Non-blocking - partial frames are kept in MT_rxBuffer between calls.
+// Returns true once a complete frame (6 byte header plus payload) is in frame.
+bool ModbusClientTCP::receiveFrame(ModbusMessage& frame) {
+  while (MT_activeClient->available()) {
+    // Is the 6 byte MBAP header complete yet?
+    if (MT_rxBuffer.size() < 6) {
+      // No - collect it byte by byte; only the len field within it tells us more
+      MT_rxBuffer.push_back(MT_activeClient->read());
+      if (MT_rxBuffer.size() < 6) continue;
+      uint16_t len = (MT_rxBuffer[4] << 8) | MT_rxBuffer[5];
+      // Guard against nonsense length values (a PDU has 253 bytes at most)
+      if (len == 0 || len > 254) {
+        LOG_E("Invalid MBAP length %d - dropping data\n", len);
+        MT_rxBuffer.clear();
+        continue;
       }
-      // Register data received
-      hadData = true;
-      // Rewind EOT and timeout timers
-      lastMillis = millis();
+      // The len field announces the exact remainder - one allocation for the frame
+      MT_rxBuffer.reserve(len + 6);
+    }
+    // Header is in - read the announced remainder straight into the message buffer
+    uint16_t expected = ((MT_rxBuffer[4] << 8) | MT_rxBuffer[5]) + 6;
+    uint16_t missing = expected - MT_rxBuffer.size();
+    if (missing) {
+      int got = MT_activeClient->read(MT_rxBuffer.extend(missing), missing);
+      if (got < 0) got = 0;
+      // Shrink back over the bytes that have not arrived yet
+      if ((uint16_t)got < missing) MT_rxBuffer.resize(expected - (missing - got));
+    }
+    // Frame complete?
+    if (MT_rxBuffer.size() == expected) {
+      // Yes. Hand it over and reset the assembly buffer
+      frame = std::move(MT_rxBuffer);
+      MT_rxBuffer.clear();
+      HEXDUMP_V("Response packet", frame.data(), frame.size());
+      return true;
+    }
+  }
+  return false;
+}
+
+// coalesceReads: merge directly following adjacent reads into one synthesized wire
+// request. Returns the entry to put on the wire - the request itself if nothing merged.
+ModbusClientTCP::RequestEntry *ModbusClientTCP::coalesceReads(RequestEntry *request) {
+  std::vector<RequestEntry *> parts;
+  uint16_t spanStart = (request->msg[2] << 8) | request->msg[3];
+  uint16_t spanEnd = spanStart + ((request->msg[4] << 8) | request->msg[5]);
+  RequestEntry *next = nullptr;
+  // Collect directly following queue entries whose ranges adjoin the span
+  while ((next = requests.peek()) != nullptr) {
+    // The same kind of read to the same server and target?
+    if (!isPlainRead(next->msg)) break;
+    if (next->msg.getServerID() != request->msg.getServerID()) break;
+    if (next->msg.getFunctionCode() != request->msg.getFunctionCode()) break;
+    if (next->target != request->target) break;
+    uint16_t nextStart = (next->msg[2] << 8) | next->msg[3];
+    uint16_t nextEnd = nextStart + ((next->msg[4] << 8) | next->msg[5]);
+    // The range must adjoin or overlap the span - a gap would read registers nobody asked for
+    if (nextStart < spanStart || nextStart > spanEnd) break;
+    // The merged span must stay within the FC 03/04 limit of 125 registers
+    if ((nextEnd > spanEnd ? nextEnd : spanEnd) - spanStart > 125) break;
+    if (nextEnd > spanEnd) spanEnd = nextEnd;
+    // Merge it - the head request rides along with its followers
+    if (parts.empty()) parts.push_back(request);
+    requests.pop();
+    parts.push_back(next);
+  }
+  // Nothing merged?
+  if (parts.empty()) return request;
+  // Synthesize a wire request covering the whole span. It takes over the
+  // head's MBAP header, so the response is matched by the head's transactionID
+  ModbusMessage merged;
+  merged.setMessage(request->msg.getServerID(), request->msg.getFunctionCode(), spanStart, (uint16_t)(spanEnd - spanStart));
+  RequestEntry *wire = MT_pool.acquire(request->token, merged, request->target, false);
+  wire->head = request->head;
+  wire->head.len = merged.size();
+  LOG_D("Coalesced %d reads into span %04X/%04X\n", (uint32_t)parts.size(), spanStart, (uint16_t)(spanEnd - spanStart));
+  MT_mergedParts[wire->head.transactionID] = std::move(parts);
+  return wire;
+}
+
+// respondMerged: split a coalesced read response and deliver each requester its slice
+void ModbusClientTCP::respondMerged(RequestEntry *wire, std::vector<RequestEntry *>& parts, ModbusMessage& response) {
+  uint16_t spanStart = (wire->msg[2] << 8) | wire->msg[3];
+  for (auto *part : parts) {
+    ModbusMessage partResponse;
+    // Did the span read fail?
+    if (response.getError() != SUCCESS) {
+      // Yes - every requester gets the error
+      partResponse.setError(part->msg.getServerID(), part->msg.getFunctionCode(), response.getError());
+    } else {
+      // No - cut the slice this requester asked for
+      partResponse = sliceReadResponse(response, spanStart, part->msg);
     }
-    delay(1); // Give scheduler room to breathe
+    respond(part, partResponse);
+    MT_pool.release(part);
   }
-  // Did we get some data?
-  if (hadData) {
-    LOG_D("Received response.\n");
-    HEXDUMP_V("Response packet", data, dataPtr);
-    // Yes. check it for validity
-    // First transactionID and protocolID shall be identical, length has to match the remainder.
-    ModbusTCPhead head(request->head.transactionID, request->head.protocolID, dataPtr - 6);
-    // Matching head?
-    if (memcmp((const uint8_t *)head, data, 6)) {
-      // No. return Error response
-      response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), TCP_HEAD_MISMATCH);
-      // If the server id does not match that of the request, report error
-    } else if (data[6] != request->msg.getServerID()) {
-      response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), SERVER_ID_MISMATCH);
-      // If the function code does not match that of the request, report error
-    } else if ((data[7] & 0x7F) != request->msg.getFunctionCode()) {
-      response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), FC_MISMATCH);
+}
+
+// respond: dispatch a response to the requester - sync response map or handler callbacks
+void ModbusClientTCP::respond(RequestEntry *request, ModbusMessage& response) {
+#if MODBUS_LATENCY_STATS
+  uint32_t dispatchMicros = (uint32_t)micros();
+#endif
+  // Count an error response
+  if (response.getError() != SUCCESS) {
+    LOG_D("Error response.\n");
+    errorCount++;
+    stats.countError(request->msg.getServerID());
+  } else {
+    LOG_D("Data response.\n");
+  }
+  // A chunk of a logical read? Then it is consumed internally - see readRegisters()
+  if (gatherResponse(request->token, response)) return;
+  // Is it a synchronous request?
+  if (request->isSyncRequest) {
+    // Yes. Move the response into the response map and wake the waiting task
+    postSyncResponse(request->token, std::move(response));
+  // No, async request. Do we have an onResponse handler?
+  } else if (onResponse) {
+    // Yes. Call it - the response is moved, not copied, into its parameter
+    onResponse(std::move(response), request->token);
+  } else if (response.getError() == SUCCESS) {
+    // Do we have an onData handler registered?
+    if (onData) {
+      onData(std::move(response), request->token);
     } else {
-      // Looks good.
-      response.add(data + 6, dataPtr - 6);
+      LOG_D("No handler for response!\n");
     }
   } else {
-    // No, timeout must have struck
-    response.setError(request->msg.getServerID(), request->msg.getFunctionCode(), TIMEOUT);
+    // Error response - do we have an onError handler?
+    if (onError) {
+      onError(response.getError(), request->token);
+    } else {
+      LOG_D("No onError handler\n");
+    }
   }
-  return response;
+#if MODBUS_LATENCY_STATS
+  latency.record(request->msg.getServerID(), ModbusLatency::DISPATCH_TIME, (uint32_t)micros() - dispatchMicros);
+#endif
 }
 
 #endif
@@ -13,10 +13,13 @@
 #endif
 
 #include "ModbusClient.h"
+#include "MessagePool.h"
+#include "RequestQueue.h"
+#include "TimerWheel.h"
+#include "TaskConfig.h"
 #include "Client.h"
-#include <queue>
 #include <vector>
-using std::queue;
+#include <functional>
 
 #define TARGETHOSTINTERVAL 10
 #define DEFAULTTIMEOUT 2000
@@ -35,12 +38,45 @@ public:
   // begin: start worker task
   void begin(int coreID = -1);
 
+#if HAS_FREERTOS
+  // begin with full task tuning - priority, stack size and core pin.
+  // Default is TaskConfig(5, 4096).
+  void begin(TaskConfig tc);
+
+  // stackHighWaterMark: unused stack of the worker task in bytes, as reported
+  // by FreeRTOS - 0 if the worker is not running
+  uint32_t stackHighWaterMark();
+#endif
+
   // Set default timeout value (and interval)
   void setTimeout(uint32_t timeout = DEFAULTTIMEOUT, uint32_t interval = TARGETHOSTINTERVAL);
 
   // Switch target host (if necessary)
   bool setTarget(IPAddress host, uint16_t port, uint32_t timeout = 0, uint32_t interval = 0);
 
+  // Set maximum number of requests kept in flight on the socket (pipelining window).
+  // Default is 1 = classic one-request-at-a-time behaviour.
+  // Responses are matched to their requests by the MBAP transactionID, not by
+  // arrival order - servers answering fast reads before slow writes issued
+  // earlier complete each request's own token, so raising the window is safe
+  // with such devices.
+  void setMaxInflightRequests(uint16_t maxInflightRequests);
+
+  // Enable a pool of persistent connections, one per target host, so that switching
+  // targets is a lookup instead of a socket teardown plus TCP handshake.
+  // The factory shall return a freshly allocated Client of the same type as the one
+  // given to the constructor - the pool takes ownership of it. Up to maxConnections
+  // sockets are kept open; the least recently used target is evicted when the pool
+  // is full, and connections idle for more than idleTimeout ms are closed.
+  // Must be called before begin()!
+  void useConnectionPool(std::function<Client *()> clientFactory, uint8_t maxConnections = 4, uint32_t idleTimeout = 60000);
+
+  // Toggle coalescing of adjacent FC 03/04 reads: directly following queued reads to
+  // the same server and target whose register ranges adjoin each other are merged into
+  // a single wire request of up to 125 registers, saving a round-trip per merge.
+  // Every requester still gets its own response, cut from the merged one.
+  void useReadCoalescing(bool onOff = true);
+
   // Return number of unprocessed requests in queue
   uint32_t pendingRequests();
 
@@ -137,19 +173,29 @@ protected:
     ModbusMessage msg;
     TargetHost target;
     ModbusTCPhead head;
+    uint32_t sentTime;
     bool isSyncRequest;
+#if MODBUS_LATENCY_STATS
+    uint32_t enqueuedMicros;       // Timestamp taken in addToQueue()
+    uint32_t sentMicros;           // Timestamp taken right after send()
+#endif
     RequestEntry(uint32_t t, ModbusMessage m, TargetHost tg, bool syncReq = false) :
       token(t),
-      msg(m),
+      msg(std::move(m)),
       target(tg),
       head(ModbusTCPhead()),
+      sentTime(0),
       isSyncRequest(syncReq) {}
   };
 
   // Base addRequest and syncRequest must be present
   Error addRequestM(ModbusMessage msg, uint32_t token);
   ModbusMessage syncRequestM(ModbusMessage msg, uint32_t token);
-  // TCP-specific addition "...MT()" including adhoc target - used by bridge 
+#if IS_LINUX
+  // Non-blocking sync enqueue backing ModbusClient::requestAsync()
+  Error queueSyncRequestM(ModbusMessage msg, uint32_t token);
+#endif
+  // TCP-specific addition "...MT()" including adhoc target - used by bridge
   Error addRequestMT(ModbusMessage msg, uint32_t token, IPAddress targetHost, uint16_t targetPort);
   ModbusMessage syncRequestMT(ModbusMessage msg, uint32_t token, IPAddress targetHost, uint16_t targetPort);
 
@@ -160,25 +206,81 @@ protected:
   static void handleConnection(ModbusClientTCP *instance);
 #if IS_LINUX
   static void *pHandle(void *p);
+
+  // waitEvent: block in the kernel until the socket turns readable, a request
+  // was queued or maxWaitMs passed - no CPU is used while parked here
+  void waitEvent(uint32_t maxWaitMs);
 #endif
 
   // send: send request via Client connection
   void send(RequestEntry *request);
 
-  // receive: get response via Client connection
-  ModbusMessage receive(RequestEntry *request);
+  // receiveFrame: collect the bytes of the next MBAP frame as they arrive
+  bool receiveFrame(ModbusMessage& frame);
+
+  // One keep-alive connection of the pool
+  struct PoolEntry {
+    Client *client;             // Factory-created socket, owned by the pool
+    TargetHost target;          // Target this socket is connected to
+    uint32_t lastUsed;          // millis() of last use, for LRU eviction and idle timeout
+    PoolEntry(Client *c, TargetHost t) :
+      client(c),
+      target(t),
+      lastUsed(millis()) {}
+
+    inline PoolEntry(const PoolEntry& p) :
+      client(p.client),
+      target(p.target.host, p.target.port, p.target.timeout, p.target.interval),
+      lastUsed(p.lastUsed) {}
+
+    inline PoolEntry& operator=(const PoolEntry& p) {
+      client = p.client;
+      target.host = p.target.host;
+      target.port = p.target.port;
+      target.timeout = p.target.timeout;
+      target.interval = p.target.interval;
+      lastUsed = p.lastUsed;
+      return *this;
+    }
+  };
+
+  // getConnection: fetch (or open) the pooled connection for a target
+  Client *getConnection(TargetHost& target);
+
+  // checkIdleConnections: close pooled connections unused for too long
+  void checkIdleConnections();
+
+  // respond: dispatch a response to the requester (sync map or handler callbacks)
+  void respond(RequestEntry *request, ModbusMessage& response);
+
+  // coalesceReads: merge directly following adjacent reads into one synthesized wire
+  // request. Returns the entry to put on the wire - the request itself if nothing merged.
+  RequestEntry *coalesceReads(RequestEntry *request);
+
+  // respondMerged: split a coalesced read response and deliver each requester its slice
+  void respondMerged(RequestEntry *wire, std::vector<RequestEntry *>& parts, ModbusMessage& response);
 
   void isInstance() { return; }   // make class instantiable
-  queue<RequestEntry *> requests;   // Queue to hold requests to be processed
-  #if USE_MUTEX
-  mutex qLock;                    // Mutex to protect queue
-  #endif
+  RequestQueue<RequestEntry> requests; // Lock-free MPSC queue to hold requests to be processed
+  MessagePool<RequestEntry> MT_pool; // Recycling storage for queue entries, sized in begin()
   Client& MT_client;              // Client reference for Internet connections (EthernetClient or WifiClient)
+  Client *MT_activeClient;        // Socket currently in use - &MT_client, or a pooled connection
+  std::vector<PoolEntry> MT_connPool;        // Keep-alive connections by target
+  std::function<Client *()> MT_clientFactory; // Creates pool sockets; empty = pooling disabled
+  uint8_t MT_maxConnections;      // Maximum number of pooled sockets kept open
+  uint32_t MT_idleTimeout;        // Time in ms after which an unused pooled socket is closed
   TargetHost MT_lastTarget;       // last used server
   TargetHost MT_target;           // Description of target server
   uint32_t MT_defaultTimeout;     // Standard timeout value taken if no dedicated was set
   uint32_t MT_defaultInterval;    // Standard interval value taken if no dedicated was set
   uint16_t MT_qLimit;             // Maximum number of requests to accept in queue
+  uint16_t MT_maxInflight;        // Pipelining window: requests in flight at the same time
+  bool MT_coalesceReads;          // true=merge adjacent queued FC 03/04 reads into one wire request
+  std::map<uint16_t, std::vector<RequestEntry *>> MT_mergedParts; // Requests behind a coalesced wire request, by transactionID
+  ModbusMessage MT_rxBuffer;      // Partly received MBAP frame between receiveFrame() calls
+#if IS_LINUX
+  int MT_wakeFD;                  // eventfd addToQueue() signals to end the worker's kernel wait
+#endif
 
   // Let any ModbusBridge class use protected members
   template<typename SERVERCLASS> friend class ModbusBridge;
@@ -32,6 +32,11 @@ ModbusClientTCPasync::ModbusClientTCPasync(IPAddress address, uint16_t port, uin
 
       // disable nagle algorithm ref Modbus spec
       MTA_client.setNoDelay(true);
+
+      // Allocate recycling storage for the request entries once - the queue admission
+      // check caps the number of live entries at the queue limit, so steady-state
+      // traffic never touches the heap for queue bookkeeping again
+      MTA_pool.resize(queueLimit);
     }
 
 // Destructor: clean up queue, task etc.
@@ -43,11 +48,11 @@ ModbusClientTCPasync::~ModbusClientTCPasync() {
     LOCK_GUARD(lock2, sLock);
     // Delete all elements from queues
     while (!txQueue.empty()) {
-      delete txQueue.front();
+      MTA_pool.release(txQueue.front());
       txQueue.pop_front();
     }
     for (auto it = rxQueue.cbegin(); it != rxQueue.cend();/* no increment */) {
-      delete it->second;
+      MTA_pool.release(it->second);
       it = rxQueue.erase(it);
     }
   }
@@ -139,16 +144,20 @@ bool ModbusClientTCPasync::addToQueue(int32_t token, ModbusMessage request, bool
     LOCK_GUARD(lock1, qLock);
     if (txQueue.size() + rxQueue.size() < MTA_qLimit) {
       HEXDUMP_V("Enqueue", request.data(), request.size());
-      RequestEntry *re = new RequestEntry(token, request, syncReq);
+      // Remember the header data - the message is moved into the entry
+      uint16_t len = request.size();
+      stats.countMessage(request.getServerID(), request.getFunctionCode());
+      RequestEntry *re = MTA_pool.acquire(token, std::move(request), syncReq);
       if (!re) return false;  //TODO: proper error returning in case allocation fails
       // inject proper transactionID
       re->head.transactionID = messageCount++;
-      re->head.len = request.size();
+      re->head.len = len;
       // if we're already connected, try to send and push to rxQueue
       // or else push to txQueue and (re)connect
       if (MTA_state == CONNECTED && send(re)) {
         re->sentTime = millis();
         rxQueue[re->head.transactionID] = re;
+        MTA_timeouts.schedule(re->head.transactionID, MTA_timeout, re->sentTime);
       } else {
         txQueue.push_back(re);
         if (MTA_state == DISCONNECTED) {
@@ -182,7 +191,7 @@ void ModbusClientTCPasync::onDisconnected() {
     if (onError) {
       onError(IP_CONNECTION_FAILED, r->token);
     }
-    delete r;
+    MTA_pool.release(r);
     txQueue.pop_front();
   }
   while (!rxQueue.empty()) {
@@ -190,9 +199,10 @@ void ModbusClientTCPasync::onDisconnected() {
     if (onError) {
       onError(IP_CONNECTION_FAILED, r->token);
     }
-    delete r;
+    MTA_pool.release(r);
     rxQueue.erase(rxQueue.begin());
   }
+  MTA_timeouts.clear();
 }
 
 
@@ -218,9 +228,11 @@ void ModbusClientTCPasync::onPacket(uint8_t* data, size_t length) {
   if (length) {
     LOG_D("parsing (len:%d)\n", length + 1);
   }
+  // One response message reused across all frames in this packet - moving it out to a
+  // handler leaves it empty, a small next frame then fits its inline buffer again
+  ModbusMessage response;
   while (length > 0) {
     RequestEntry* request = nullptr;
-    ModbusMessage* response = nullptr;
     uint16_t transactionID = 0;
     uint16_t protocolID = 0;
     uint16_t messageLength = 0;
@@ -237,8 +249,8 @@ void ModbusClientTCPasync::onPacket(uint8_t* data, size_t length) {
       if (protocolID == 0 &&
         length >= (uint32_t)messageLength + 6 &&
         messageLength < 256) {
-        response = new ModbusMessage(messageLength);
-        response->add(&data[6], messageLength);
+        response.clear();
+        response.add(&data[6], messageLength);
         LOG_D("packet validated (len:%d)\n", messageLength);
 
         // on next iteration: adjust remaining length and pointer to data
@@ -260,6 +272,7 @@ void ModbusClientTCPasync::onPacket(uint8_t* data, size_t length) {
         // found it, handle it and stop iterating
         request = i->second;
         i = rxQueue.erase(i);
+        MTA_timeouts.cancel(transactionID);
         LOG_D("matched request\n");
       } else {
         // TCP packet did not yield valid modbus response, abort function
@@ -272,40 +285,37 @@ void ModbusClientTCPasync::onPacket(uint8_t* data, size_t length) {
     if (request) {
       // compare request with response
       Error error = SUCCESS;
-      if (request->msg.getFunctionCode() != (response->getFunctionCode() & 0x7F)) {
+      if (request->msg.getFunctionCode() != (response.getFunctionCode() & 0x7F)) {
         error = FC_MISMATCH;
-      } else if (request->msg.getServerID() != response->getServerID()) {
+      } else if (request->msg.getServerID() != response.getServerID()) {
         error = SERVER_ID_MISMATCH;
       } else {
-        error = response->getError();
+        error = response.getError();
       }
 
       if (error != SUCCESS) {
-        LOCK_GUARD(errorCntLock, countAccessM);
         errorCount++;
+        stats.countError(request->msg.getServerID());
       }
 
       if (request->isSyncRequest) {
-        {
-          LOCK_GUARD(sL ,syncRespM);
-          syncResponse[request->token] = *response;
-        }
+        postSyncResponse(request->token, std::move(response));
       } else if (onResponse) {
-        onResponse(*response, request->token);
+        // The response is moved, not copied, into the handler's parameter
+        onResponse(std::move(response), request->token);
       } else {
         if (error == SUCCESS) {
           if (onData) {
-            onData(*response, request->token);
+            onData(std::move(response), request->token);
           }
         } else {
           if (onError) {
-            onError(response->getError(), request->token);
+            onError(response.getError(), request->token);
           }
         }
       }
-      delete request;
+      MTA_pool.release(request);
     }
-    delete response;
 
   }  // end processing of incoming data
 
@@ -321,19 +331,23 @@ void ModbusClientTCPasync::onPoll() {
   // try to send whatever is waiting
   handleSendingQueue();
 
-  // next check if timeout has struck for oldest request
-  if (!rxQueue.empty()) {
-    RequestEntry* request = rxQueue.begin()->second;
-    if (millis() - request->sentTime > MTA_timeout) {
-      LOG_D("request timeouts (now:%lu-sent:%u)\n", millis(), request->sentTime);
-      // oldest element timeouts, call onError and clean up
-      if (onError) {
-        // Handle timeout error
-        onError(TIMEOUT, request->token);
-      }
-      delete request;
-      rxQueue.erase(rxQueue.begin());
+  // next check if a timeout has struck. The wheel hands over all due
+  // transactionIDs at once - formerly only the oldest request was checked,
+  // so stacked-up timeouts trickled out one per poll cycle
+  std::vector<uint16_t> expired;
+  MTA_timeouts.advance(millis(), expired);
+  for (uint16_t overdue : expired) {
+    auto i = rxQueue.find(overdue);
+    if (i == rxQueue.end()) continue;
+    RequestEntry* request = i->second;
+    LOG_D("request timeouts (now:%lu-sent:%u)\n", millis(), request->sentTime);
+    // element timeouts, call onError and clean up
+    if (onError) {
+      // Handle timeout error
+      onError(TIMEOUT, request->token);
     }
+    MTA_pool.release(request);
+    rxQueue.erase(i);
   }
     
   }  // end lockguard scope
@@ -357,6 +371,7 @@ void ModbusClientTCPasync::handleSendingQueue() {
       // after sending, update timeout value, add to other queue and remove from this queue
       (*it)->sentTime = millis();
       rxQueue[(*it)->head.transactionID] = (*it);      // push request to other queue
+      MTA_timeouts.schedule((*it)->head.transactionID, MTA_timeout, (*it)->sentTime);
       it = txQueue.erase(it);  // remove from toSend queue and point i to next request
     } else {
       // sending didn't succeed, try next request
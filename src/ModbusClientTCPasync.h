@@ -13,6 +13,8 @@
 #include "options.h"
 #include "ModbusMessage.h"
 #include "ModbusClient.h"
+#include "TimerWheel.h"
+#include "MessagePool.h"
 #include <list>
 #include <map>
 #include <vector>
@@ -99,7 +101,7 @@ protected:
     bool isSyncRequest;
     RequestEntry(uint32_t t, ModbusMessage m, bool syncReq = false) :
       token(t),
-      msg(m),
+      msg(std::move(m)),
       head(ModbusTCPhead()),
       sentTime(0),
       isSyncRequest(syncReq) {}
@@ -132,6 +134,8 @@ protected:
 
   std::list<RequestEntry*> txQueue;           // Queue to hold requests to be sent
   std::map<uint16_t, RequestEntry*> rxQueue;  // Queue to hold requests to be processed
+  TimerWheel<uint16_t> MTA_timeouts;          // Deadlines of the in-flight requests, by transactionID
+  MessagePool<RequestEntry> MTA_pool;         // Recycling storage for request entries, sized from the queue limit
   #if USE_MUTEX
   std::mutex sLock;                         // Mutex to protect state
   std::mutex qLock;                         // Mutex to protect queues
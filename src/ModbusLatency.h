@@ -0,0 +1,134 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _MODBUS_LATENCY_H
+#define _MODBUS_LATENCY_H
+
+#include <cstdint>
+#include <atomic>
+#include <cstring>
+
+// ModbusLatency: per-serverID latency histograms for client transactions,
+// compiled in with MODBUS_LATENCY_STATS=1 (see options.h).
+// Each sample lands in one of 32 power-of-two buckets - bucket n covers
+// [2^n, 2^(n+1)) microseconds, bucket 0 additionally catches 0 and 1.
+// Recording is one CLZ plus one relaxed atomic increment, no allocation
+// past the first sample for a serverID, so it is safe on the worker's
+// hot path. Reading a snapshot never stops the worker.
+class ModbusLatency {
+public:
+  // The measured phases of a request's life cycle
+  enum Phase : uint8_t {
+    QUEUE_WAIT = 0,      // addToQueue() until the worker picks the request up
+    WIRE_TIME = 1,       // request sent until the response was received
+    DISPATCH_TIME = 2,   // response received until the user handler returned
+  };
+  static constexpr uint8_t NUM_PHASES = 3;
+  static constexpr uint8_t NUM_BUCKETS = 32;
+
+  // Snapshot: coherent copy of the histograms gathered for one serverID
+  struct Snapshot {
+    uint32_t bucket[NUM_PHASES][NUM_BUCKETS];  // sample counts by phase and bucket
+  };
+
+  // Constructor: start with no blocks allocated
+  ModbusLatency() {
+    for (auto& b : LTblocks) {
+      b.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  // Destructor: drop all blocks
+  ~ModbusLatency() {
+    for (auto& b : LTblocks) {
+      delete b.load(std::memory_order_relaxed);
+    }
+  }
+
+  // No copying - the blocks are owned by exactly one client
+  ModbusLatency(const ModbusLatency&) = delete;
+  ModbusLatency& operator=(const ModbusLatency&) = delete;
+
+  // record: file one duration sample for serverID/phase
+  void record(uint8_t serverID, Phase phase, uint32_t microseconds) {
+    getBlock(serverID)->bucket[phase][bucketOf(microseconds)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // getSnapshot: copy the histograms for one serverID
+  Snapshot getSnapshot(uint8_t serverID) const {
+    Snapshot s;
+    Block *b = LTblocks[serverID].load(std::memory_order_acquire);
+    // Anything gathered for this ID yet?
+    if (b) {
+      // Yes, copy out all buckets
+      for (uint8_t p = 0; p < NUM_PHASES; ++p) {
+        for (uint8_t i = 0; i < NUM_BUCKETS; ++i) {
+          s.bucket[p][i] = b->bucket[p][i].load(std::memory_order_relaxed);
+        }
+      }
+    } else {
+      // No, deliver all zeroes
+      memset(&s, 0, sizeof(s));
+    }
+    return s;
+  }
+
+  // reset: zero out all gathered samples (blocks are kept)
+  void reset() {
+    for (auto& blk : LTblocks) {
+      Block *b = blk.load(std::memory_order_acquire);
+      if (b) {
+        for (auto& p : b->bucket) {
+          for (auto& i : p) {
+            i.store(0, std::memory_order_relaxed);
+          }
+        }
+      }
+    }
+  }
+
+  // bucketOf: map a duration to its histogram bucket (floor(log2))
+  static uint8_t bucketOf(uint32_t microseconds) {
+    return microseconds > 1 ? 31 - __builtin_clz(microseconds) : 0;
+  }
+
+  // bucketFloor: lower bound in microseconds of a bucket, for report printing
+  static uint32_t bucketFloor(uint8_t bucket) {
+    return bucket ? (1UL << bucket) : 0;
+  }
+
+protected:
+  // One histogram block per addressed serverID
+  struct Block {
+    std::atomic<uint32_t> bucket[NUM_PHASES][NUM_BUCKETS];
+    Block() {
+      for (auto& p : bucket) {
+        for (auto& i : p) {
+          i.store(0, std::memory_order_relaxed);
+        }
+      }
+    }
+  };
+
+  // getBlock: find the block for a serverID, allocating it on first use.
+  // Concurrent first uses are resolved by compare-exchange - the loser
+  // deletes its allocation again.
+  Block *getBlock(uint8_t serverID) {
+    Block *b = LTblocks[serverID].load(std::memory_order_acquire);
+    if (!b) {
+      Block *fresh = new Block();
+      if (LTblocks[serverID].compare_exchange_strong(b, fresh, std::memory_order_acq_rel)) {
+        b = fresh;
+      } else {
+        // Another task was faster - use its block
+        delete fresh;
+      }
+    }
+    return b;
+  }
+
+  std::atomic<Block *> LTblocks[256];  // histogram blocks by serverID
+};
+
+#endif  // _MODBUS_LATENCY_H
@@ -6,6 +6,178 @@
 #undef LOCAL_LOG_LEVEL
 // #define LOCAL_LOG_LEVEL LOG_LEVEL_ERROR
 #include "Logging.h"
+#include "CoilData.h"
+#include <cstring>
+
+// MMbuffer: small-buffer storage for message data
+// Constructor: start with the inline storage
+MMbuffer::MMbuffer() :
+  BFlen(0),
+  BFcapacity(MODBUSMESSAGE_INLINE_SIZE),
+  BFptr(BFinline) { }
+
+// Destructor: release heap storage, if any was claimed
+MMbuffer::~MMbuffer() {
+  if (BFptr != BFinline) {
+    delete[] BFptr;
+  }
+}
+
+// Copy constructor
+MMbuffer::MMbuffer(const MMbuffer& b) :
+  BFlen(0),
+  BFcapacity(MODBUSMESSAGE_INLINE_SIZE),
+  BFptr(BFinline) {
+  append(b.BFptr, b.BFlen);
+}
+
+// Assignment operator
+MMbuffer& MMbuffer::operator=(const MMbuffer& b) {
+  // Do anything only if not self-assigning
+  if (this != &b) {
+    clear();
+    append(b.BFptr, b.BFlen);
+  }
+  return *this;
+}
+
+#ifndef NO_MOVE
+// Move constructor
+MMbuffer::MMbuffer(MMbuffer&& b) :
+  BFlen(b.BFlen),
+  BFcapacity(b.BFcapacity),
+  BFptr(BFinline) {
+  // Heap storage can be taken over as-is, inline bytes must be copied
+  if (b.BFptr != b.BFinline) {
+    BFptr = b.BFptr;
+  } else {
+    memcpy(BFinline, b.BFinline, BFlen);
+  }
+  // Leave the source empty, but usable
+  b.BFlen = 0;
+  b.BFcapacity = MODBUSMESSAGE_INLINE_SIZE;
+  b.BFptr = b.BFinline;
+}
+
+// Move assignment
+MMbuffer& MMbuffer::operator=(MMbuffer&& b) {
+  if (this != &b) {
+    // Drop own heap storage, if any
+    if (BFptr != BFinline) {
+      delete[] BFptr;
+    }
+    BFlen = b.BFlen;
+    BFcapacity = b.BFcapacity;
+    // Heap storage can be taken over as-is, inline bytes must be copied
+    if (b.BFptr != b.BFinline) {
+      BFptr = b.BFptr;
+    } else {
+      BFptr = BFinline;
+      BFcapacity = MODBUSMESSAGE_INLINE_SIZE;
+      memcpy(BFinline, b.BFinline, BFlen);
+    }
+    // Leave the source empty, but usable
+    b.BFlen = 0;
+    b.BFcapacity = MODBUSMESSAGE_INLINE_SIZE;
+    b.BFptr = b.BFinline;
+  }
+  return *this;
+}
+#endif
+
+// reserve: provide storage for at least newCapacity bytes
+void MMbuffer::reserve(uint16_t newCapacity) {
+  // Anything to do at all? The inline buffer is the lower capacity bound.
+  if (newCapacity > BFcapacity) {
+    // Yes, we need to spill to (larger) heap storage.
+    // Grow in doubling steps to keep re-allocations rare. Doubling is done in
+    // 32 bits - a 16-bit capacity would wrap to 0 beyond 32768 - and capped at
+    // the 65535 bytes a uint16_t size can address.
+    uint32_t cap = BFcapacity;
+    while (cap < newCapacity) {
+      cap <<= 1;
+    }
+    if (cap > 65535) {
+      cap = 65535;
+    }
+    uint8_t *p = new uint8_t[cap];
+    memcpy(p, BFptr, BFlen);
+    if (BFptr != BFinline) {
+      delete[] BFptr;
+    }
+    BFptr = p;
+    BFcapacity = cap;
+  }
+}
+
+// resize: set logical size, growing storage if necessary
+void MMbuffer::resize(uint16_t newSize) {
+  if (newSize > BFcapacity) {
+    reserve(newSize);
+  }
+  // Bytes newly exposed shall read as zero - std::vector did guarantee that
+  if (newSize > BFlen) {
+    memset(BFptr + BFlen, 0, newSize - BFlen);
+  }
+  BFlen = newSize;
+}
+
+// push_back: add a single byte at the end
+void MMbuffer::push_back(uint8_t val) {
+  if (BFlen >= BFcapacity) {
+    reserve(BFlen + 1);
+  }
+  BFptr[BFlen++] = val;
+}
+
+// append: add a run of bytes at the end
+void MMbuffer::append(const uint8_t *p, uint16_t count) {
+  if (count) {
+    reserve(BFlen + count);
+    memcpy(BFptr + BFlen, p, count);
+    BFlen += count;
+  }
+}
+
+// adopt: take ownership of a new[]'ed buffer, avoiding a copy
+void MMbuffer::adopt(uint8_t *p, uint16_t len, uint16_t capacity) {
+  // Drop own heap storage, if any
+  if (BFptr != BFinline) {
+    delete[] BFptr;
+  }
+  // Small buffers shall stay inline - else short messages would hold
+  // a large allocation hostage for their whole lifetime
+  if (len <= MODBUSMESSAGE_INLINE_SIZE) {
+    memcpy(BFinline, p, len);
+    delete[] p;
+    BFptr = BFinline;
+    BFcapacity = MODBUSMESSAGE_INLINE_SIZE;
+  } else {
+    BFptr = p;
+    BFcapacity = capacity;
+  }
+  BFlen = len;
+}
+
+// extend: grow by count bytes in one step, return a pointer to the new region.
+// Other than resize(), the new bytes are not zero-filled - the caller is
+// expected to write all of them right away.
+uint8_t *MMbuffer::extend(uint16_t count) {
+  reserve(BFlen + count);
+  uint8_t *p = BFptr + BFlen;
+  BFlen += count;
+  return p;
+}
+
+// shrink_to_fit: move spilled data back inline, if it fits again
+void MMbuffer::shrink_to_fit() {
+  if (BFptr != BFinline && BFlen <= MODBUSMESSAGE_INLINE_SIZE) {
+    memcpy(BFinline, BFptr, BFlen);
+    delete[] BFptr;
+    BFptr = BFinline;
+    BFcapacity = MODBUSMESSAGE_INLINE_SIZE;
+  }
+}
 
 // Default Constructor - takes optional size of MM_data to allocate memory
 ModbusMessage::ModbusMessage(uint16_t dataLen) {
@@ -13,8 +185,9 @@ ModbusMessage::ModbusMessage(uint16_t dataLen) {
 }
 
 // Special message Constructor - takes a std::vector<uint8_t>
-ModbusMessage::ModbusMessage(std::vector<uint8_t> s) :
-MM_data(s) { }
+ModbusMessage::ModbusMessage(std::vector<uint8_t> s) {
+  MM_data.append(s.data(), s.size());
+}
 
 // Destructor
 ModbusMessage::~ModbusMessage() { 
@@ -90,20 +263,37 @@ uint8_t  ModbusMessage::operator[](uint16_t index) const {
   return 0;
 }
 // Resize internal MM_data
-uint16_t ModbusMessage::resize(uint16_t newSize) { 
-  MM_data.resize(newSize); 
-  return MM_data.size(); 
+uint16_t ModbusMessage::resize(uint16_t newSize) {
+  MM_data.resize(newSize);
+  return MM_data.size();
+}
+
+// Reserve storage for a known final message size in one step
+void ModbusMessage::reserve(uint16_t capacity) {
+  MM_data.reserve(capacity);
+}
+
+// Extend the message by count bytes, returning the address of the new region
+uint8_t *ModbusMessage::extend(uint16_t count) {
+  return MM_data.extend(count);
 }
 
 // Add append() for two ModbusMessages or a std::vector<uint8_t> to be appended
-void ModbusMessage::append(ModbusMessage& m) { 
-  MM_data.reserve(size() + m.size()); 
-  MM_data.insert(MM_data.end(), m.begin(), m.end()); 
+void ModbusMessage::append(ModbusMessage& m) {
+  MM_data.append(m.MM_data.data(), m.MM_data.size());
+}
+
+void ModbusMessage::append(std::vector<uint8_t>& m) {
+  MM_data.append(m.data(), m.size());
 }
 
-void ModbusMessage::append(std::vector<uint8_t>& m) { 
-  MM_data.reserve(size() + m.size()); 
-  MM_data.insert(MM_data.end(), m.begin(), m.end()); 
+void ModbusMessage::append(const uint8_t *data, uint16_t count) {
+  MM_data.append(data, count);
+}
+
+// adopt: take over a new[]-allocated buffer as message data without copying
+void ModbusMessage::adopt(uint8_t *buffer, uint16_t len, uint16_t capacity) {
+  MM_data.adopt(buffer, len, capacity);
 }
 
 uint8_t ModbusMessage::getServerID() const {
@@ -165,94 +355,7 @@ uint16_t ModbusMessage::add(const uint8_t *arrayOfBytes, uint16_t count) {
   return MM_data.size();
 }
 
-// determineFloatOrder: calculate the sequence of bytes in a float value
-uint8_t ModbusMessage::determineFloatOrder() {
-  constexpr uint8_t floatSize = sizeof(float);
-  // Only do it if not done yet
-  if (floatOrder[0] == 0xFF) {
-    // We need to calculate it.
-    // This will only work for 32bit floats, so check that
-    if (floatSize != 4) {
-      // OOPS! we cannot proceed.
-      LOG_E("Oops. float seems to be %d bytes wide instead of 4.\n", floatSize);
-      return 0;
-    }
-
-    uint32_t i = 77230;                             // int value to go into a float without rounding error
-    float f = i;                                    // assign it
-    uint8_t *b = (uint8_t *)&f;                     // Pointer to bytes of f
-    uint8_t expect[floatSize] = { 0x47, 0x96, 0xd7, 0x00 }; // IEEE754 representation 
-    uint8_t matches = 0;                            // number of bytes successfully matched
-     
-    // Loop over the bytes of the expected sequence
-    for (uint8_t inx = 0; inx < floatSize; ++inx) {
-      // Loop over the real bytes of f
-      for (uint8_t trg = 0; trg < floatSize; ++trg) {
-        if (expect[inx] == b[trg]) {
-          floatOrder[inx] = trg;
-          matches++;
-          break;
-        }
-      }
-    }
-
-    // All bytes found?
-    if (matches != floatSize) {
-      // No! There is something fishy...
-      LOG_E("Unable to determine float byte order (matched=%d of %d)\n", matches, floatSize);
-      floatOrder[0] = 0xFF;
-      return 0;
-    } else {
-      HEXDUMP_V("floatOrder", floatOrder, floatSize);
-    }
-  }
-  return floatSize;
-}
-
-// determineDoubleOrder: calculate the sequence of bytes in a double value
-uint8_t ModbusMessage::determineDoubleOrder() {
-  constexpr uint8_t doubleSize = sizeof(double);
-  // Only do it if not done yet
-  if (doubleOrder[0] == 0xFF) {
-    // We need to calculate it.
-    // This will only work for 64bit doubles, so check that
-    if (doubleSize != 8) {
-      // OOPS! we cannot proceed.
-      LOG_E("Oops. double seems to be %d bytes wide instead of 8.\n", doubleSize);
-      return 0;
-    }
-
-    uint64_t i = 5791007487489389;                  // int64 value to go into a double without rounding error
-    double f = i;                                   // assign it
-    uint8_t *b = (uint8_t *)&f;                     // Pointer to bytes of f
-    uint8_t expect[doubleSize] = { 0x43, 0x34, 0x92, 0xE4, 0x00, 0x2E, 0xF5, 0x6D }; // IEEE754 representation 
-    uint8_t matches = 0;                            // number of bytes successfully matched
-     
-    // Loop over the bytes of the expected sequence
-    for (uint8_t inx = 0; inx < doubleSize; ++inx) {
-      // Loop over the real bytes of f
-      for (uint8_t trg = 0; trg < doubleSize; ++trg) {
-        if (expect[inx] == b[trg]) {
-          doubleOrder[inx] = trg;
-          matches++;
-          break;
-        }
-      }
-    }
-
-    // All bytes found?
-    if (matches != doubleSize) {
-      // No! There is something fishy...
-      LOG_E("Unable to determine double byte order (matched=%d of %d)\n", matches, doubleSize);
-      doubleOrder[0] = 0xFF;
-      return 0;
-    } else {
-      HEXDUMP_V("doubleOrder", doubleOrder, doubleSize);
-    }
-  }
-  return doubleSize;
-}
-
+#if EMODBUS_FLOAT
 // swapFloat() and swapDouble() will re-order the bytes of a float or double value
 // according a user-given pattern
 float ModbusMessage::swapFloat(float& f, int swapRule) {
@@ -303,6 +406,7 @@ double ModbusMessage::swapDouble(double& f, int swapRule) {
   f = interim;
   return interim;
 }
+#endif  // EMODBUS_FLOAT
 
 // add() variant for a vector of uint8_t
 uint16_t ModbusMessage::add(vector<uint8_t> v) {
@@ -312,6 +416,18 @@ uint16_t ModbusMessage::add(vector<uint8_t> v) {
   return MM_data.size();
 }
 
+// add() variant for a CoilDataView - one pass over the backing bytes,
+// no intermediate CoilData object as with slice()
+uint16_t ModbusMessage::add(const CoilDataView& v) {
+  uint8_t n = v.size();
+  MM_data.reserve(MM_data.size() + n);
+  for (uint8_t i = 0; i < n; ++i) {
+    MM_data.push_back(v.packedByte(i));
+  }
+  return MM_data.size();
+}
+
+#if EMODBUS_FLOAT
 // add() variants for float and double values
 // values will be added in IEEE754 byte sequence (MSB first)
 uint16_t ModbusMessage::add(float v, int swapRule) {
@@ -423,6 +539,7 @@ uint16_t ModbusMessage::get(uint16_t index, double& v, int swapRule) const {
 
   return index;
 }
+#endif  // EMODBUS_FLOAT
 
 // get() - read a byte array of a given size into a vector<uint8_t>. Returns updated index
 uint16_t ModbusMessage::get(uint16_t index, vector<uint8_t>& v, uint8_t count) const {
@@ -435,6 +552,34 @@ uint16_t ModbusMessage::get(uint16_t index, vector<uint8_t>& v, uint8_t count) c
   return index;
 }
 
+// get() - bulk-read a block of registers into a uint16_t array
+uint16_t ModbusMessage::get(uint16_t index, uint16_t *v, uint16_t count) const {
+  // One bounds check for the whole block: how many complete registers are there?
+  uint16_t have = (index < MM_data.size()) ? ((MM_data.size() - index) >> 1) : 0;
+  if (count > have) count = have;
+
+  // Copy and byte-swap the block in one pass
+  const uint8_t *src = MM_data.data() + index;
+  for (uint16_t i = 0; i < count; ++i) {
+    uint16_t w;
+    memcpy(&w, src, 2);
+    v[i] = __builtin_bswap16(w);
+    src += 2;
+  }
+  return index + (count << 1);
+}
+
+// add() variant to bulk-append a block of registers MSB first
+uint16_t ModbusMessage::add(const uint16_t *arrayOfWords, uint16_t count) {
+  // One reserve for the whole block
+  MM_data.reserve(MM_data.size() + (count << 1));
+  for (uint16_t i = 0; i < count; ++i) {
+    MM_data.push_back((arrayOfWords[i] >> 8) & 0xFF);
+    MM_data.push_back(arrayOfWords[i] & 0xFF);
+  }
+  return MM_data.size();
+}
+
 // Data validation methods for the different factory calls
 // 0. serverID and function code - used by all of the below
 Error ModbusMessage::checkServerFC(uint8_t serverID, uint8_t functionCode) {
@@ -640,9 +785,7 @@ Error ModbusMessage::setMessage(uint8_t serverID, uint8_t functionCode, uint16_t
     MM_data.clear();
     add(serverID, functionCode, p1, p2);
     add(count);
-    for (uint8_t i = 0; i < (count >> 1); ++i) {
-      add(arrayOfWords[i]);
-    }
+    add(arrayOfWords, count >> 1);
   }
   return returnCode;
 }
@@ -687,12 +830,18 @@ Error ModbusMessage::setMessage(uint8_t serverID, uint8_t functionCode, uint16_t
 }
 
 // 8. Error response generator
+// An error PDU is three bytes and always fits the inline buffer, so it is built
+// with three direct stores - the error path never allocates, even under a flood
+// of misaddressed requests.
 Error ModbusMessage::setError(uint8_t serverID, uint8_t functionCode, Error errorCode) {
-  // No error checking for server ID or function code here, as both may be the cause for the message!? 
-  MM_data.reserve(3);
-  MM_data.shrink_to_fit();
+  // No error checking for server ID or function code here, as both may be the cause for the message!?
   MM_data.clear();
-  add(serverID, static_cast<uint8_t>((functionCode | 0x80) & 0xFF), static_cast<uint8_t>(errorCode));
+  // Drop heap storage a large earlier payload may have claimed
+  MM_data.shrink_to_fit();
+  uint8_t *p = MM_data.extend(3);
+  p[0] = serverID;
+  p[1] = (functionCode | 0x80) & 0xFF;
+  p[2] = static_cast<uint8_t>(errorCode);
   return SUCCESS;
 }
 
@@ -701,5 +850,7 @@ void ModbusMessage::printError(const char *file, int lineNo, Error e, uint8_t se
   LOG_E("(%s, line %d) Error in constructor: %02X - %s (%02X/%02X)\n", file_name(file), lineNo, e, (const char *)(ModbusError(e)), serverID, functionCode);
 }
 
-uint8_t ModbusMessage::floatOrder[] = { 0xFF };
-uint8_t ModbusMessage::doubleOrder[] = { 0xFF };
+#if EMODBUS_FLOAT
+constexpr uint8_t ModbusMessage::floatOrder[];
+constexpr uint8_t ModbusMessage::doubleOrder[];
+#endif
@@ -4,6 +4,7 @@
 // =================================================================================================
 #ifndef _MODBUS_MESSAGE_H
 #define _MODBUS_MESSAGE_H
+#include "options.h"
 #include "ModbusTypeDefs.h"
 #include "ModbusError.h"
 #include <type_traits>
@@ -14,6 +15,65 @@ using Modbus::FCType;
 using Modbus::FCT;
 using std::vector;
 
+class CoilDataView;  // forward declaration - see CoilData.h
+
+// Number of bytes kept in-object by MMbuffer. Typical Modbus PDUs (FC 0x03/0x06 etc.)
+// are well below this, so they will never touch the heap. May be overridden at compile time.
+#ifndef MODBUSMESSAGE_INLINE_SIZE
+#define MODBUSMESSAGE_INLINE_SIZE 32
+#endif
+
+// MMbuffer: small-buffer storage for message data.
+// Messages up to MODBUSMESSAGE_INLINE_SIZE bytes live in an in-object array,
+// avoiding heap allocation and fragmentation on the hot path. Only larger
+// messages (FC 0x0F/0x10 frames and the like) will spill to heap storage.
+class MMbuffer {
+public:
+  // Constructor: start with the inline storage
+  MMbuffer();
+
+  // Destructor: release heap storage, if any was claimed
+  ~MMbuffer();
+
+  // Copy constructor and assignment
+  MMbuffer(const MMbuffer& b);
+  MMbuffer& operator=(const MMbuffer& b);
+
+#ifndef NO_MOVE
+  // Move constructor and assignment - will steal heap storage where possible
+  MMbuffer(MMbuffer&& b);
+  MMbuffer& operator=(MMbuffer&& b);
+#endif
+
+  // Subset of the std::vector interface ModbusMessage relies upon
+  inline uint8_t       *data()       { return BFptr; }
+  inline const uint8_t *data() const { return BFptr; }
+  inline uint16_t       size() const { return BFlen; }
+  inline bool          empty() const { return BFlen == 0; }
+  inline uint8_t&  operator[](uint16_t index)       { return BFptr[index]; }
+  inline uint8_t   operator[](uint16_t index) const { return BFptr[index]; }
+  inline void          clear()       { BFlen = 0; }
+
+  void reserve(uint16_t newCapacity);   // provide storage for at least newCapacity bytes
+  void resize(uint16_t newSize);        // set logical size, growing storage if necessary
+  void push_back(uint8_t val);          // add a single byte at the end
+  void append(const uint8_t *p, uint16_t count); // add a run of bytes at the end
+  uint8_t *extend(uint16_t count);      // grow by count bytes, return pointer to the new region
+  void shrink_to_fit();                 // move spilled data back inline, if it fits again
+  void adopt(uint8_t *p, uint16_t len, uint16_t capacity); // take ownership of a new[]'ed buffer
+
+  // provide (const) iterator interface
+  typedef const uint8_t *const_iterator;
+  inline const_iterator begin() const { return BFptr; }
+  inline const_iterator end() const   { return BFptr + BFlen; }
+
+protected:
+  uint16_t BFlen;                       // Used length in bytes
+  uint16_t BFcapacity;                  // Currently allocated bytes
+  uint8_t *BFptr;                       // Points to BFinline or heap storage
+  uint8_t  BFinline[MODBUSMESSAGE_INLINE_SIZE]; // In-object storage for small messages
+};
+
 class ModbusMessage {
 public:
   // Default empty message Constructor - optionally takes expected size of MM_data
@@ -62,14 +122,28 @@ public:
   void clear();             // delete message contents
   uint16_t resize(uint16_t newSize);  // resize MM_data
 
+  // reserve: provide storage for a known final message size in one step
+  void reserve(uint16_t capacity);
+
+  // extend: grow the message by count bytes at the end and return the address
+  // of the first new byte - for transports reading an announced frame length
+  // straight into the message. The new bytes are NOT zero-filled; the caller
+  // is expected to write (or resize() away) all of them right away.
+  uint8_t *extend(uint16_t count);
+
   // provide iterator interface on MM_data
-  typedef std::vector<uint8_t>::const_iterator const_iterator;
+  typedef MMbuffer::const_iterator const_iterator;
   const_iterator begin() const { return MM_data.begin(); }
   const_iterator end() const   { return MM_data.end(); }
 
   // Add append() for two ModbusMessages or a std::vector<uint8_t> to be appended
   void append(ModbusMessage& m);
   void append(std::vector<uint8_t>& m);
+  void append(const uint8_t *data, uint16_t count);
+
+  // adopt: take over a new[]-allocated buffer as message data without copying.
+  // The message claims ownership and will delete[] the buffer eventually.
+  void adopt(uint8_t *buffer, uint16_t len, uint16_t capacity);
 
   // Modbus data extraction
   uint8_t getServerID() const;      // returns Server ID or 0 if MM_data is shorter than 3
@@ -83,23 +157,31 @@ public:
   // add() variant to copy a buffer into MM_data. Returns updated size
   uint16_t add(const uint8_t *arrayOfBytes, uint16_t count);
 
+  // add() variant to bulk-append a block of registers MSB first (e.g. the data
+  // section of an FC 0x10 request) with a single reserve. Returns updated size
+  uint16_t add(const uint16_t *arrayOfWords, uint16_t count);
+
   // add() - add a single data element MSB first to MM_data. Returns updated size
   template <class T> uint16_t add(T v) {
     uint16_t sz = sizeof(T);    // Size of value to be added
 
-    // Copy it MSB first
+    // Claim the bytes in one go and write MSB first through the raw pointer
+    uint8_t *p = MM_data.extend(sz);
     while (sz) {
       sz--;
-      MM_data.push_back((v >> (sz << 3)) & 0xFF);
+      *p++ = (v >> (sz << 3)) & 0xFF;
     }
     // Return updated size (logical length of message so far)
     return MM_data.size();
   }
 
   // Template function to extend add(A) to add(A, B, C, ...)
-  template <class T, class... Args> 
+  template <class T, class... Args>
   typename std::enable_if<!std::is_pointer<T>::value, uint16_t>::type
   add(T v, Args... args) {
+      // Reserve storage for the complete pack at once - the accumulated size
+      // is known at compile time, so repeated growth steps are avoided
+      MM_data.reserve(MM_data.size() + packSize<T, Args...>());
       add(v);
       return add(args...);
   }
@@ -107,6 +189,12 @@ public:
 // get() - read a byte array of a given size into a vector<uint8_t>. Returns updated index
 uint16_t get(uint16_t index, vector<uint8_t>& v, uint8_t count) const;
 
+// get() - bulk-read a block of registers into a uint16_t array with a single
+// bounds check and a byte-swapping copy, instead of chained getOne() calls.
+// Reads as many complete registers as the message holds, at most count.
+// Returns the updated index.
+uint16_t get(uint16_t index, uint16_t *v, uint16_t count) const;
+
 // get() - recursion stopper for template function below
 inline uint16_t get(uint16_t index) const { return index; }
 
@@ -121,6 +209,11 @@ get(uint16_t index, T& v, Args&... args) const {
 // add() variant for vectors of uint8_t
 uint16_t add(vector<uint8_t> v);
 
+// add() variant for a CoilDataView - append the viewed coils in packed wire
+// format (FC 0x01/0x02 response layout) without an intermediate copy
+uint16_t add(const CoilDataView& v);
+
+#if EMODBUS_FLOAT
 // add() variants for float and double values
 uint16_t add(float v, int swapRules = 0);
 uint16_t add(double v, int swapRules = 0);
@@ -128,6 +221,7 @@ uint16_t add(double v, int swapRules = 0);
 // get() variants for float and double values
 uint16_t get(uint16_t index, float& v, int swapRules = 0) const;
 uint16_t get(uint16_t index, double& v, int swapRules = 0) const;
+#endif
 
   // Message generation methods
   // 1. no additional parameter (FCs 0x07, 0x0b, 0x0c, 0x11)
@@ -183,16 +277,35 @@ protected:
   // Error output in case a message constructor will fail
   static void printError(const char *file, int lineNo, Error e, uint8_t serverID, uint8_t functionCode);
 
-  std::vector<uint8_t> MM_data;  // Message data buffer
-
-  static uint8_t floatOrder[sizeof(float)]; // order of bytes in a float variable
-  static uint8_t doubleOrder[sizeof(double)]; // order of bytes in a double variable
+  MMbuffer MM_data;  // Message data buffer (small-buffer optimized)
+
+#if EMODBUS_FLOAT
+  // Byte positions of a float/double value in memory, MSB first.
+  // The byte order of every supported target is fixed, so the mapping is a
+  // compile-time constant - add(float)/get(float) boil down to plain byte
+  // moves without any runtime order probing.
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  static constexpr uint8_t floatOrder[sizeof(float)] = { 0, 1, 2, 3 };
+  static constexpr uint8_t doubleOrder[sizeof(double)] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+#else
+  static constexpr uint8_t floatOrder[sizeof(float)] = { 3, 2, 1, 0 };
+  static constexpr uint8_t doubleOrder[sizeof(double)] = { 7, 6, 5, 4, 3, 2, 1, 0 };
+#endif
 
-  static uint8_t determineFloatOrder();
-  static uint8_t determineDoubleOrder();
+  // determineFloatOrder/determineDoubleOrder: formerly probed the byte order
+  // at runtime - reduced to compile-time width checks for the call sites
+  static constexpr uint8_t determineFloatOrder() { return sizeof(float) == 4 ? sizeof(float) : 0; }
+  static constexpr uint8_t determineDoubleOrder() { return sizeof(double) == 8 ? sizeof(double) : 0; }
 
   static float swapFloat(float& f, int swapRule);
   static double swapDouble(double& f, int swapRule);
+#endif  // EMODBUS_FLOAT
+
+  // packSize() - compile-time accumulated byte size of an add(A, B, C, ...) pack
+  template <typename T>
+  static constexpr uint16_t packSize() { return sizeof(T); }
+  template <typename T, typename U, typename... Args>
+  static constexpr uint16_t packSize() { return sizeof(T) + packSize<U, Args...>(); }
 
   // getOne() - read a MSB-first value starting at byte index. Returns updated index
   template <typename T> uint16_t getOne(uint16_t index, T& retval) const {
@@ -0,0 +1,222 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#include <algorithm>
+#include "ModbusPoller.h"
+
+#if HAS_FREERTOS || IS_LINUX
+
+#undef LOCAL_LOG_LEVEL
+// #define LOCAL_LOG_LEVEL LOG_LEVEL_VERBOSE
+#include "Logging.h"
+
+uint16_t ModbusPoller::instanceCounter = 0;
+
+// Constructor: takes the client the poll requests shall be enqueued on
+ModbusPoller::ModbusPoller(ModbusClient& client) :
+  MP_client(client),
+  MP_nextPollID(0),
+  MP_deadlineMisses(0),
+  MP_running(false),
+#if HAS_FREERTOS
+  MP_task(NULL)
+#else
+  MP_task(0)
+#endif
+  { instanceCounter++; }
+
+// Destructor: stop the dispatcher task
+ModbusPoller::~ModbusPoller() {
+  end();
+}
+
+// begin: start dispatcher task
+void ModbusPoller::begin(int coreID) {
+#if IS_LINUX
+  // Already running?
+  if (MP_running) return;
+  MP_running = true;
+  int rc = pthread_create(&MP_task, NULL, &pHandle, this);
+  if (rc) {
+    LOG_E("Error creating poller thread: %d\n", rc);
+    MP_running = false;
+  } else {
+    LOG_D("Poller dispatcher started.\n");
+  }
+#else
+  begin(TaskConfig(5, 4096, coreID));
+#endif
+}
+
+#if HAS_FREERTOS
+// begin: start dispatcher task with full task tuning
+void ModbusPoller::begin(TaskConfig tc) {
+  // Already running?
+  if (MP_running) return;
+  MP_running = true;
+  // Create unique task name
+  char taskName[18];
+  snprintf(taskName, 18, "Modbus%02XPoll", instanceCounter);
+  // Start task to dispatch the due requests
+  xTaskCreatePinnedToCore((TaskFunction_t)&handleDispatch, taskName, tc.stackSize, this, tc.priority, &MP_task, tc.coreID >= 0 ? tc.coreID : NULL);
+  LOG_D("Poller dispatcher %s started\n", taskName);
+}
+
+// stackHighWaterMark: unused dispatcher stack in bytes, 0 if not running
+uint32_t ModbusPoller::stackHighWaterMark() {
+  return MP_task ? uxTaskGetStackHighWaterMark(MP_task) : 0;
+}
+#endif
+
+// end: stop the dispatcher task
+void ModbusPoller::end() {
+  if (!MP_running) return;
+  MP_running = false;
+#if HAS_FREERTOS
+  // Give the dispatcher task room to run off its loop and delete itself
+  delay(50);
+  MP_task = NULL;
+#elif IS_LINUX
+  pthread_join(MP_task, NULL);
+#endif
+  LOG_D("Poller dispatcher stopped.\n");
+}
+
+// addPollRequest: register a request template to be enqueued every period ms
+uint32_t ModbusPoller::addPollRequest(uint32_t token, ModbusMessage request, uint32_t period, uint8_t priority) {
+  // We need a valid request and a nonzero period
+  if (!request || period == 0) return 0;
+
+  LOCK_GUARD(lg, MP_lock);
+  PollEntry entry;
+  entry.pollID = ++MP_nextPollID;
+  entry.token = token;
+  entry.msg = request;
+  entry.period = period;
+  entry.priority = priority;
+  entry.nextDue = (uint32_t)millis();
+  entry.fired = 0;
+  entry.missed = 0;
+  MP_entries.push_back(entry);
+
+  // Jitter smoothing: re-spread the first deadlines of all requests sharing this
+  // period evenly across it, so they do not fall due in one burst
+  uint16_t siblings = 0;
+  for (auto& e : MP_entries) {
+    if (e.period == period) siblings++;
+  }
+  uint32_t now = (uint32_t)millis();
+  uint16_t slot = 0;
+  for (auto& e : MP_entries) {
+    if (e.period == period) {
+      e.nextDue = now + (uint32_t)(((uint64_t)period * slot) / siblings);
+      slot++;
+    }
+  }
+
+  LOG_D("Poll request %d registered: period %dms, priority %d\n", entry.pollID, period, priority);
+  return entry.pollID;
+}
+
+// removePollRequest: unregister a poll request
+bool ModbusPoller::removePollRequest(uint32_t pollID) {
+  LOCK_GUARD(lg, MP_lock);
+  for (auto it = MP_entries.begin(); it != MP_entries.end(); ++it) {
+    if (it->pollID == pollID) {
+      MP_entries.erase(it);
+      LOG_D("Poll request %d removed\n", pollID);
+      return true;
+    }
+  }
+  return false;
+}
+
+// getDeadlineMisses: total number of poll periods that could not be served on time
+uint32_t ModbusPoller::getDeadlineMisses() {
+  return MP_deadlineMisses;
+}
+
+// getPollCounts: fired/missed tallies of a single poll request
+bool ModbusPoller::getPollCounts(uint32_t pollID, uint32_t& fired, uint32_t& missed) {
+  LOCK_GUARD(lg, MP_lock);
+  for (auto& e : MP_entries) {
+    if (e.pollID == pollID) {
+      fired = e.fired;
+      missed = e.missed;
+      return true;
+    }
+  }
+  return false;
+}
+
+// pollCount: number of registered poll requests
+uint16_t ModbusPoller::pollCount() {
+  LOCK_GUARD(lg, MP_lock);
+  return MP_entries.size();
+}
+
+// handleDispatch: dispatcher task
+// This was created in begin() to enqueue the registered requests on schedule
+void ModbusPoller::handleDispatch(ModbusPoller *instance) {
+  // Loop until end() is called
+  while (instance->MP_running) {
+    {
+      LOCK_GUARD(lg, instance->MP_lock);
+      uint32_t now = (uint32_t)millis();
+
+      // Collect all entries due by now
+      std::vector<PollEntry *> due;
+      for (auto& e : instance->MP_entries) {
+        if ((int32_t)(now - e.nextDue) >= 0) due.push_back(&e);
+      }
+
+      // Anything to fire?
+      if (!due.empty()) {
+        // Yes. Most urgent first: higher priority, then earlier deadline
+        std::sort(due.begin(), due.end(), [](PollEntry *a, PollEntry *b) {
+          if (a->priority != b->priority) return a->priority > b->priority;
+          return (int32_t)(a->nextDue - b->nextDue) < 0;
+        });
+
+        for (auto *e : due) {
+          // Were whole periods lost already (dispatcher starved)?
+          uint32_t late = now - e->nextDue;
+          if (late >= e->period) {
+            // Yes. Count each lost period as a miss and re-phase - a catch-up
+            // burst would only pile onto whatever caused the stall
+            uint32_t lost = late / e->period;
+            e->missed += lost;
+            instance->MP_deadlineMisses += lost;
+            e->nextDue += lost * e->period;
+            LOG_D("Poll request %d missed %d period(s)\n", e->pollID, lost);
+          }
+          // Enqueue the request on the client
+          if (instance->MP_client.addRequestM(e->msg, e->token) == SUCCESS) {
+            e->fired++;
+          } else {
+            // Queue full - this period is lost, try again next one
+            e->missed++;
+            instance->MP_deadlineMisses++;
+            LOG_D("Poll request %d not enqueued - queue full\n", e->pollID);
+          }
+          // Advance from the scheduled time, not from now, to avoid drift
+          e->nextDue += e->period;
+        }
+      }
+    }
+    delay(1);
+  }
+#if HAS_FREERTOS
+  vTaskDelete(NULL);
+#endif
+}
+
+#if IS_LINUX
+void *ModbusPoller::pHandle(void *p) {
+  handleDispatch((ModbusPoller *)p);
+  return nullptr;
+}
+#endif
+
+#endif  // HAS_FREERTOS || IS_LINUX
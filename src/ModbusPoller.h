@@ -0,0 +1,105 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _MODBUS_POLLER_H
+#define _MODBUS_POLLER_H
+
+#include "options.h"
+
+#if HAS_FREERTOS || IS_LINUX
+
+#include "ModbusClient.h"
+#include "TaskConfig.h"
+#include <vector>
+
+// ModbusPoller: deadline-based periodic poll scheduler on top of a ModbusClient.
+// Register a request template with a period (and an optional priority) once, and
+// the poller's dispatcher task enqueues it on schedule - replacing the hand-written
+// millis() bookkeeping loops applications keep reinventing for cyclic polling.
+// Deadlines advance from the scheduled time, not from "now", so periods do not
+// drift, and the first deadlines of same-period requests are spread evenly across
+// the period so a cycle start does not hit the request queue in one burst.
+// A request that could not be fired for one or more full periods - the client
+// queue was full, or the dispatcher was starved - is counted as a deadline miss
+// per period lost and re-phased instead of firing a catch-up burst.
+class ModbusPoller {
+public:
+  // Constructor: takes the client the poll requests shall be enqueued on
+  explicit ModbusPoller(ModbusClient& client);
+
+  // Destructor: stop the dispatcher task
+  ~ModbusPoller();
+
+  // begin: start dispatcher task
+  void begin(int coreID = -1);
+
+#if HAS_FREERTOS
+  // begin with full task tuning - priority, stack size and core pin.
+  // Default is TaskConfig(5, 4096).
+  void begin(TaskConfig tc);
+
+  // stackHighWaterMark: unused stack of the dispatcher task in bytes, as
+  // reported by FreeRTOS - 0 if the dispatcher is not running
+  uint32_t stackHighWaterMark();
+#endif
+
+  // end: stop the dispatcher task
+  void end();
+
+  // addPollRequest: register a request template to be enqueued every period ms.
+  // When several requests fall due in the same dispatcher pass, higher priority
+  // ones are enqueued first. Returns a poll ID for removePollRequest(), 0 on error.
+  uint32_t addPollRequest(uint32_t token, ModbusMessage request, uint32_t period, uint8_t priority = 0);
+
+  // removePollRequest: unregister a poll request. Returns true if it was found.
+  bool removePollRequest(uint32_t pollID);
+
+  // getDeadlineMisses: total number of poll periods that could not be served on time
+  uint32_t getDeadlineMisses();
+
+  // getPollCounts: fired/missed tallies of a single poll request. Returns false
+  // if the poll ID is unknown.
+  bool getPollCounts(uint32_t pollID, uint32_t& fired, uint32_t& missed);
+
+  // pollCount: number of registered poll requests
+  uint16_t pollCount();
+
+protected:
+  // One registered periodic request
+  struct PollEntry {
+    uint32_t pollID;       // Handle returned by addPollRequest()
+    uint32_t token;        // User token handed to the client on every fire
+    ModbusMessage msg;     // Request template
+    uint32_t period;       // Poll period in ms
+    uint8_t priority;      // Dispatch order among requests due in the same pass
+    uint32_t nextDue;      // millis() deadline of the next fire
+    uint32_t fired;        // Number of requests enqueued on time
+    uint32_t missed;       // Number of periods lost (queue full or dispatcher starved)
+  };
+
+  // handleDispatch: dispatcher task method
+  static void handleDispatch(ModbusPoller *instance);
+#if IS_LINUX
+  static void *pHandle(void *p);
+#endif
+
+  ModbusClient& MP_client;           // Client the due requests are enqueued on
+  std::vector<PollEntry> MP_entries; // Registered poll requests
+  uint32_t MP_nextPollID;            // Poll ID source
+  std::atomic<uint32_t> MP_deadlineMisses; // Total periods lost, readable at any time
+  bool MP_running;                   // Dispatcher loop flag
+#if HAS_FREERTOS
+  TaskHandle_t MP_task;              // Dispatcher task
+#elif IS_LINUX
+  pthread_t MP_task;
+#endif
+#if USE_MUTEX
+  std::mutex MP_lock;                // Protects MP_entries against concurrent add/remove
+#endif
+  static uint16_t instanceCounter;   // Number of ModbusPollers created
+};
+
+#endif  // HAS_FREERTOS || IS_LINUX
+
+#endif  // INCLUDE GUARD
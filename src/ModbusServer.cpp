@@ -2,47 +2,91 @@
 // eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
 //               MIT license - see license.md for details
 // =================================================================================================
+#include "options.h"
+#if !IS_LINUX
 #include <Arduino.h>
+#endif
 #include "ModbusServer.h"
 
 #undef LOCAL_LOG_LEVEL
 // #define LOCAL_LOG_LEVEL LOG_LEVEL_VERBOSE
 #include "Logging.h"
 
+// readerEnter: announce a read of the dispatch tables. The epoch slot must be
+// registered BEFORE the table pointer is loaded - a writer flips the epoch only
+// after swapping the pointer, so a reader counted late can only see the new table
+uint8_t ModbusServer::readerEnter() {
+  uint8_t slot = updateEpoch.load() & 1;
+  readersInFlight[slot]++;
+  return slot;
+}
+
+// readerExit: revoke the announcement again
+void ModbusServer::readerExit(uint8_t slot) {
+  readersInFlight[slot]--;
+}
+
+// retireTable: delete a replaced dispatch table after the readers have left it -
+// caller holds workerLock!
+void ModbusServer::retireTable(WorkerTable *old) {
+  // Nothing was replaced?
+  if (!old) return;
+  // Flip the epoch - readers arriving from now on count on the other slot and
+  // cannot hold the old pointer, since it was swapped out before we got here
+  uint8_t slot = updateEpoch.fetch_add(1) & 1;
+  // Wait out the readers still counted on the old slot
+  while (readersInFlight[slot].load()) {
+    delay(1);
+  }
+  delete old;
+}
+
 // registerWorker: register a worker function for a certain serverID/FC combination
 // If there is one already, it will be overwritten!
 void ModbusServer::registerWorker(uint8_t serverID, uint8_t functionCode, MBSworker worker) {
-  workerMap[serverID][functionCode] = worker;
+  // Function codes 0x80 and up are exception responses and cannot carry a worker
+  if (functionCode & 0x80) {
+    LOG_E("Invalid function code %02X - worker not registered\n", functionCode);
+    return;
+  }
+  LOCK_GUARD(workerGuard, workerLock);
+  // Build the updated table aside - a copy of the current one, or a fresh one
+  // if this is the first worker for the serverID
+  WorkerTable *old = workerTable[serverID];
+  WorkerTable *wt = old ? new WorkerTable(*old) : new WorkerTable();
+  // Count the slot, unless we are overwriting an occupied one
+  if (!wt->worker[functionCode]) wt->numWorkers++;
+  wt->worker[functionCode] = worker;
+  // Swap it in and retire the replaced table
+  workerTable[serverID] = wt;
+  retireTable(old);
   LOG_D("Registered worker for %02X/%02X\n", serverID, functionCode);
 }
 
 // getWorker: if a worker function is registered, return its address, nullptr otherwise
 MBSworker ModbusServer::getWorker(uint8_t serverID, uint8_t functionCode) {
-  // Search the FC map associated with the serverID
-  auto svmap = workerMap.find(serverID);
-  // Is there one?
-  if (svmap != workerMap.end()) {
-    // Yes. Now look for the function code in the inner map
-    auto fcmap = svmap->second.find(functionCode);;
-    // Found it?
-    if (fcmap != svmap->second.end()) {
-      // Yes. Return the function pointer for it.
+  MBSworker found = nullptr;
+  uint8_t slot = readerEnter();
+  // Get the dispatch table for the serverID
+  WorkerTable *wt = workerTable[serverID];
+  // Is the ID served at all (and the FC in registrable range)?
+  if (wt && !(functionCode & 0x80)) {
+    // Yes. Worker registered for the explicit function code?
+    if (wt->worker[functionCode]) {
       LOG_D("Worker found for %02X/%02X\n", serverID, functionCode);
-      return fcmap->second;
-      // No, no explicit worker found, but may be there is one for ANY_FUNCTION_CODE?
-    } else {
-      fcmap = svmap->second.find(ANY_FUNCTION_CODE);;
-      // Found it?
-      if (fcmap != svmap->second.end()) {
-        // Yes. Return the function pointer for it.
-        LOG_D("Worker found for %02X/ANY\n", serverID);
-        return fcmap->second;
-      }
+      found = wt->worker[functionCode];
+    } else if (wt->worker[ANY_FUNCTION_CODE]) {
+      // No, but there is one for ANY_FUNCTION_CODE
+      LOG_D("Worker found for %02X/ANY\n", serverID);
+      found = wt->worker[ANY_FUNCTION_CODE];
     }
   }
-  // No matching function pointer found
-  LOG_D("No matching worker found\n");
-  return nullptr;
+  readerExit(slot);
+  if (!found) {
+    // No matching function pointer found
+    LOG_D("No matching worker found\n");
+  }
+  return found;
 }
 
 // unregisterWorker; remove again all or part of the registered workers for a given server ID
@@ -50,34 +94,194 @@ MBSworker ModbusServer::getWorker(uint8_t serverID, uint8_t functionCode) {
 bool ModbusServer::unregisterWorker(uint8_t serverID, uint8_t functionCode) {
   uint16_t numEntries = 0;    // Number of entries removed
 
+  LOCK_GUARD(workerGuard, workerLock);
   // Is there at least one entry for the serverID?
-  auto svmap = workerMap.find(serverID);
+  WorkerTable *old = workerTable[serverID];
   // Is there one?
-  if (svmap != workerMap.end()) {
+  if (old) {
     // Yes. we may proceed with it
     // Are we to look for a single serverID/FC combination?
     if (functionCode) {
-      // Yes. 
-      numEntries = svmap->second.erase(functionCode);
+      // Yes.
+      if (!(functionCode & 0x80) && old->worker[functionCode]) {
+        // Was that the last worker? Then the ID is not served any more
+        if (old->numWorkers == 1) {
+          workerTable[serverID] = nullptr;
+        } else {
+          // No - swap in a copy lacking the one worker
+          WorkerTable *wt = new WorkerTable(*old);
+          wt->worker[functionCode] = nullptr;
+          wt->numWorkers--;
+          workerTable[serverID] = wt;
+        }
+        numEntries = 1;
+        retireTable(old);
+      }
     } else {
       // No, the serverID shall be removed with all references
-      numEntries = workerMap.erase(serverID);
+      workerTable[serverID] = nullptr;
+      numEntries = 1;
+      retireTable(old);
     }
-  } 
+  }
   LOG_D("Removed %d worker entries for %d/%d\n", numEntries, serverID, functionCode);
   return (numEntries ? true : false);
 }
 
 // isServerFor: if any worker function is registered for the given serverID, return true
 bool ModbusServer::isServerFor(uint8_t serverID) {
-  // Search the FC map for the serverID
-  auto svmap = workerMap.find(serverID);
-  // Is it there? Then return true
-  if (svmap != workerMap.end()) return true;
-  // No, serverID was not found. Return false
+  // A serverID is served if it has a dispatch table or a register bank attached
+  return workerTable[serverID] != nullptr
+    || bankTable[serverID][HOLDING_REGISTER_BANK] != nullptr
+    || bankTable[serverID][INPUT_REGISTER_BANK] != nullptr;
+}
+
+// attachRegisterBank: serve register function codes directly from server-owned storage
+bool ModbusServer::attachRegisterBank(uint8_t serverID, RegisterBankType type, uint16_t firstAddress, uint16_t numRegisters) {
+  // Sanity checks: non-empty block, fitting the 16 bit address space
+  if (numRegisters == 0 || (uint32_t)firstAddress + numRegisters > 0x10000) return false;
+  LOCK_GUARD(bankGuard, bankLock);
+  // The new block must not overlap an existing bank of the same type
+  for (RegisterBank *bank = bankTable[serverID][type]; bank; bank = bank->next) {
+    if (firstAddress < bank->first + bank->numRegs && bank->first < firstAddress + numRegisters) return false;
+  }
+  RegisterBank *bank = new RegisterBank();
+  bank->values = new uint16_t[numRegisters]();
+  bank->first = firstAddress;
+  bank->numRegs = numRegisters;
+  bank->next = bankTable[serverID][type];
+  bankTable[serverID][type] = bank;
+  LOG_D("Attached %s bank %02X/%04X, %d registers\n", type == INPUT_REGISTER_BANK ? "input" : "holding", serverID, firstAddress, numRegisters);
+  return true;
+}
+
+// detachRegisterBank: remove the bank starting at firstAddress again
+bool ModbusServer::detachRegisterBank(uint8_t serverID, RegisterBankType type, uint16_t firstAddress) {
+  LOCK_GUARD(bankGuard, bankLock);
+  for (RegisterBank **link = &bankTable[serverID][type]; *link; link = &(*link)->next) {
+    if ((*link)->first == firstAddress) {
+      RegisterBank *bank = *link;
+      *link = bank->next;
+      delete[] bank->values;
+      delete bank;
+      LOG_D("Detached bank %02X/%04X\n", serverID, firstAddress);
+      return true;
+    }
+  }
   return false;
 }
 
+// findBank: locate the bank covering [address, address+words) - caller holds bankLock!
+ModbusServer::RegisterBank *ModbusServer::findBank(uint8_t serverID, RegisterBankType type, uint16_t address, uint16_t words) {
+  for (RegisterBank *bank = bankTable[serverID][type]; bank; bank = bank->next) {
+    if (address >= bank->first && (uint32_t)address + words <= (uint32_t)bank->first + bank->numRegs) return bank;
+  }
+  return nullptr;
+}
+
+// setBankRegister: application write access to an attached bank register
+bool ModbusServer::setBankRegister(uint8_t serverID, RegisterBankType type, uint16_t address, uint16_t value) {
+  LOCK_GUARD(bankGuard, bankLock);
+  RegisterBank *bank = findBank(serverID, type, address, 1);
+  if (!bank) return false;
+  bank->values[address - bank->first] = value;
+  return true;
+}
+
+// getBankRegister: application read access to an attached bank register
+uint16_t ModbusServer::getBankRegister(uint8_t serverID, RegisterBankType type, uint16_t address) {
+  LOCK_GUARD(bankGuard, bankLock);
+  RegisterBank *bank = findBank(serverID, type, address, 1);
+  return bank ? bank->values[address - bank->first] : 0;
+}
+
+// bankRequest: attempt to serve a request from an attached register bank
+bool ModbusServer::bankRequest(ModbusMessage& request, ModbusMessage& response) {
+  uint8_t serverID = request.getServerID();
+  uint8_t functionCode = request.getFunctionCode();
+  // Only the four register function codes can be served from a bank
+  if (functionCode != READ_HOLD_REGISTER
+    && functionCode != READ_INPUT_REGISTER
+    && functionCode != WRITE_HOLD_REGISTER
+    && functionCode != WRITE_MULT_REGISTERS) return false;
+  // Input registers live in their own bank list, everything else is holding
+  RegisterBankType type = (functionCode == READ_INPUT_REGISTER) ? INPUT_REGISTER_BANK : HOLDING_REGISTER_BANK;
+  LOCK_GUARD(bankGuard, bankLock);
+  // No bank of the right type attached? Then regular worker dispatch shall apply
+  if (!bankTable[serverID][type]) return false;
+
+  if (functionCode == READ_HOLD_REGISTER || functionCode == READ_INPUT_REGISTER) {
+    uint16_t address = 0;
+    uint16_t words = 0;
+    request.get(2, address);
+    request.get(4, words);
+    if (words == 0 || words > 125) {
+      response.setError(serverID, functionCode, ILLEGAL_DATA_VALUE);
+      return true;
+    }
+    RegisterBank *bank = findBank(serverID, type, address, words);
+    if (!bank) {
+      response.setError(serverID, functionCode, ILLEGAL_DATA_ADDRESS);
+      return true;
+    }
+    // Assemble byte count and MSB-first register values in one buffer,
+    // then append it to the response in a single go
+    uint8_t buffer[251];
+    uint8_t *cp = buffer;
+    *cp++ = words * 2;
+    const uint16_t *vp = bank->values + (address - bank->first);
+    for (uint16_t i = 0; i < words; ++i) {
+      *cp++ = (*vp >> 8) & 0xFF;
+      *cp++ = *vp & 0xFF;
+      vp++;
+    }
+    response.add(serverID, functionCode);
+    response.add(buffer, words * 2 + 1);
+    return true;
+  }
+
+  if (functionCode == WRITE_HOLD_REGISTER) {
+    uint16_t address = 0;
+    uint16_t value = 0;
+    request.get(2, address);
+    request.get(4, value);
+    RegisterBank *bank = findBank(serverID, type, address, 1);
+    if (!bank) {
+      response.setError(serverID, functionCode, ILLEGAL_DATA_ADDRESS);
+      return true;
+    }
+    bank->values[address - bank->first] = value;
+    // The standard echoes the request as write confirmation
+    response = request;
+    return true;
+  }
+
+  // WRITE_MULT_REGISTERS remains
+  uint16_t address = 0;
+  uint16_t words = 0;
+  uint8_t bytes = 0;
+  request.get(2, address);
+  request.get(4, words);
+  request.get(6, bytes);
+  if (words == 0 || words > 123 || bytes != words * 2 || request.size() != 7u + bytes) {
+    response.setError(serverID, functionCode, ILLEGAL_DATA_VALUE);
+    return true;
+  }
+  RegisterBank *bank = findBank(serverID, type, address, words);
+  if (!bank) {
+    response.setError(serverID, functionCode, ILLEGAL_DATA_ADDRESS);
+    return true;
+  }
+  uint16_t *vp = bank->values + (address - bank->first);
+  const uint8_t *sp = request.data() + 7;
+  for (uint16_t i = 0; i < words; ++i) {
+    *vp++ = (sp[0] << 8) | sp[1];
+    sp += 2;
+  }
+  response.add(serverID, functionCode, address, words);
+  return true;
+}
+
 // getMessageCount: read number of messages processed
 uint32_t ModbusServer::getMessageCount() { 
   return messageCount;
@@ -90,11 +294,9 @@ uint32_t ModbusServer::getErrorCount() {
 
 // resetCounts: set both message and error counts to zero
 void ModbusServer::resetCounts() {
-  {
-    LOCK_GUARD(cntLock, m);
-    messageCount = 0;
-    errorCount = 0;
-  }
+  messageCount = 0;
+  errorCount = 0;
+  stats.reset();
 }
 
 // LocalRequest: get response from locally running server.
@@ -104,6 +306,11 @@ ModbusMessage ModbusServer::localRequest(ModbusMessage msg) {
   uint8_t functionCode = msg.getFunctionCode();
   LOG_D("Local request for %02X/%02X\n", serverID, functionCode);
   HEXDUMP_V("Request", msg.data(), msg.size());
+  // Attached register bank covering the function code? Then it serves directly
+  if (bankRequest(msg, m)) {
+    HEXDUMP_V("Bank response", m.data(), m.size());
+    return m;
+  }
   // Try to get a worker for the request
   MBSworker worker = getWorker(serverID, functionCode);
   // Did we get one?
@@ -150,20 +357,43 @@ ModbusMessage ModbusServer::localRequest(ModbusMessage msg) {
 
 // Constructor
 ModbusServer::ModbusServer() :
+  workerTable{},
+  bankTable{{nullptr}},
   messageCount(0),
-  errorCount(0) { }
+  errorCount(0),
+  updateEpoch(0),
+  readersInFlight{} { }
 
 // Destructor
 ModbusServer::~ModbusServer() {
+  // Drop all dispatch tables and register banks
+  for (uint16_t serverID = 0; serverID < 256; ++serverID) {
+    delete workerTable[serverID].load();
+    for (uint8_t type = 0; type < 2; ++type) {
+      RegisterBank *bank = bankTable[serverID][type];
+      while (bank) {
+        RegisterBank *next = bank->next;
+        delete[] bank->values;
+        delete bank;
+        bank = next;
+      }
+    }
+  }
 }
 
 // listServer: Print out all mapped server/FC combinations
 void ModbusServer::listServer() {
-  for (auto it = workerMap.begin(); it != workerMap.end(); ++it) {
-    LOG_N("Server %3d: ", it->first);
-    for (auto it2 = it->second.begin(); it2 != it->second.end(); it2++) {
-      LOGRAW_N(" %02X", it2->first);
+  uint8_t slot = readerEnter();
+  for (uint16_t serverID = 0; serverID < 256; ++serverID) {
+    WorkerTable *wt = workerTable[serverID];
+    if (!wt) continue;
+    LOG_N("Server %3d: ", serverID);
+    for (uint16_t fc = 0; fc < 128; ++fc) {
+      if (wt->worker[fc]) {
+        LOGRAW_N(" %02X", fc);
+      }
     }
     LOGRAW_N("\n");
   }
+  readerExit(slot);
 }
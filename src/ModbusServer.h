@@ -7,15 +7,16 @@
 
 #include "options.h"
 
-#include <map>
 #include <vector>
 #include <functional>
+#include <atomic>
 #if USE_MUTEX
 #include <mutex>      // NOLINT
 #endif
 #include "ModbusTypeDefs.h"
 #include "ModbusError.h"
 #include "ModbusMessage.h"
+#include "ModbusStats.h"
 
 #if USE_MUTEX
 using std::mutex;
@@ -26,25 +27,63 @@ using std::lock_guard;
 const ModbusMessage NIL_RESPONSE (std::vector<uint8_t>{0xFF, 0xF0});
 const ModbusMessage ECHO_RESPONSE(std::vector<uint8_t>{0xFF, 0xF1});
 
-// MBSworker: function signature for worker functions to handle single serverID/functionCode combinations
-using MBSworker = std::function<ModbusMessage(ModbusMessage msg)>;
+// MBSworker: function signature for worker functions to handle single serverID/functionCode combinations.
+// The request is handed over by reference - no copy is made on the way into the worker.
+// The reference stays owned by the server and is valid for the duration of the call only;
+// a worker returning ECHO_RESPONSE must leave the request unmodified. Workers written
+// with a by-value parameter (ModbusMessage msg) still bind and get a private copy as before.
+using MBSworker = std::function<ModbusMessage(ModbusMessage& msg)>;
+
+// Register bank flavours: holding registers are served for FC 0x03/0x06/0x10,
+// input registers for FC 0x04
+enum RegisterBankType : uint8_t {
+  HOLDING_REGISTER_BANK = 0,
+  INPUT_REGISTER_BANK = 1,
+};
 
 class ModbusServer {
 public:
   // registerWorker: register a worker function for a certain serverID/FC combination
   // If there is one already, it will be overwritten!
+  // May be called at runtime while the server is handling requests: the dispatch
+  // table is rebuilt aside and swapped in atomically (read-copy-update), so
+  // concurrent getWorker() calls always see a complete table and never block.
   void registerWorker(uint8_t serverID, uint8_t functionCode, MBSworker worker);
-  
-  // getWorker: if a worker function is registered, return its address, nullptr otherwise
+
+  // getWorker: if a worker function is registered, return its address, nullptr otherwise.
+  // Lock-free - safe against concurrent (un)registration
   MBSworker getWorker(uint8_t serverID, uint8_t functionCode);
 
   // unregisterWorker; remove again all or part of the registered workers for a given server ID
-  // Returns true if the worker was found and removed
+  // Returns true if the worker was found and removed.
+  // Runtime-safe like registerWorker() - the call returns only after the last
+  // reader of the old table has left it, so the worker is gone for good
   bool unregisterWorker(uint8_t serverID, uint8_t functionCode = 0);
 
   // isServerFor: if any worker function is registered for the given serverID, return true
   bool isServerFor(uint8_t serverID);
 
+  // attachRegisterBank: serve FC 0x03/0x06/0x10 (holding) or FC 0x04 (input) for a
+  // contiguous block of registers directly from server-owned storage, without a
+  // worker function in between. Storage is allocated here and zero-initialized.
+  // Returns false if the block is empty, exceeds the address space or overlaps an
+  // already attached bank of the same type.
+  bool attachRegisterBank(uint8_t serverID, RegisterBankType type, uint16_t firstAddress, uint16_t numRegisters);
+
+  // detachRegisterBank: remove the bank starting at firstAddress again
+  bool detachRegisterBank(uint8_t serverID, RegisterBankType type, uint16_t firstAddress);
+
+  // setBankRegister/getBankRegister: application access to attached bank registers.
+  // Updates are atomic with respect to served requests - a FC 0x03 read will never
+  // see a FC 0x10 write block halfway applied.
+  bool setBankRegister(uint8_t serverID, RegisterBankType type, uint16_t address, uint16_t value);
+  uint16_t getBankRegister(uint8_t serverID, RegisterBankType type, uint16_t address);
+
+  // bankRequest: attempt to serve a request from an attached register bank.
+  // Returns true if the request was handled - response then holds the answer
+  // (which may be an error response, e.g. for an out-of-bank address).
+  bool bankRequest(ModbusMessage& request, ModbusMessage& response);
+
   // getMessageCount: read number of messages processed
   uint32_t getMessageCount();
 
@@ -54,6 +93,9 @@ public:
   // resetCounts: set both message and error counts to zero
   void resetCounts();
 
+  // getCounts: read a coherent statistics snapshot for one served ID
+  ModbusStats::Snapshot getCounts(uint8_t serverID) const { return stats.getSnapshot(serverID); }
+
   // Local request to the server
   ModbusMessage localRequest(ModbusMessage msg);
 
@@ -70,11 +112,54 @@ protected:
   // Virtual function to prevent this class being instantiated
   virtual void isInstance() = 0;
 
-  std::map<uint8_t, std::map<uint8_t, MBSworker>> workerMap;      // map on serverID->functionCode->worker function
-  uint32_t messageCount;         // Number of Requests processed
-  uint32_t errorCount;           // Number of errors responded
+  // Dense dispatch table for one served ID: workers are found by indexing with the
+  // function code - no tree walk, O(1) with a single indirection on the hot path.
+  // Slot 0 (ANY_FUNCTION_CODE) holds the catch-all worker, if one was registered.
+  // Function codes are 7 bit by the standard (0x80 and up are exception responses),
+  // so 128 slots cover all registrable codes.
+  struct WorkerTable {
+    MBSworker worker[128];       // worker functions, indexed by function code
+    uint16_t numWorkers;         // number of occupied slots, for unregister bookkeeping
+    WorkerTable() : numWorkers(0) { }
+  };
+
+  // The dispatch tables are updated read-copy-update style: a registration
+  // builds a modified copy aside, swaps the pointer in atomically and retires
+  // the old table once the last reader has left it. Readers bracket their
+  // access with readerEnter()/readerExit() - two lock-free counter operations,
+  // no mutex anywhere on the request path.
+  std::atomic<WorkerTable *> workerTable[256]; // dispatch index by serverID; nullptr = ID not served
+
+  // readerEnter/readerExit: announce/revoke a read of the dispatch tables.
+  // The epoch slot returned by readerEnter() must be handed to readerExit()
+  uint8_t readerEnter();
+  void readerExit(uint8_t slot);
+
+  // retireTable: delete a replaced dispatch table after all readers that may
+  // still hold its pointer have left - caller holds workerLock!
+  void retireTable(WorkerTable *old);
+
+  // One native register bank: a contiguous block of 16 bit registers served by the
+  // framework itself. Banks of one serverID/type form a singly linked list.
+  struct RegisterBank {
+    uint16_t *values;            // Register storage, owned by the server
+    uint16_t first;              // First register address of the block
+    uint16_t numRegs;            // Number of registers in the block
+    RegisterBank *next;          // Next bank for the same serverID/type
+  };
+
+  // findBank: locate the bank covering [address, address+words) - caller holds bankLock!
+  RegisterBank *findBank(uint8_t serverID, RegisterBankType type, uint16_t address, uint16_t words);
+
+  RegisterBank *bankTable[256][2]; // attached banks by serverID and bank type
+  std::atomic<uint32_t> messageCount; // Number of Requests processed
+  std::atomic<uint32_t> errorCount;   // Number of errors responded
+  ModbusStats stats;             // Per-serverID/per-FC tallies
+  std::atomic<uint32_t> updateEpoch;       // Epoch counter, bumped per table retirement
+  std::atomic<uint32_t> readersInFlight[2]; // Readers active, by epoch parity
   #if USE_MUTEX
-  mutex m;                       // mutex to cover changes to messageCount and errorCount
+  mutex bankLock;                // mutex to make register bank accesses atomic
+  mutex workerLock;              // serializes the (rare) dispatch table rebuilds
   #endif
 };
 
@@ -23,6 +23,8 @@ ModbusServerRTU::ModbusServerRTU(HardwareSerial& serial, uint32_t timeout, int r
   MSRrtsPin(rtsPin), 
   MSRuseASCII(false),
   MSRskipLeadingZeroByte(false),
+  MSRhighRate(false),
+  MSRuseIDfilter(false),
   listener(nullptr),
   sniffer(nullptr) {
   // Count instances one up
@@ -50,6 +52,8 @@ ModbusServerRTU::ModbusServerRTU(HardwareSerial& serial, uint32_t timeout, RTSca
   MRTSrts(rts), 
   MSRuseASCII(false),
   MSRskipLeadingZeroByte(false),
+  MSRhighRate(false),
+  MSRuseIDfilter(false),
   listener(nullptr),
   sniffer(nullptr) {
   // Count instances one up
@@ -63,8 +67,13 @@ ModbusServerRTU::ModbusServerRTU(HardwareSerial& serial, uint32_t timeout, RTSca
 ModbusServerRTU::~ModbusServerRTU() {
 }
 
-// start: create task with RTU server
+// start: create task with RTU server, default tuning
 bool ModbusServerRTU::start(int coreID, uint32_t interval) {
+  return start(TaskConfig(8, 4096, coreID), interval);
+}
+
+// start: create task with RTU server, full task tuning
+bool ModbusServerRTU::start(TaskConfig tc, uint32_t interval) {
   // Task already running?
   if (serverTask != nullptr) {
     // Yes. stop it first
@@ -75,7 +84,7 @@ bool ModbusServerRTU::start(int coreID, uint32_t interval) {
   // start only if serial interface is initialized!
   if (MSRserial.baudRate()) {
     // Set minimum interval time
-    MSRinterval = RTUutils::calculateInterval(MSRserial, interval);
+    MSRinterval = RTUutils::calculateInterval(MSRserial, interval, MSRhighRate);
 
     // Set the UART FIFO copy threshold to 1 byte
     RTUutils::UARTinit(MSRserial, 1);
@@ -85,7 +94,7 @@ bool ModbusServerRTU::start(int coreID, uint32_t interval) {
     snprintf(taskName, 18, "MBsrv%02XRTU", instanceCounter);
 
     // Start task to handle the client
-    xTaskCreatePinnedToCore((TaskFunction_t)&serve, taskName, 4096, this, 8, &serverTask, coreID >= 0 ? coreID : NULL);
+    xTaskCreatePinnedToCore((TaskFunction_t)&serve, taskName, tc.stackSize, this, tc.priority, &serverTask, tc.coreID >= 0 ? tc.coreID : NULL);
 
     LOG_D("Server task %d started. Interval=%d\n", (uint32_t)serverTask, MSRinterval);
   } else {
@@ -96,6 +105,11 @@ bool ModbusServerRTU::start(int coreID, uint32_t interval) {
   return true;
 }
 
+// stackHighWaterMark: unused server task stack in bytes, 0 if not running
+uint32_t ModbusServerRTU::stackHighWaterMark() {
+  return serverTask ? uxTaskGetStackHighWaterMark(serverTask) : 0;
+}
+
 // stop: kill server task
 bool ModbusServerRTU::stop() {
   if (serverTask != nullptr) {
@@ -108,9 +122,14 @@ bool ModbusServerRTU::stop() {
 
 // Toggle protocol to ModbusASCII
 void ModbusServerRTU::useModbusASCII(unsigned long timeout) {
+#if EMODBUS_ASCII
   MSRuseASCII = true;
   serverTimeout = timeout; // Set timeout to ASCII's value
   LOG_D("Protocol mode: ASCII\n");
+#else
+  // ASCII support was pruned from this build - stay in RTU mode
+  LOG_E("ASCII support compiled out (EMODBUS_NO_ASCII)\n");
+#endif
 }
 
 // Toggle protocol to ModbusRTU
@@ -130,6 +149,18 @@ void ModbusServerRTU::skipLeading0x00(bool onOff) {
   LOG_D("Skip leading 0x00 mode = %s\n", onOff ? "ON" : "OFF");
 }
 
+// Toggle high-rate bus mode - takes effect with the next start()
+void ModbusServerRTU::useHighRateMode(bool onOff) {
+  MSRhighRate = onOff;
+  LOG_D("High-rate mode = %s\n", onOff ? "ON" : "OFF");
+}
+
+// Toggle the served-ID pre-filter
+void ModbusServerRTU::useServerIDfilter(bool onOff) {
+  MSRuseIDfilter = onOff;
+  LOG_D("ServerID pre-filter = %s\n", onOff ? "ON" : "OFF");
+}
+
 // Special case: worker to react on broadcast requests
 void ModbusServerRTU::registerBroadcastWorker(MSRlistener worker) {
   // If there is one already, it will be overwritten!
@@ -161,6 +192,23 @@ void ModbusServerRTU::serve(ModbusServerRTU *myServer) {
     response.clear();
     m.clear();
 
+    // Refresh the served-ID bitmap for the receive pre-filter, if it is enabled.
+    // A registered sniffer wants to see all bus traffic, so it suspends the filter.
+    const uint8_t *idFilter = nullptr;
+    if (myServer->MSRuseIDfilter && !myServer->sniffer) {
+      memset(myServer->MSRidFilter, 0, sizeof(myServer->MSRidFilter));
+      // Broadcasts always pass
+      myServer->MSRidFilter[0] = 0x01;
+      for (uint16_t id = 1; id < 256; ++id) {
+        // Served by a worker function or an attached register bank?
+        if (myServer->workerTable[id] || myServer->bankTable[id][0] || myServer->bankTable[id][1]) {
+          // Yes. Set the ID's bit
+          myServer->MSRidFilter[id >> 3] |= 1 << (id & 0x07);
+        }
+      }
+      idFilter = myServer->MSRidFilter;
+    }
+
     // Wait for and read an request
     request = RTUutils::receive(
       myServer->MSRserial, 
@@ -168,7 +216,8 @@ void ModbusServerRTU::serve(ModbusServerRTU *myServer) {
       myServer->MSRlastMicros, 
       myServer->MSRinterval, 
       myServer->MSRuseASCII, 
-      myServer->MSRskipLeadingZeroByte);
+      myServer->MSRskipLeadingZeroByte,
+      idFilter);
 
     // Request longer than 1 byte (that will signal an error in receive())? 
     if (request.size() > 1) {
@@ -189,49 +238,55 @@ void ModbusServerRTU::serve(ModbusServerRTU *myServer) {
         }
         // else we simply ignore it
       } else {
-        // No Broadcast. 
-        // Do we have a callback function registered for it?
-        MBSworker callBack = myServer->getWorker(request[0], request[1]);
-        if (callBack) {
-          LOG_D("Callback found.\n");
-          // Yes, we do. Count the message
-          {
-            LOCK_GUARD(cntLock, myServer->m);
+        // No Broadcast.
+        // Can an attached register bank serve the request directly?
+        if (myServer->bankRequest(request, response)) {
+          LOG_D("Register bank response.\n");
+          // Count the message
+          myServer->messageCount++;
+          myServer->stats.countMessage(request.getServerID(), request.getFunctionCode());
+        } else {
+          // No. Do we have a callback function registered for it?
+          MBSworker callBack = myServer->getWorker(request[0], request[1]);
+          if (callBack) {
+            LOG_D("Callback found.\n");
+            // Yes, we do. Count the message
             myServer->messageCount++;
-          }
-          // Get the user's response
-          LOG_D("Callback called.\n");
-          m = callBack(request);
-          HEXDUMP_V("Callback response", m.data(), m.size());
-
-          // Process Response. Is it one of the predefined types?
-          if (m[0] == 0xFF && (m[1] == 0xF0 || m[1] == 0xF1)) {
-            // Yes. Check it
-            switch (m[1]) {
-            case 0xF0: // NIL
-              response.clear();
-              break;
-            case 0xF1: // ECHO
-              response = request;
-              if (request.getFunctionCode() == WRITE_MULT_REGISTERS ||
-                  request.getFunctionCode() == WRITE_MULT_COILS) {
-                response.resize(6);
+            myServer->stats.countMessage(request.getServerID(), request.getFunctionCode());
+            // Get the user's response
+            LOG_D("Callback called.\n");
+            m = callBack(request);
+            HEXDUMP_V("Callback response", m.data(), m.size());
+
+            // Process Response. Is it one of the predefined types?
+            if (m[0] == 0xFF && (m[1] == 0xF0 || m[1] == 0xF1)) {
+              // Yes. Check it
+              switch (m[1]) {
+              case 0xF0: // NIL
+                response.clear();
+                break;
+              case 0xF1: // ECHO
+                response = request;
+                if (request.getFunctionCode() == WRITE_MULT_REGISTERS ||
+                    request.getFunctionCode() == WRITE_MULT_COILS) {
+                  response.resize(6);
+                }
+                break;
+              default:   // Will not get here, but lint likes it!
+                break;
               }
-              break;
-            default:   // Will not get here, but lint likes it!
-              break;
+            } else {
+              // No predefined. User provided data in free format - move, not copy, it over
+              response = std::move(m);
             }
           } else {
-            // No predefined. User provided data in free format
-            response = m;
-          }
-        } else {
-          // No callback. Is at least the serverID valid and no broadcast?
-          if (myServer->isServerFor(request[0]) && request[0] != 0x00) {
-            // Yes. Send back a ILLEGAL_FUNCTION error
-            response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_FUNCTION);
+            // No callback. Is at least the serverID valid and no broadcast?
+            if (myServer->isServerFor(request[0]) && request[0] != 0x00) {
+              // Yes. Send back a ILLEGAL_FUNCTION error
+              response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_FUNCTION);
+            }
+            // Else we will ignore the request, as it is not meant for us and we do not deal with broadcasts!
           }
-          // Else we will ignore the request, as it is not meant for us and we do not deal with broadcasts!
         }
         // Do we have gathered a valid response now?
         if (response.size() >= 3) {
@@ -240,8 +295,8 @@ void ModbusServerRTU::serve(ModbusServerRTU *myServer) {
           LOG_D("Response sent.\n");
           // Count it, in case we had an error response
           if (response.getError() != SUCCESS) {
-            LOCK_GUARD(errorCntLock, myServer->m);
             myServer->errorCount++;
+            myServer->stats.countError(request.getServerID());
           }
         }
       }
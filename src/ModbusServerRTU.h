@@ -13,6 +13,7 @@
 #include "HardwareSerial.h"
 #include "ModbusServer.h"
 #include "RTUutils.h"
+#include "TaskConfig.h"
 
 extern "C" {
 #include <freertos/FreeRTOS.h>
@@ -34,6 +35,16 @@ public:
   // start: create task with RTU server to accept requests
   bool start(int coreID = -1, uint32_t interval = 0);
 
+  // start with full task tuning - priority, stack size and core pin.
+  // Default is TaskConfig(8, 4096); pin the task and keep the priority above
+  // the network housekeeping tasks if the bus timing degrades under WiFi load.
+  bool start(TaskConfig tc, uint32_t interval = 0);
+
+  // stackHighWaterMark: unused stack of the server task in bytes, as reported
+  // by FreeRTOS - 0 if the server is not running. Use it to right-size the
+  // TaskConfig stack.
+  uint32_t stackHighWaterMark();
+
   // stop: kill server task
   bool stop();
 
@@ -49,6 +60,17 @@ public:
   // Toggle skipping of leading 0x00 byte
   void skipLeading0x00(bool onOff = true);
 
+  // Toggle high-rate bus mode - call before start(). The silent interval is
+  // taken as the true 3.5 character time instead of the standard's 1750µs
+  // floor, matching a client running useHighRateMode() on the same bus.
+  void useHighRateMode(bool onOff = true);
+
+  // Toggle the served-ID pre-filter: on a shared bus, frames addressing a foreign
+  // server are drained with a cheap skip path - no buffering and no CRC - instead
+  // of being fully received just to be discarded. Broadcasts always pass, and a
+  // registered sniffer suspends the filter, as it wants to see all bus traffic.
+  void useServerIDfilter(bool onOff = true);
+
   // Special case: worker to react on broadcast requests
   void registerBroadcastWorker(MSRlistener worker);
 
@@ -76,8 +98,11 @@ protected:
   RTScallback MRTSrts;                   // Callback to set the RTS line to HIGH/LOW
   bool MSRuseASCII;                      // true=ModbusASCII, false=ModbusRTU
   bool MSRskipLeadingZeroByte;           // true=first byte ignored if 0x00, false=all bytes accepted
-  MSRlistener listener;                  // Broadcast listener 
-  MSRlistener sniffer;                   // Sniffer listener 
+  bool MSRhighRate;                      // true=use the true 3.5 character time, not the 1750µs floor
+  bool MSRuseIDfilter;                   // true=skip frames addressing foreign serverIDs
+  uint8_t MSRidFilter[32];               // 256-bit bitmap of served IDs for the pre-filter
+  MSRlistener listener;                  // Broadcast listener
+  MSRlistener sniffer;                   // Sniffer listener
 
   // serve: loop function for server task
   static void serve(ModbusServerRTU *myself);
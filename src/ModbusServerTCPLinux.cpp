@@ -0,0 +1,379 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#include "ModbusServerTCPLinux.h"
+
+#if IS_LINUX
+
+#undef LOCAL_LOG_LEVEL
+// #define LOCAL_LOG_LEVEL LOG_LEVEL_VERBOSE
+#include "Logging.h"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+
+// Connection destructor: the last reference closes the socket, so a worker still
+// writing a response can never collide with a reused fd number
+ModbusServerTCPLinux::Connection::~Connection() {
+  ::close(fd);
+}
+
+// Constructor: choose the number of dispatch worker threads
+ModbusServerTCPLinux::ModbusServerTCPLinux(uint8_t numWorkerThreads) :
+  MSL_listenFd(-1),
+  MSL_epollFd(-1),
+  MSL_maxClients(100),
+  MSL_idleTimeout(60000),
+  MSL_numWorkers(numWorkerThreads ? numWorkerThreads : 1),
+  MSL_running(false) { }
+
+// Destructor: shut everything down
+ModbusServerTCPLinux::~ModbusServerTCPLinux() {
+  stop();
+}
+
+// start: open the listen socket and run event loop and worker threads
+bool ModbusServerTCPLinux::start(uint16_t port, uint8_t maxClients, uint32_t timeout) {
+  // don't restart if already running
+  if (MSL_running) {
+    LOG_W("Server already running.\n");
+    return false;
+  }
+
+  MSL_maxClients = maxClients;
+  MSL_idleTimeout = timeout;
+
+  // Set up the listening socket - nonblocking, address reusable
+  MSL_listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (MSL_listenFd < 0) {
+    LOG_E("Could not create socket: %d\n", errno);
+    return false;
+  }
+  int on = 1;
+  setsockopt(MSL_listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (::bind(MSL_listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || ::listen(MSL_listenFd, 8) < 0) {
+    LOG_E("Could not bind/listen on port %d: %d\n", port, errno);
+    ::close(MSL_listenFd);
+    MSL_listenFd = -1;
+    return false;
+  }
+
+  // Set up the epoll instance watching the listen socket
+  MSL_epollFd = epoll_create1(0);
+  if (MSL_epollFd < 0) {
+    LOG_E("Could not create epoll instance: %d\n", errno);
+    ::close(MSL_listenFd);
+    MSL_listenFd = -1;
+    return false;
+  }
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.fd = MSL_listenFd;
+  epoll_ctl(MSL_epollFd, EPOLL_CTL_ADD, MSL_listenFd, &ev);
+
+  // Start event loop and worker pool
+  MSL_running = true;
+  MSL_eventThread = std::thread(&ModbusServerTCPLinux::eventLoop, this);
+  for (uint8_t i = 0; i < MSL_numWorkers; ++i) {
+    MSL_workers.emplace_back(&ModbusServerTCPLinux::workerLoop, this);
+  }
+  LOG_D("Modbus server started on port %d (%d workers)\n", port, MSL_numWorkers);
+  return true;
+}
+
+// stop: close all connections and join all threads
+bool ModbusServerTCPLinux::stop() {
+  if (!MSL_running) return true;
+
+  // Make all threads wind down and wait for them
+  MSL_running = false;
+  MSL_jobsCV.notify_all();
+  if (MSL_eventThread.joinable()) MSL_eventThread.join();
+  for (auto& worker : MSL_workers) {
+    if (worker.joinable()) worker.join();
+  }
+  MSL_workers.clear();
+
+  // Drop all connections - destructors close the sockets
+  {
+    std::lock_guard<std::mutex> lg(MSL_clientsLock);
+    MSL_clients.clear();
+  }
+  ::close(MSL_epollFd);
+  ::close(MSL_listenFd);
+  MSL_epollFd = -1;
+  MSL_listenFd = -1;
+  LOG_D("Modbus server stopped\n");
+  return true;
+}
+
+// activeClients: number of currently open client connections
+uint16_t ModbusServerTCPLinux::activeClients() {
+  std::lock_guard<std::mutex> lg(MSL_clientsLock);
+  return MSL_clients.size();
+}
+
+// eventLoop: accept clients, collect frames, feed the job queue
+void ModbusServerTCPLinux::eventLoop() {
+  struct epoll_event events[16];
+
+  while (MSL_running) {
+    // Short timeout keeps the idle sweep and the shutdown check responsive
+    int numEvents = epoll_wait(MSL_epollFd, events, 16, 250);
+
+    for (int i = 0; i < numEvents; ++i) {
+      if (events[i].data.fd == MSL_listenFd) {
+        // New connection(s) pending - accept them all
+        while (true) {
+          int fd = ::accept4(MSL_listenFd, nullptr, nullptr, SOCK_NONBLOCK);
+          if (fd < 0) break;
+          std::lock_guard<std::mutex> lg(MSL_clientsLock);
+          if (MSL_clients.size() >= MSL_maxClients) {
+            LOG_D("max number of clients reached, closing new\n");
+            ::close(fd);
+            continue;
+          }
+          int on = 1;
+          setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+          struct epoll_event ev = {};
+          ev.events = EPOLLIN;
+          ev.data.fd = fd;
+          epoll_ctl(MSL_epollFd, EPOLL_CTL_ADD, fd, &ev);
+          MSL_clients[fd] = std::make_shared<Connection>(fd);
+          LOG_D("new client (fd %d), nr clients: %d\n", fd, (int)MSL_clients.size());
+        }
+      } else {
+        // Traffic (or hangup) on a client socket
+        int fd = events[i].data.fd;
+        std::shared_ptr<Connection> connection;
+        {
+          std::lock_guard<std::mutex> lg(MSL_clientsLock);
+          auto it = MSL_clients.find(fd);
+          if (it != MSL_clients.end()) connection = it->second;
+        }
+        if (!connection) continue;
+        if ((events[i].events & (EPOLLHUP | EPOLLERR)) || !readConnection(connection)) {
+          LOG_D("client disconnected (fd %d)\n", fd);
+          dropConnection(fd);
+        }
+      }
+    }
+
+    // Idle sweep: close connections without traffic for too long
+    if (MSL_idleTimeout > 0) {
+      std::vector<int> idleFds;
+      {
+        std::lock_guard<std::mutex> lg(MSL_clientsLock);
+        for (auto& client : MSL_clients) {
+          if (millis() - client.second->lastActive > MSL_idleTimeout) idleFds.push_back(client.first);
+        }
+      }
+      for (int fd : idleFds) {
+        LOG_D("client idle, closing (fd %d)\n", fd);
+        dropConnection(fd);
+      }
+    }
+  }
+}
+
+// readConnection: drain the socket, cut out complete frames. false = connection lost
+bool ModbusServerTCPLinux::readConnection(std::shared_ptr<Connection>& connection) {
+  uint8_t buffer[512];
+
+  while (true) {
+    ssize_t len = ::recv(connection->fd, buffer, sizeof(buffer), 0);
+    if (len == 0) return false;                     // orderly shutdown by the peer
+    if (len < 0) return errno == EAGAIN || errno == EWOULDBLOCK;  // drained - or lost
+    connection->lastActive = millis();
+
+    ModbusMessage& message = connection->assembly;
+    ssize_t i = 0;
+    while (i < len) {
+      // 1. get minimal 8 bytes (MBAP header, server ID, FC) to move on
+      if (message.size() < 8) {
+        uint16_t take = 8 - message.size();
+        if (take > len - i) take = (uint16_t)(len - i);
+        message.append(buffer + i, take);
+        i += take;
+      }
+      if (message.size() < 8) break;
+
+      // 2. preliminary validation: protocol bytes and message length
+      Error error = SUCCESS;
+      if (message[2] != 0 || message[3] != 0) {
+        error = TCP_HEAD_MISMATCH;
+        LOG_D("invalid protocol\n");
+      }
+      size_t messageLength = ((message[4] << 8) | message[5]) + 6;
+      if (messageLength > 262) {  // 256 + MBAP(6) = 262
+        error = PACKET_LENGTH_ERROR;
+        LOG_D("max length error\n");
+      }
+      if (error != SUCCESS) {
+        // Answer the malformed frame with an error response right away
+        ModbusMessage response;
+        response.setError(message.getServerID(), message.getFunctionCode(), error);
+        message.resize(4);
+        message.add(static_cast<uint16_t>(3));
+        message.append(response);
+        writeResponse(*connection, message);
+        message.clear();
+        return true;  // protocol validation, abort further parsing
+      }
+
+      // 3. receive until request is complete - the len field announced the exact
+      // size, so one reserve and one bulk copy take the remainder in
+      if (message.size() < messageLength) {
+        message.reserve((uint16_t)messageLength);
+        uint16_t take = (uint16_t)(messageLength - message.size());
+        if (take > len - i) take = (uint16_t)(len - i);
+        message.append(buffer + i, take);
+        i += take;
+      }
+      if (message.size() < messageLength) break;  // wait for the next TCP packet
+
+      // 4. request complete - hand it to the worker pool
+      LOG_D("request complete (len:%d)\n", (int)message.size());
+      {
+        std::lock_guard<std::mutex> lg(MSL_jobsLock);
+        MSL_jobs.push(Job{connection, message});
+      }
+      MSL_jobsCV.notify_one();
+      message.clear();
+    }
+  }
+}
+
+// dropConnection: take a connection out of event handling and the client map
+void ModbusServerTCPLinux::dropConnection(int fd) {
+  epoll_ctl(MSL_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+  std::lock_guard<std::mutex> lg(MSL_clientsLock);
+  auto it = MSL_clients.find(fd);
+  if (it != MSL_clients.end()) {
+    it->second->closed = true;
+    MSL_clients.erase(it);
+  }
+}
+
+// workerLoop: take jobs, dispatch them, write the responses
+void ModbusServerTCPLinux::workerLoop() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lk(MSL_jobsLock);
+      MSL_jobsCV.wait(lk, [this]() { return !MSL_jobs.empty() || !MSL_running; });
+      if (MSL_jobs.empty()) {
+        if (!MSL_running) return;
+        continue;
+      }
+      job = MSL_jobs.front();
+      MSL_jobs.pop();
+    }
+
+    // Extract request data (server ID and PDU, without MBAP)
+    ModbusMessage request;
+    request.add(job.frame.data() + 6, job.frame.size() - 6);
+
+    // Count the message
+    messageCount++;
+    stats.countMessage(request.getServerID(), request.getFunctionCode());
+    ModbusMessage response;
+
+    // Can an attached register bank serve the request directly?
+    if (bankRequest(request, response)) {
+      LOG_D("Register bank response\n");
+    } else if (isServerFor(request.getServerID())) {
+      // Server is correct - in principle. Do we serve the FC?
+      MBSworker callBack = getWorker(request.getServerID(), request.getFunctionCode());
+      if (callBack) {
+        // Yes, we do. Invoke the worker method to get a response
+        ModbusMessage data = callBack(request);
+        // Process Response. One of the predefined types?
+        if (data[0] == 0xFF && (data[1] == 0xF0 || data[1] == 0xF1)) {
+          // Yes. Check it
+          switch (data[1]) {
+          case 0xF0: // NIL
+            response.clear();
+            LOG_D("NIL response\n");
+            break;
+          case 0xF1: // ECHO
+            response = request;
+            if (request.getFunctionCode() == WRITE_MULT_REGISTERS ||
+                request.getFunctionCode() == WRITE_MULT_COILS) {
+              response.resize(6);
+            }
+            LOG_D("ECHO response\n");
+            break;
+          default:   // Will not get here!
+            break;
+          }
+        } else {
+          // No. User provided data response - move, not copy, it over
+          response = std::move(data);
+          LOG_D("Data response\n");
+        }
+      } else {
+        // No, function code is not served here
+        response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_FUNCTION);
+      }
+    } else {
+      // No, serverID is not served here
+      response.setError(request.getServerID(), request.getFunctionCode(), INVALID_SERVER);
+    }
+
+    // Do we have a response to send?
+    if (response.size() >= 3) {
+      // Count it, in case we had an error response
+      if (response.getError() != SUCCESS) {
+        errorCount++;
+        stats.countError(request.getServerID());
+      }
+      // Keep transaction and protocol ID, add new length, append the response
+      ModbusMessage frame = job.frame;
+      frame.resize(4);
+      frame.add(static_cast<uint16_t>(response.size()));
+      frame.append(response);
+      writeResponse(*job.conn, frame);
+    }
+  }
+}
+
+// writeResponse: send a response frame back, handling partial writes
+void ModbusServerTCPLinux::writeResponse(Connection& connection, ModbusMessage& m) {
+  std::lock_guard<std::mutex> lg(connection.writeLock);
+  if (connection.closed) return;
+  size_t sent = 0;
+  while (sent < m.size()) {
+    ssize_t written = ::send(connection.fd, m.data() + sent, m.size() - sent, MSG_NOSIGNAL);
+    if (written > 0) {
+      sent += written;
+      continue;
+    }
+    if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      // Socket buffer full - wait for write readiness (bounded)
+      struct pollfd pfd = { connection.fd, POLLOUT, 0 };
+      if (::poll(&pfd, 1, 1000) > 0) continue;
+    }
+    // Write failed for good - give up on the connection.
+    // The event loop will notice the shutdown and clean up.
+    LOG_D("write failed (fd %d): %d\n", connection.fd, errno);
+    connection.closed = true;
+    ::shutdown(connection.fd, SHUT_RDWR);
+    return;
+  }
+  HEXDUMP_V("Response packet", m.data(), m.size());
+  connection.lastActive = millis();
+}
+
+#endif  // IS_LINUX
@@ -0,0 +1,99 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _MODBUS_SERVER_TCP_LINUX_H
+#define _MODBUS_SERVER_TCP_LINUX_H
+
+#include "options.h"
+
+#if IS_LINUX
+
+#include <thread>             // NOLINT
+#include <mutex>              // NOLINT
+#include <atomic>             // NOLINT
+#include <condition_variable> // NOLINT
+#include <memory>
+#include <queue>
+#include <map>
+#include <vector>
+
+#include "ModbusServer.h"
+
+// ModbusServerTCPLinux: epoll-based multi-client Modbus TCP server for the Linux build.
+// A single event loop thread owns all sockets (nonblocking) and assembles MBAP frames;
+// complete requests are handed to a small pool of worker threads for dispatch, so a
+// slow user worker never stalls connection handling. Scales to hundreds of concurrent
+// connections without a task per client.
+class ModbusServerTCPLinux : public ModbusServer {
+public:
+  // Constructor: choose the number of dispatch worker threads
+  explicit ModbusServerTCPLinux(uint8_t numWorkerThreads = 2);
+
+  // Destructor: shut everything down
+  ~ModbusServerTCPLinux();
+
+  // start: open the listen socket and run event loop and worker threads.
+  // timeout: close connections idle for that many ms (0 = never)
+  bool start(uint16_t port, uint8_t maxClients = 100, uint32_t timeout = 60000);
+
+  // stop: close all connections and join all threads
+  bool stop();
+
+  // activeClients: number of currently open client connections
+  uint16_t activeClients();
+
+protected:
+  void isInstance() { }
+
+  // One client connection. The event loop owns the map entry; jobs in flight keep
+  // the object (and with it the fd) alive until they are done.
+  struct Connection {
+    int fd;                        // client socket, nonblocking
+    ModbusMessage assembly;        // partially received frame (incl. MBAP header)
+    uint32_t lastActive;           // millis() of last traffic, for the idle sweep
+    std::atomic<bool> closed;      // set once the connection is being torn down
+    std::mutex writeLock;          // serializes responses from concurrent workers
+    explicit Connection(int f) : fd(f), lastActive(millis()), closed(false) { }
+    ~Connection();
+  };
+
+  // A complete request frame waiting for a worker thread
+  struct Job {
+    std::shared_ptr<Connection> conn;
+    ModbusMessage frame;           // complete frame (incl. MBAP header)
+  };
+
+  // eventLoop: accept clients, collect frames, feed the job queue
+  void eventLoop();
+
+  // workerLoop: take jobs, dispatch them, write the responses
+  void workerLoop();
+
+  // readConnection: drain the socket, cut out complete frames. false = connection lost
+  bool readConnection(std::shared_ptr<Connection>& connection);
+
+  // dropConnection: take a connection out of event handling and the client map
+  void dropConnection(int fd);
+
+  // writeResponse: send a response frame back, handling partial writes
+  void writeResponse(Connection& connection, ModbusMessage& m);
+
+  int MSL_listenFd;                // listening socket
+  int MSL_epollFd;                 // epoll instance
+  uint8_t MSL_maxClients;          // maximum number of concurrent connections
+  uint32_t MSL_idleTimeout;        // close connections after this many ms without traffic
+  uint8_t MSL_numWorkers;          // worker thread pool size
+  std::atomic<bool> MSL_running;   // clear to make all threads wind down
+  std::thread MSL_eventThread;     // the epoll event loop
+  std::vector<std::thread> MSL_workers;  // dispatch worker pool
+  std::map<int, std::shared_ptr<Connection>> MSL_clients;  // open connections by fd
+  std::mutex MSL_clientsLock;      // protects MSL_clients
+  std::queue<Job> MSL_jobs;        // requests waiting for a worker
+  std::mutex MSL_jobsLock;         // protects MSL_jobs
+  std::condition_variable MSL_jobsCV;  // wakes workers on new jobs
+};
+
+#endif  // IS_LINUX
+
+#endif  // INCLUDE GUARD
@@ -9,137 +9,218 @@
 #include "Logging.h"
 
 ModbusServerTCPasync::mb_client::mb_client(ModbusServerTCPasync* s, AsyncClient* c) :
-  server(s),
   client(c),
-  lastActiveTime(millis()),
   message(nullptr),
-  error(SUCCESS),
-  outbox() {
+  lastActiveTime(millis()),
+  draining(false),
+  obAlarmed(false),
+  doomed(false),
+  pendingJobs(0),
+  outbox(s->obLimit),
+  server(s),
+  error(SUCCESS) {
     client->onData([](void* i, AsyncClient* c, void* data, size_t len) { (static_cast<mb_client*>(i))->onData(static_cast<uint8_t*>(data), len); }, this);
     client->onPoll([](void* i, AsyncClient* c) { (static_cast<mb_client*>(i))->onPoll(); }, this);
+    // Acked data means freed TCP window space - the natural moment to send more
+    client->onAck([](void* i, AsyncClient* c, size_t len, uint32_t time) { (static_cast<mb_client*>(i))->handleOutbox(); }, this);
     client->onDisconnect([](void* i, AsyncClient* c) { (static_cast<mb_client*>(i))->onDisconnect(); }, this);
     client->setNoDelay(true);
 }
 
 ModbusServerTCPasync::mb_client::~mb_client() {
+  // release a partly received message, if any
+  if (message) {
+    server->outboxPool.release(message);
+    message = nullptr;
+  }
+
   // clear outbox, if data is left
-  while (!outbox.empty()) {
-    outbox.pop();
+  ModbusMessage* m = nullptr;
+  while ((m = outbox.pop()) != nullptr) {
+    server->outboxPool.release(m);
   }
 
   delete client;  // will also close connection, if any
 }
 
+// checkMBAPheader: preliminary validation of an MBAP header - protocol bytes and
+// message length. Returns SUCCESS and sets frameLength (MBAP plus PDU) if valid
+static Error checkMBAPheader(const uint8_t* head, size_t& frameLength) {
+  if (head[2] != 0 || head[3] != 0) {
+    LOG_D("invalid protocol\n");
+    return TCP_HEAD_MISMATCH;
+  }
+  frameLength = ((head[4] << 8) | head[5]) + 6;
+  if (frameLength > 262) {  // 256 + MBAP(6) = 262
+    LOG_D("max length error\n");
+    return PACKET_LENGTH_ERROR;
+  }
+  return SUCCESS;
+}
+
 void ModbusServerTCPasync::mb_client::onData(uint8_t* data, size_t len) {
   lastActiveTime = millis();
   LOG_D("data len %d\n", len);
 
-  Error error = SUCCESS;
   size_t i = 0;
-  while (i < len) {
-    // 0. start
-    if (!message) {
-      message = new ModbusMessage(8);
-      error = SUCCESS;
-    }
+  size_t frameLength = 0;
 
-    //  1. get minimal 8 bytes to move on
-    while (message->size() < 8 && i < len) {
-      message->push_back(data[i++]);
+  // 1. complete the partial frame carried over from the previous event, if any
+  if (message) {
+    // The MBAP header itself may have been split across segments
+    if (message->size() < 8) {
+      size_t take = 8 - message->size();
+      if (take > len) take = len;
+      message->add(data, take);
+      i += take;
+      // Header still incomplete? Then all data is consumed - wait for more
+      if (message->size() < 8) return;
     }
-    
-    // 2. preliminary validation: protocol bytes and message length
-    if ((*message)[2] != 0 || (*message)[3] != 0) {
-      error = TCP_HEAD_MISMATCH;
-      LOG_D("invalid protocol\n");
-    }
-    size_t messageLength = (((*message)[4] << 8) | (*message)[5]) + 6;
-    if (messageLength > 262) {  // 256 + MBAP(6) = 262
-      error = PACKET_LENGTH_ERROR;
-      LOG_D("max length error\n");
-    }
-    if (error != SUCCESS) {
-      ModbusMessage response;
-      response.setError(message->getServerID(), message->getFunctionCode(), error);
-      message->resize(4);
-      message->add(static_cast<uint16_t>(3));
-      message->append(response);
-      addResponseToOutbox(message);  // outbox has pointer ownership now
-      // reset to starting values and process remaining data
+    Error hdrError = checkMBAPheader(message->data(), frameLength);
+    if (hdrError != SUCCESS) {
+      sendErrorFrame(message->data(), hdrError);
+      server->outboxPool.release(message);
       message = nullptr;
       return;  // protocol validation, abort further parsing
     }
+    // Top up the frame with its missing bytes
+    size_t take = frameLength - message->size();
+    if (take > len - i) take = len - i;
+    message->add(data + i, take);
+    i += take;
+    // Still incomplete?
+    if (message->size() < frameLength) {
+      LOG_D("request incomplete (len:%d), waiting for next TCP packet\n", message->size());
+      return;
+    }
+    LOG_D("request complete (len:%d)\n", message->size());
+    dispatchFrame(message);
+    message = nullptr;
+  }
 
-    // 3. receive until request is complete
-    while (message->size() < messageLength && i < len) {
-      message->push_back(data[i++]);
+  // 2. single pass over the remaining data: headers are parsed in place, and every
+  //    frame complete within the segment is copied out just once and dispatched
+  while (len - i >= 8) {
+    Error hdrError = checkMBAPheader(data + i, frameLength);
+    if (hdrError != SUCCESS) {
+      sendErrorFrame(data + i, hdrError);
+      return;  // protocol validation, abort further parsing
     }
-    if (message->size() == messageLength) {
-      LOG_D("request complete (len:%d)\n", message->size());
-    } else {
-      LOG_D("request incomplete (len:%d), waiting for next TCP packet\n", message->size());
-      continue;
+    // Is the frame complete within this segment?
+    if (len - i < frameLength) break;
+    // Yes. Take it over in one go and dispatch it
+    ModbusMessage* frame = server->outboxPool.acquire(frameLength);
+    frame->add(data + i, frameLength);
+    i += frameLength;
+    LOG_D("request complete (len:%d)\n", frame->size());
+    dispatchFrame(frame);
+  }
+
+  // 3. carry over the partial tail, if any
+  if (i < len) {
+    message = server->outboxPool.acquire(len - i);
+    message->add(data + i, len - i);
+    LOG_D("request incomplete (len:%d), waiting for next TCP packet\n", message->size());
+  }
+}
+
+// dispatchFrame: hand one complete MBAP frame over for processing
+void ModbusServerTCPasync::mb_client::dispatchFrame(ModbusMessage* frame) {
+#if HAS_FREERTOS
+  // Worker pool enabled?
+  if (server->jobQueue) {
+    // Yes. Hand the frame over - a blocking worker function then only occupies
+    // one pool task and the event loop keeps running for all connections
+    Job* job = server->jobPool.acquire(this, frame);
+    pendingJobs++;
+    // Did the handover succeed?
+    if (server->jobQueue->push(job)) {
+      return;
     }
+    // No, job queue is saturated - process inline after all
+    pendingJobs--;
+    server->jobPool.release(job);
+  }
+#endif
+  processRequest(frame);
+}
 
-    // 4. request complete, process
-    ModbusMessage request(messageLength - 6);  // create request without MBAP, with server ID
-    request.add(message->data() + 6, message->size() - 6);
-    ModbusMessage userData;
-    if (server->isServerFor(request.getServerID())) {
-      MBSworker callback = server->getWorker(request.getServerID(), request.getFunctionCode());
-      if (callback) {
-        // request is well formed and is being served by user API
-        userData = callback(request);
-        // Process Response
-        // One of the predefined types?
-        if (userData[0] == 0xFF && (userData[1] == 0xF0 || userData[1] == 0xF1)) {
-          // Yes. Check it
-          switch (userData[1]) {
-          case 0xF0: // NIL
-            userData.clear();
-            LOG_D("NIL response\n");
-            break;
-          case 0xF1: // ECHO
-            userData = request;
-            if (request.getFunctionCode() == WRITE_MULT_REGISTERS ||
-                request.getFunctionCode() == WRITE_MULT_COILS) {
-              userData.resize(6);
-            }
-            LOG_D("ECHO response\n");
-            break;
-          default:   // Will not get here!
-            break;
+// sendErrorFrame: respond to a malformed MBAP header with an error frame
+void ModbusServerTCPasync::mb_client::sendErrorFrame(const uint8_t* head, Error error) {
+  ModbusMessage response;
+  response.setError(head[6], head[7], error);
+  ModbusMessage* out = server->outboxPool.acquire(6 + response.size());
+  out->add(head, 4);  // keep transaction ID and protocol ID
+  out->add(static_cast<uint16_t>(response.size()));
+  out->append(response);
+  addResponseToOutbox(out);  // outbox has pointer ownership now
+}
+
+// processRequest: dispatch one complete MBAP frame and queue the response
+void ModbusServerTCPasync::mb_client::processRequest(ModbusMessage* frame) {
+  Error error = SUCCESS;
+  ModbusMessage request(frame->size() - 6);  // create request without MBAP, with server ID
+  request.add(frame->data() + 6, frame->size() - 6);
+  ModbusMessage userData;
+  if (server->bankRequest(request, userData)) {
+    // Served directly from an attached register bank -
+    // userData already holds the (possibly error) response
+    LOG_D("Register bank response\n");
+    error = SUCCESS;
+  } else if (server->isServerFor(request.getServerID())) {
+    MBSworker callback = server->getWorker(request.getServerID(), request.getFunctionCode());
+    if (callback) {
+      // request is well formed and is being served by user API
+      userData = callback(request);
+      // Process Response
+      // One of the predefined types?
+      if (userData[0] == 0xFF && (userData[1] == 0xF0 || userData[1] == 0xF1)) {
+        // Yes. Check it
+        switch (userData[1]) {
+        case 0xF0: // NIL
+          userData.clear();
+          LOG_D("NIL response\n");
+          break;
+        case 0xF1: // ECHO
+          userData = request;
+          if (request.getFunctionCode() == WRITE_MULT_REGISTERS ||
+              request.getFunctionCode() == WRITE_MULT_COILS) {
+            userData.resize(6);
           }
-        } else {
-          // No. User provided data response
-          LOG_D("Data response\n");
+          LOG_D("ECHO response\n");
+          break;
+        default:   // Will not get here!
+          break;
         }
-        error = SUCCESS;
-      } else {  // no worker found
-        error = ILLEGAL_FUNCTION;
+      } else {
+        // No. User provided data response
+        LOG_D("Data response\n");
       }
-    } else {  // mismatch server ID
-      error = INVALID_SERVER;
-    }
-    if (error != SUCCESS) {
-      userData.setError(request.getServerID(), request.getFunctionCode(), error);
+      error = SUCCESS;
+    } else {  // no worker found
+      error = ILLEGAL_FUNCTION;
     }
-    // Keep transaction id and protocol id
-    message->resize(4);
-    // Add new payload length
-    message->add(static_cast<uint16_t>(userData.size()));
-    // Append payload
-    message->append(userData);
-    // Transfer message data to outbox
-    addResponseToOutbox(message);
-    message = nullptr;
-  }  // end while loop iterating incoming data
+  } else {  // mismatch server ID
+    error = INVALID_SERVER;
+  }
+  if (error != SUCCESS) {
+    userData.setError(request.getServerID(), request.getFunctionCode(), error);
+  }
+  // Keep transaction id and protocol id
+  frame->resize(4);
+  // Add new payload length
+  frame->add(static_cast<uint16_t>(userData.size()));
+  // Append payload
+  frame->append(userData);
+  // Transfer message data to outbox
+  addResponseToOutbox(frame);
 }
 
 void ModbusServerTCPasync::mb_client::onPoll() {
-  LOCK_GUARD(lock1, obLock);
+  // Safety net for the rare push that raced the end of a drain - the regular
+  // trigger for pending sends is the onAck space accounting
   handleOutbox();
-  if (server->idle_timeout > 0 && 
+  if (server->idle_timeout > 0 &&
       millis() - lastActiveTime > server->idle_timeout) {
     LOG_D("client idle, closing\n");
     client->close();
@@ -153,41 +234,165 @@ void ModbusServerTCPasync::mb_client::onDisconnect() {
 
 void ModbusServerTCPasync::mb_client::addResponseToOutbox(ModbusMessage* response) {
   if (response->size() > 0) {
-    LOCK_GUARD(lock1, obLock);
-    outbox.push(response);
+    // Ring full? Then the reader has not taken responses for a long while -
+    // cut it loose instead of ballooning the heap on its behalf
+    if (!outbox.push(response)) {
+      LOG_E("outbox full (%d pending) - closing connection\n", (int)outbox.size());
+      server->outboxPool.release(response);
+      client->close();
+      return;
+    }
+    // Backlog past the high watermark? Tell the application once per episode
+    uint16_t pending = (uint16_t)outbox.size();
+    if (!obAlarmed && server->obAlarm && pending >= server->obAlarmLevel) {
+      obAlarmed = true;
+      server->obAlarm(pending);
+    }
     handleOutbox();
   }
 }
 
 void ModbusServerTCPasync::mb_client::handleOutbox() {
-  while (!outbox.empty()) {
-    ModbusMessage* m = outbox.front();
+  // Claim the single-consumer role of the ring - a concurrent drain is fine,
+  // the claim holder will see (or onPoll will catch) what we pushed
+  bool expected = false;
+  if (!draining.compare_exchange_strong(expected, true)) return;
+  ModbusMessage* m = nullptr;
+  while ((m = outbox.peek()) != nullptr) {
     if (m->size() <= client->space()) {
       LOG_D("sending (%d)\n", m->size());
       client->add(reinterpret_cast<const char*>(m->data()), m->size(), ASYNC_WRITE_FLAG_COPY);
       client->send();
-      delete m;
+      server->outboxPool.release(m);
       outbox.pop();
     } else {
-      return;
+      break;
     }
   }
+  // Backlog halfway drained? Re-arm the high-watermark alarm
+  if (obAlarmed && outbox.size() < server->obAlarmLevel / 2) obAlarmed = false;
+  draining = false;
 }
 
 ModbusServerTCPasync::ModbusServerTCPasync() :
+#if HAS_FREERTOS
+  jobQueue(nullptr),
+#endif
   server(nullptr),
   clients(),
   maxNoClients(5),
-  idle_timeout(60000) {
+  idle_timeout(60000),
+  obLimit(16),
+  obAlarmLevel(12) {
     // setup will be done in 'start'
 }
 
+// useOutboxLimit: size the per-client outbox ring and hook the high-water alarm
+void ModbusServerTCPasync::useOutboxLimit(uint16_t slots, uint16_t highWater, std::function<void(uint16_t)> alarm) {
+  // Server already running? The rings of connected clients cannot be resized
+  if (server) {
+    LOG_E("useOutboxLimit() must be called before start()!\n");
+    return;
+  }
+  if (slots < 2) slots = 2;
+  obLimit = slots;
+  // 0 picks the default watermark of 3/4 the limit
+  obAlarmLevel = highWater ? highWater : (uint16_t)(slots - slots / 4);
+  obAlarm = alarm;
+  LOG_D("Outbox limit %d, high watermark %d\n", obLimit, obAlarmLevel);
+}
+
 
 ModbusServerTCPasync::~ModbusServerTCPasync() {
   stop();
+#if HAS_FREERTOS
+  // Kill the worker pool and release leftover jobs, if we had one
+  for (auto& t : workerTasks) {
+    vTaskDelete(t);
+  }
+  if (jobQueue) {
+    Job* job = nullptr;
+    while ((job = jobQueue->pop()) != nullptr) {
+      outboxPool.release(job->frame);
+      jobPool.release(job);
+    }
+    delete jobQueue;
+    jobQueue = nullptr;
+  }
+#endif
   delete server;
 }
 
+#if HAS_FREERTOS
+// useWorkerTasks: enable the worker pool with default tuning - must be called before start()
+bool ModbusServerTCPasync::useWorkerTasks(uint8_t numTasks, uint16_t queueLimit) {
+  return useWorkerTasks(numTasks, queueLimit, TaskConfig(5, 4096));
+}
+
+// useWorkerTasks: enable the worker pool with full task tuning - must be called before start()
+bool ModbusServerTCPasync::useWorkerTasks(uint8_t numTasks, uint16_t queueLimit, TaskConfig tc) {
+  // Server already running or pool already set up?
+  if (server || jobQueue) {
+    LOG_E("useWorkerTasks() must be called once, before start()!\n");
+    return false;
+  }
+  if (!numTasks) numTasks = 1;
+  // One spare job slot per task on top of the queue limit
+  jobPool.resize(queueLimit + numTasks);
+  jobQueue = new RequestQueue<Job>(queueLimit);
+  for (uint8_t i = 0; i < numTasks; ++i) {
+    char taskName[18];
+    snprintf(taskName, 18, "Modbus%02XasyW", i);
+    TaskHandle_t th = nullptr;
+    xTaskCreatePinnedToCore((TaskFunction_t)&workerTaskLoop, taskName, tc.stackSize, this, tc.priority, &th, tc.coreID >= 0 ? tc.coreID : NULL);
+    if (th) workerTasks.push_back(th);
+  }
+  LOG_D("Worker pool started: %d tasks, %d queue slots\n", workerTasks.size(), queueLimit);
+  return !workerTasks.empty();
+}
+
+// workerStackHighWaterMark: smallest unused pool task stack in bytes, 0 if no pool
+uint32_t ModbusServerTCPasync::workerStackHighWaterMark() {
+  uint32_t least = 0;
+  for (auto& th : workerTasks) {
+    uint32_t mark = uxTaskGetStackHighWaterMark(th);
+    if (least == 0 || mark < least) least = mark;
+  }
+  return least;
+}
+
+// workerTaskLoop: worker pool task - pull jobs, process, respond
+void ModbusServerTCPasync::workerTaskLoop(ModbusServerTCPasync* instance) {
+  while (1) {
+    // Multi-consumer pop - the pool tasks all take from the one job queue
+    Job* job = instance->jobQueue->popMC();
+    // Do we have a job?
+    if (job) {
+      mb_client* sender = job->sender;
+      // Process and respond - unless the connection is gone already
+      if (!sender->doomed) {
+        sender->processRequest(job->frame);
+      } else {
+        instance->outboxPool.release(job->frame);
+      }
+      {
+        // The lock pairs the decrement with the doomed check in onClientDisconnect()
+        LOCK_GUARD(lock1, instance->cListLock);
+        sender->pendingJobs--;
+        // Last job of a disconnected client done?
+        if (sender->doomed && sender->pendingJobs == 0) {
+          // Yes - complete the deferred deletion
+          delete sender;
+        }
+      }
+      instance->jobPool.release(job);
+    } else {
+      delay(1);
+    }
+  }
+}
+#endif
+
 
 uint16_t ModbusServerTCPasync::activeClients() {
   LOCK_GUARD(lock1, cListLock);
@@ -204,6 +409,8 @@ bool ModbusServerTCPasync::start(uint16_t port, uint8_t maxClients, uint32_t tim
   
   maxNoClients = maxClients;
   idle_timeout = timeout;
+  // Provide recycled message storage - a handful of messages in flight per client
+  outboxPool.resize(maxNoClients * 8);
   server = new AsyncServer(port);
   if (server) {
     server->setNoDelay(true);
@@ -251,7 +458,18 @@ void ModbusServerTCPasync::onClientDisconnect(mb_client* client) {
   LOCK_GUARD(lock1, cListLock);
   // delete mb_client from list
   clients.remove_if([client](mb_client* i) { return i->client == client->client; });
+#if HAS_FREERTOS
+  // Jobs of this client still on the worker pool?
+  if (client->pendingJobs > 0) {
+    // Yes - the worker finishing the last one deletes it (under cListLock)
+    client->doomed = true;
+    LOG_D("client deletion deferred, %d jobs pending\n", (uint16_t)client->pendingJobs);
+  } else {
+    delete client;
+  }
+#else
   // delete client itself
   delete client;
+#endif
   LOG_D("nr clients: %d\n", clients.size());
 }
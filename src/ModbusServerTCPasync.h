@@ -8,7 +8,7 @@
 #include "options.h"
 
 #include <list>
-#include <queue>
+#include <atomic>
 #if USE_MUTEX
 #include <mutex> // NOLINT
 #endif
@@ -23,6 +23,9 @@
 #endif
 
 #include "ModbusServer.h"
+#include "MessagePool.h"
+#include "RequestQueue.h"
+#include "TaskConfig.h"
 
 #if USE_MUTEX
 using std::lock_guard;
@@ -42,17 +45,33 @@ class ModbusServerTCPasync : public ModbusServer {
     void onData(uint8_t* data, size_t len);
     void onPoll();
     void onDisconnect();
+    // dispatchFrame: hand one complete MBAP frame over for processing -
+    // to the worker pool if one is running, else inline
+    void dispatchFrame(ModbusMessage* frame);
+    // processRequest: dispatch one complete MBAP frame and queue the response.
+    // Runs inline in the event loop, or on a worker task (see useWorkerTasks())
+    void processRequest(ModbusMessage* frame);
+    // sendErrorFrame: respond to a malformed MBAP header with an error frame
+    void sendErrorFrame(const uint8_t* head, Modbus::Error error);
     void addResponseToOutbox(ModbusMessage* response);
     void handleOutbox();
-    ModbusServerTCPasync* server;
+    // Hot fields first - every data/poll/ack event touches these, so they
+    // share the leading cache line instead of straddling the cold tail
     AsyncClient* client;
+    ModbusMessage* message;             // frame under assembly
     uint32_t lastActiveTime;
-    ModbusMessage* message;
+    std::atomic<bool> draining;         // claims the single-consumer role of the outbox
+    bool obAlarmed;                     // high-water callback fired for the current episode
+    bool doomed;                        // disconnected while jobs were pending
+    std::atomic<uint16_t> pendingJobs;  // requests of this client on the worker pool
+    // Bounded lock-free ring of pending responses. Producers are the event
+    // loop and the worker pool tasks; the drain is claimed via 'draining', so
+    // the send path needs no mutex. A client that lets the ring overflow is
+    // disconnected - memory per slow reader stays bounded.
+    RequestQueue<ModbusMessage> outbox;
+    // Cold tail - set once, or only read on the error path
+    ModbusServerTCPasync* server;
     Modbus::Error error;
-    std::queue<ModbusMessage*> outbox;
-    #if USE_MUTEX
-    std::mutex obLock;  // outbox protection
-    #endif
   };
 
 
@@ -72,15 +91,65 @@ class ModbusServerTCPasync : public ModbusServer {
   // stop: drop all connections and kill server task
   bool stop();
 
+  // useOutboxLimit: bound each client's response outbox to 'slots' pending
+  // responses and optionally register a high-watermark callback. The callback
+  // fires (once per episode, with the pending count) when a client's backlog
+  // passes 'highWater' responses - 0 picks 3/4 of the limit - so the
+  // application can shed load. A client overflowing its outbox entirely is
+  // disconnected: a reader that slow is beyond saving, and memory stays
+  // bounded. Must be called before start(); default is 16 slots, no callback.
+  void useOutboxLimit(uint16_t slots, uint16_t highWater = 0, std::function<void(uint16_t)> alarm = nullptr);
+
+#if HAS_FREERTOS
+  // useWorkerTasks: process requests on a pool of worker tasks instead of inline in
+  // the network event loop. A worker function that blocks - a bridge forwarding to a
+  // slow downstream server, say - then only occupies one pool task, and requests of
+  // the other connections (and further requests pipelined on the same connection)
+  // keep being served concurrently, completing out of order by MBAP transaction ID.
+  // Must be called before start().
+  bool useWorkerTasks(uint8_t numTasks, uint16_t queueLimit = 16);
+
+  // useWorkerTasks with full task tuning - priority, stack size and core pin
+  // for the pool tasks. Default is TaskConfig(5, 4096).
+  bool useWorkerTasks(uint8_t numTasks, uint16_t queueLimit, TaskConfig tc);
+
+  // workerStackHighWaterMark: smallest unused stack across the pool tasks in
+  // bytes, as reported by FreeRTOS - 0 if no pool is running. Use it to
+  // right-size the TaskConfig stack.
+  uint32_t workerStackHighWaterMark();
+#endif
+
  protected:
   inline void isInstance() { }
   void onClientConnect(AsyncClient* client);
   void onClientDisconnect(mb_client* client);
 
+#if HAS_FREERTOS
+  // One pooled request handed from the event loop to the worker tasks
+  struct Job {
+    mb_client* sender;        // connection the request came in on
+    ModbusMessage* frame;     // complete MBAP frame, outboxPool-owned
+    Job(mb_client* s, ModbusMessage* f) :
+      sender(s),
+      frame(f) {}
+  };
+
+  // workerTaskLoop: worker pool task - pull jobs, process, respond
+  static void workerTaskLoop(ModbusServerTCPasync* instance);
+
+  RequestQueue<Job>* jobQueue;        // job handover to the worker pool; nullptr = inline mode
+  MessagePool<Job> jobPool;           // recycling storage for job entries
+  std::vector<TaskHandle_t> workerTasks;  // the pool tasks
+#endif
+
   AsyncServer* server;
   std::list<mb_client*> clients;
   uint8_t maxNoClients;
   uint32_t idle_timeout;
+  uint16_t obLimit;                       // outbox ring slots per client
+  uint16_t obAlarmLevel;                  // pending responses triggering the alarm
+  std::function<void(uint16_t)> obAlarm;  // high-watermark callback, may be empty
+  MessagePool<ModbusMessage> outboxPool;  // recycling storage for in-flight messages, sized in start()
   #if USE_MUTEX
   std::mutex cListLock;  // client list protection
   #endif
@@ -8,6 +8,7 @@
 #include <Arduino.h>
 #include <mutex>  // NOLINT
 #include "ModbusServer.h"
+#include "TaskConfig.h"
 #undef LOCAL_LOG_LEVEL
 // #define LOCAL_LOG_LEVEL LOG_LEVEL_VERBOSE
 #include "Logging.h"
@@ -36,9 +37,26 @@ public:
   // start: create task with TCP server to accept requests
   bool start(uint16_t port, uint8_t maxClients, uint32_t timeout, int coreID = -1);
 
+  // start with full task tuning - priority, stack size and core pin.
+  // Default is TaskConfig(5, 4096); it applies to the server task and to the
+  // per-client worker tasks alike.
+  bool start(uint16_t port, uint8_t maxClients, uint32_t timeout, TaskConfig tc);
+
+  // stackHighWaterMark: unused stack of the server task in bytes, as reported
+  // by FreeRTOS - 0 if the server is not running. Use it to right-size the
+  // TaskConfig stack.
+  uint32_t stackHighWaterMark();
+
   // stop: drop all connections and kill server task
   bool stop();
 
+  // useEventLoop: serve all connections from one single task instead of one task
+  // (4kB stack each) per client. The task accepts connections itself and rotates
+  // over them, serving one request per turn - per-connection state shrinks to a
+  // few dozen bytes, at the price of one slow worker callback stalling the others.
+  // Must be called before start().
+  void useEventLoop(bool onOff = true) { eventLoopMode = onOff; }
+
 protected:
   // Prevent copy construction and assignment
   ModbusServerTCP(ModbusServerTCP& m) = delete;
@@ -48,42 +66,58 @@ protected:
 
   uint8_t numClients;
   TaskHandle_t serverTask;
+  TaskConfig serverTaskConfig;
   uint16_t serverPort;
   uint32_t serverTimeout;
   bool serverGoDown;
   mutex clientLock;
 
-  struct ClientData {
-    ClientData() : task(nullptr), client(0), timeout(0), parent(nullptr) {}
-    ClientData(TaskHandle_t t, CT& c, uint32_t to, ModbusServerTCP<ST, CT> *p) : 
-      task(t), client(c), timeout(to), parent(p) {}
-    ~ClientData() {
-      if (client) {
-        client.stop();
-      }
-      if (task != nullptr) {
-        vTaskDelete(task);
-        LOG_D("Killed client task %d\n", (uint32_t)task);
-      }
-    }
-    TaskHandle_t task;
-    CT client;
-    uint32_t timeout;
-    ModbusServerTCP<ST, CT> *parent;
+  // One connection slot. Slots live in a single contiguous array, so the
+  // accept and cleanup scans walk memory linearly instead of chasing heap
+  // nodes - the fields every scan pass touches lead the struct, the cold
+  // per-connection configuration follows.
+  struct ClientSlot {
+    ClientSlot() : task(nullptr), active(false), gen(0), client(0), timeout(0), parent(nullptr) {}
+    // Hot: checked by every pass of the slot scans
+    TaskHandle_t task;          // Worker task, nullptr once the worker wound down
+    bool active;                // Is the slot occupied?
+    uint16_t gen;               // Bumped on every release - a stale worker must not touch a reused slot
+    // Cold: set once when the slot is taken
+    CT client;                  // The accepted connection
+    uint32_t timeout;           // Idle timeout for the worker
+    ModbusServerTCP<ST, CT> *parent;  // Owning server
   };
-  ClientData **clients;
+  ClientSlot *clients;
+
+  // clearSlot: close a slot's connection, kill its task and free it for reuse
+  void clearSlot(ClientSlot& slot);
+
+  // One connection in event loop mode - no task, no stack, just the socket and a timer
+  struct EventConn {
+    CT client;                  // The accepted connection
+    uint32_t lastActive;        // millis() of the last traffic, for the idle timeout
+    explicit EventConn(CT& c) : client(c), lastActive(millis()) {}
+  };
+  vector<EventConn> conns;      // Connections serviced by the event loop
+  bool eventLoopMode;           // true=single event loop task, false=task per client
 
   // serve: loop function for server task
   static void serve(ModbusServerTCP<ST, CT> *myself);
 
+  // serveEventLoop: loop function for the single-task event loop mode
+  static void serveEventLoop(ModbusServerTCP<ST, CT> *myself);
+
   // worker: loop function for client tasks
-  static void worker(ClientData *myData);
+  static void worker(ClientSlot *myData);
+
+  // serveRequest: receive one request from a client and send back the response
+  void serveRequest(CT& client);
 
   // receive: read data from TCP
   ModbusMessage receive(CT& client, uint32_t timeWait);
 
   // accept: start a task to receive requests and respond to a given client
-  bool accept(CT& client, uint32_t timeout, int coreID = -1);
+  bool accept(CT& client, uint32_t timeout);
 
   // clientAvailable: return true,. if a client slot is currently unused
   bool clientAvailable() { return (numClients - activeClients()) > 0; }
@@ -95,48 +129,75 @@ ModbusServerTCP<ST, CT>::ModbusServerTCP() :
   ModbusServer(),
   numClients(0),
   serverTask(nullptr),
+  serverTaskConfig(5, 4096),
   serverPort(502),
   serverTimeout(20000),
-  serverGoDown(false) {
-    clients = new ClientData*[numClients]();
+  serverGoDown(false),
+  eventLoopMode(false) {
+    clients = new ClientSlot[numClients];
    }
 
 // Destructor: closes the connections
 template <typename ST, typename CT>
 ModbusServerTCP<ST, CT>::~ModbusServerTCP() {
   for (uint8_t i = 0; i < numClients; ++i) {
-    if (clients[i] != nullptr) {
-      delete clients[i];
+    if (clients[i].active) {
+      clearSlot(clients[i]);
     }
   }
   delete[] clients;
   serverGoDown = true;
 }
 
+// clearSlot: close a slot's connection, kill its task and free it for reuse
+template <typename ST, typename CT>
+void ModbusServerTCP<ST, CT>::clearSlot(ClientSlot& slot) {
+  if (slot.client) {
+    slot.client.stop();
+  }
+  if (slot.task != nullptr) {
+    vTaskDelete(slot.task);
+    LOG_D("Killed client task %d\n", (uint32_t)slot.task);
+    slot.task = nullptr;
+  }
+  slot.active = false;
+  // A worker still winding down on this slot must not touch it any more
+  slot.gen++;
+}
+
 // activeClients: return number of clients currently employed
 template <typename ST, typename CT>
 uint16_t ModbusServerTCP<ST, CT>::activeClients() {
+  // In event loop mode the connection list is authoritative
+  if (eventLoopMode) {
+    return conns.size();
+  }
   uint8_t cnt = 0;
   for (uint8_t i = 0; i < numClients; ++i) {
     // Current slot could have been previously used - look for cleared task handles
-    if (clients[i] != nullptr) {
-      // Empty task handle?
-      if (clients[i]->task == nullptr) {
-        // Yes. Delete entry and init client pointer
+    if (clients[i].active) {
+      // Worker wound down?
+      if (clients[i].task == nullptr) {
+        // Yes. Release the slot for reuse
         lock_guard<mutex> cL(clientLock);
-        delete clients[i];
-        LOG_V("Delete client %d\n", i);
-        clients[i] = nullptr;
+        clearSlot(clients[i]);
+        LOG_V("Release client slot %d\n", i);
       }
     }
-    if (clients[i] != nullptr) cnt++;
+    if (clients[i].active) cnt++;
   }
   return cnt;
 }
 
-  // start: create task with TCP server to accept requests
+  // start: create task with TCP server to accept requests, default tuning
 template <typename ST, typename CT>
   bool ModbusServerTCP<ST, CT>::start(uint16_t port, uint8_t maxClients, uint32_t timeout, int coreID) {
+    return start(port, maxClients, timeout, TaskConfig(5, 4096, coreID));
+  }
+
+  // start: create task with TCP server to accept requests, full task tuning
+template <typename ST, typename CT>
+  bool ModbusServerTCP<ST, CT>::start(uint16_t port, uint8_t maxClients, uint32_t timeout, TaskConfig tc) {
     // Task already running?
     if (serverTask != nullptr) {
       // Yes. stop it first
@@ -148,10 +209,11 @@ template <typename ST, typename CT>
       delete[] clients;
       // Now allocate a new one
       numClients = maxClients;
-      clients = new ClientData*[numClients]();
+      clients = new ClientSlot[numClients];
     }
     serverPort = port;
     serverTimeout = timeout;
+    serverTaskConfig = tc;
     serverGoDown = false;
 
     // Create unique task name
@@ -159,7 +221,8 @@ template <typename ST, typename CT>
     snprintf(taskName, 18, "MBserve%04X", port);
 
     // Start task to handle the client
-    xTaskCreatePinnedToCore((TaskFunction_t)&serve, taskName, 4096, this, 5, &serverTask, coreID >= 0 ? coreID : NULL);
+    xTaskCreatePinnedToCore(eventLoopMode ? (TaskFunction_t)&serveEventLoop : (TaskFunction_t)&serve,
+      taskName, tc.stackSize, this, tc.priority, &serverTask, tc.coreID >= 0 ? tc.coreID : NULL);
     LOG_D("Server task %s started (%d).\n", taskName, (uint32_t)serverTask);
 
     // Wait two seconds for it to establish
@@ -174,10 +237,9 @@ template <typename ST, typename CT>
     // Check for clients still connected
     for (uint8_t i = 0; i < numClients; ++i) {
       // Client is alive?
-      if (clients[i] != nullptr) {
-        // Yes. Close the connection
-        delete clients[i];
-        clients[i] = nullptr;
+      if (clients[i].active) {
+        // Yes. Close the connection and free the slot
+        clearSlot(clients[i]);
       }
     }
     if (serverTask != nullptr) {
@@ -191,23 +253,33 @@ template <typename ST, typename CT>
     return true;
   }
 
+// stackHighWaterMark: unused server task stack in bytes, 0 if not running
+template <typename ST, typename CT>
+uint32_t ModbusServerTCP<ST, CT>::stackHighWaterMark() {
+  return serverTask ? uxTaskGetStackHighWaterMark(serverTask) : 0;
+}
+
 // accept: start a task to receive requests and respond to a given client
 template <typename ST, typename CT>
-bool ModbusServerTCP<ST, CT>::accept(CT& client, uint32_t timeout, int coreID) {
+bool ModbusServerTCP<ST, CT>::accept(CT& client, uint32_t timeout) {
   // Look for an empty client slot
   for (uint8_t i = 0; i < numClients; ++i) {
     // Empty slot?
-    if (clients[i] == nullptr) {
-      // Yes. allocate new client data in slot
-      clients[i] = new ClientData(0, client, timeout, this);
+    if (!clients[i].active) {
+      // Yes. Take it for the new connection
+      clients[i].client = client;
+      clients[i].timeout = timeout;
+      clients[i].parent = this;
+      clients[i].active = true;
 
       // Create unique task name
       char taskName[18];
       snprintf(taskName, 18, "MBsrv%02Xclnt", i);
 
-      // Start task to handle the client
-      xTaskCreatePinnedToCore((TaskFunction_t)&worker, taskName, 4096, clients[i], 5, &clients[i]->task, coreID >= 0 ? coreID : NULL);
-      LOG_D("Started client %d task %d\n", i, (uint32_t)(clients[i]->task));
+      // Start task to handle the client, with the tuning the server task got
+      xTaskCreatePinnedToCore((TaskFunction_t)&worker, taskName, serverTaskConfig.stackSize, &clients[i], serverTaskConfig.priority,
+        &clients[i].task, serverTaskConfig.coreID >= 0 ? serverTaskConfig.coreID : NULL);
+      LOG_D("Started client %d task %d\n", i, (uint32_t)(clients[i].task));
 
       return true;
     }
@@ -235,7 +307,7 @@ void ModbusServerTCP<ST, CT>::serve(ModbusServerTCP<ST, CT> *myself) {
         // Did we get a connection?
         if (ec) {
           // Yes. Forward it to the Modbus server
-          myself->accept(ec, myself->serverTimeout, 0);
+          myself->accept(ec, myself->serverTimeout);
           LOG_D("Accepted connection - %d clients running\n", myself->activeClients());
         }
       }
@@ -250,100 +322,93 @@ void ModbusServerTCP<ST, CT>::serve(ModbusServerTCP<ST, CT> *myself) {
 }
 
 template <typename ST, typename CT>
-void ModbusServerTCP<ST, CT>::worker(ClientData *myData) {
+void ModbusServerTCP<ST, CT>::serveEventLoop(ModbusServerTCP<ST, CT> *myself) {
+  // need a local scope here to delete the server at termination time
+  if (1) {
+    // Set up server with given port
+    ST server(myself->serverPort);
+
+    // Start it
+    server.begin();
+
+    // Loop until being killed
+    while (!myself->serverGoDown) {
+      bool didWork = false;
+
+      // Do we have client slots left to use?
+      if (myself->conns.size() < myself->numClients) {
+        // Yes. accept one, when it connects
+        CT ec = server.accept();
+        // Did we get a connection?
+        if (ec) {
+          // Yes. Put it on the connection list
+          myself->conns.emplace_back(ec);
+          LOG_D("Accepted connection - %d clients running\n", (uint16_t)myself->conns.size());
+          didWork = true;
+        }
+      }
+
+      // Rotate over the connections, serving one request per turn
+      for (auto conn = myself->conns.begin(); conn != myself->conns.end(); ) {
+        bool drop = false;
+        // Still connected?
+        if (!conn->client.connected()) {
+          // No. Drop it
+          LOG_D("Client disconnected.\n");
+          drop = true;
+        } else if (conn->client.available()) {
+          // Connected, and a request is waiting - serve it
+          myself->serveRequest(conn->client);
+          conn->lastActive = millis();
+          didWork = true;
+        } else if (myself->serverTimeout && (millis() - conn->lastActive > myself->serverTimeout)) {
+          // Idle for too long
+          LOG_D("Client timed out.\n");
+          drop = true;
+        }
+        // Is the connection to be closed?
+        if (drop) {
+          // Yes. Read away all that may still hang in the buffer, then stop it
+          while (conn->client.read() != -1) {}
+          conn->client.stop();
+          conn = myself->conns.erase(conn);
+        } else {
+          ++conn;
+        }
+      }
+
+      // Give scheduler room to breathe, if nothing was going on
+      if (!didWork) delay(1);
+    }
+    LOG_E("Server going down\n");
+    // Close all remaining connections
+    for (auto& conn : myself->conns) {
+      conn.client.stop();
+    }
+    myself->conns.clear();
+    // We must go down
+    SERVER_END;
+  }
+  vTaskDelete(NULL);
+}
+
+template <typename ST, typename CT>
+void ModbusServerTCP<ST, CT>::worker(ClientSlot *myData) {
   // Get own reference data in handier form
   CT myClient = myData->client;
   uint32_t myTimeOut = myData->timeout;
-  // TaskHandle_t myTask = myData->task;
   ModbusServerTCP<ST, CT> *myParent = myData->parent;
+  // Remember the slot generation we were started for
+  uint16_t myGen = myData->gen;
   unsigned long myLastMessage = millis();
 
   LOG_D("Worker started, timeout=%d\n", myTimeOut);
 
   // loop forever, if timeout is 0, or until timeout was hit
   while (myClient.connected() && (!myTimeOut || (millis() - myLastMessage < myTimeOut))) {
-    ModbusMessage response;               // Data buffer to hold prepared response
     // Get a request
     if (myClient.available()) {
-      response.clear();
-      ModbusMessage m = myParent->receive(myClient, 100);
-
-      // has it the minimal length (6 bytes TCP header plus serverID plus FC)?
-      if (m.size() >= 8) {
-        {
-          LOCK_GUARD(cntLock, myParent->m);
-          myParent->messageCount++;
-        }
-        // Extract request data
-        ModbusMessage request;
-        request.add(m.data() + 6, m.size() - 6);
-
-        // Protocol ID shall be 0x0000 - is it?
-        if (m[2] == 0 && m[3] == 0) {
-          // ServerID shall be at [6], FC at [7]. Check both
-          if (myParent->isServerFor(request.getServerID())) {
-            // Server is correct - in principle. Do we serve the FC?
-            MBSworker callBack = myParent->getWorker(request.getServerID(), request.getFunctionCode());
-            if (callBack) {
-              // Yes, we do.
-              // Invoke the worker method to get a response
-              ModbusMessage data = callBack(request);
-              // Process Response
-              // One of the predefined types?
-              if (data[0] == 0xFF && (data[1] == 0xF0 || data[1] == 0xF1)) {
-                // Yes. Check it
-                switch (data[1]) {
-                case 0xF0: // NIL
-                  response.clear();
-                  LOG_D("NIL response\n");
-                  break;
-                case 0xF1: // ECHO
-                  response = request;
-                  if (request.getFunctionCode() == WRITE_MULT_REGISTERS ||
-                      request.getFunctionCode() == WRITE_MULT_COILS) {
-                    response.resize(6);
-                  }
-                  LOG_D("ECHO response\n");
-                  break;
-                default:   // Will not get here!
-                  break;
-                }
-              } else {
-                // No. User provided data response
-                response = data;
-                LOG_D("Data response\n");
-              }
-            } else {
-              // No, function code is not served here
-              response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_FUNCTION);
-            }
-          } else {
-            // No, serverID is not served here
-            response.setError(request.getServerID(), request.getFunctionCode(), INVALID_SERVER);
-          }
-        } else {
-          // No, protocol ID was something weird
-          response.setError(request.getServerID(), request.getFunctionCode(), TCP_HEAD_MISMATCH);
-        }
-      }
-      delay(1);
-      // Do we have a response to send?
-      if (response.size() >= 3) {
-        // Yes. Do it now.
-        // Cut off length and request data, then update TCP header
-        m.resize(4);
-        m.add(static_cast<uint16_t>(response.size()));
-        // Append response
-        m.append(response);
-        myClient.write(m.data(), m.size());
-        myClient.flush();
-        HEXDUMP_V("Response", m.data(), m.size());
-        // count error responses
-        if (response.getError() != SUCCESS) {
-          LOCK_GUARD(cntLock, myParent->m);
-          myParent->errorCount++;
-        }
-      }
+      myParent->serveRequest(myClient);
       // We did something communicationally - rewind timeout timer
       myLastMessage = millis();
     }
@@ -365,13 +430,101 @@ void ModbusServerTCP<ST, CT>::worker(ClientData *myData) {
 
   {
     lock_guard<mutex> cL(myParent->clientLock);
-    myData->task = nullptr;
+    // Only report back if the slot was not cleared and reused in the meantime
+    if (myData->gen == myGen) {
+      myData->task = nullptr;
+    }
   }
 
   delay(50);
   vTaskDelete(NULL);
 }
 
+// serveRequest: receive one request from a client and send back the response
+template <typename ST, typename CT>
+void ModbusServerTCP<ST, CT>::serveRequest(CT& client) {
+  ModbusMessage response;               // Data buffer to hold prepared response
+  ModbusMessage m = receive(client, 100);
+
+  // has it the minimal length (6 bytes TCP header plus serverID plus FC)?
+  if (m.size() >= 8) {
+    messageCount++;
+    stats.countMessage(m[6], m[7]);
+    // Extract request data
+    ModbusMessage request;
+    request.add(m.data() + 6, m.size() - 6);
+
+    // Protocol ID shall be 0x0000 - is it?
+    if (m[2] == 0 && m[3] == 0) {
+      // ServerID shall be at [6], FC at [7]. Check both
+      if (bankRequest(request, response)) {
+        // Served directly from an attached register bank
+        LOG_D("Register bank response\n");
+      } else if (isServerFor(request.getServerID())) {
+        // Server is correct - in principle. Do we serve the FC?
+        MBSworker callBack = getWorker(request.getServerID(), request.getFunctionCode());
+        if (callBack) {
+          // Yes, we do.
+          // Invoke the worker method to get a response
+          ModbusMessage data = callBack(request);
+          // Process Response
+          // One of the predefined types?
+          if (data[0] == 0xFF && (data[1] == 0xF0 || data[1] == 0xF1)) {
+            // Yes. Check it
+            switch (data[1]) {
+            case 0xF0: // NIL
+              response.clear();
+              LOG_D("NIL response\n");
+              break;
+            case 0xF1: // ECHO
+              response = request;
+              if (request.getFunctionCode() == WRITE_MULT_REGISTERS ||
+                  request.getFunctionCode() == WRITE_MULT_COILS) {
+                response.resize(6);
+              }
+              LOG_D("ECHO response\n");
+              break;
+            default:   // Will not get here!
+              break;
+            }
+          } else {
+            // No. User provided data response - move, not copy, it over
+            response = std::move(data);
+            LOG_D("Data response\n");
+          }
+        } else {
+          // No, function code is not served here
+          response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_FUNCTION);
+        }
+      } else {
+        // No, serverID is not served here
+        response.setError(request.getServerID(), request.getFunctionCode(), INVALID_SERVER);
+      }
+    } else {
+      // No, protocol ID was something weird
+      response.setError(request.getServerID(), request.getFunctionCode(), TCP_HEAD_MISMATCH);
+    }
+  }
+  delay(1);
+  // Do we have a response to send?
+  if (response.size() >= 3) {
+    // Yes. Do it now.
+    // Cut off length and request data, then update TCP header
+    m.resize(4);
+    m.add(static_cast<uint16_t>(response.size()));
+    // Append response
+    m.append(response);
+    client.write(m.data(), m.size());
+    client.flush();
+    HEXDUMP_V("Response", m.data(), m.size());
+    // count error responses
+    if (response.getError() != SUCCESS) {
+      errorCount++;
+      stats.countError(response.getServerID());
+    }
+  }
+}
+
 // receive: get request via Client connection
 template <typename ST, typename CT>
 ModbusMessage ModbusServerTCP<ST, CT>::receive(CT& client, uint32_t timeWait) {
@@ -387,17 +540,19 @@ ModbusMessage ModbusServerTCP<ST, CT>::receive(CT& client, uint32_t timeWait) {
   {
     // Is there data waiting?
     if (client.available()) {
-        buffer[cnt] = client.read();
-        // Are we at the TCP header length field byte #1?
-        if (cnt == 4) lengthVal = buffer[cnt] << 8;
-        // Are we at the TCP header length field byte #2?
-        if (cnt == 5) {
-          lengthVal |= buffer[cnt];
-          lengthVal += 6;
+        // Read in bulk: the header first, then exactly the announced remainder
+        uint16_t want = (cnt < 6) ? 6 - cnt : lengthVal - cnt;
+        if (want > BUFFERSIZE - cnt) want = BUFFERSIZE - cnt;
+        int got = client.read(buffer + cnt, want);
+        if (got > 0) {
+          cnt += got;
+          // Header complete? Then the len field tells us the exact frame size
+          if (lengthVal == 0 && cnt >= 6) {
+            lengthVal = ((buffer[4] << 8) | buffer[5]) + 6;
+          }
+          // Rewind EOT and timeout timers
+          lastMillis = millis();
         }
-        cnt++;
-        // Rewind EOT and timeout timers
-        lastMillis = millis();
     } else {
       delay(1); // Give scheduler room to breathe
     }
@@ -0,0 +1,122 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _MODBUS_STATS_H
+#define _MODBUS_STATS_H
+
+#include <cstdint>
+#include <atomic>
+#include <cstring>
+
+// ModbusStats: per-serverID/per-FC message statistics for clients and servers.
+// All tallies are lock-free atomics, so the worker bumps them without taking a
+// mutex and a monitoring task reads a snapshot without stopping the worker.
+// Blocks are allocated lazily the first time a serverID is seen - idle IDs
+// cost one null pointer each.
+class ModbusStats {
+public:
+  // Snapshot: coherent copy of the tallies gathered for one serverID
+  struct Snapshot {
+    uint32_t messages;       // messages processed for the serverID
+    uint32_t errors;         // error responses for the serverID
+    uint32_t perFC[128];     // messages by function code
+  };
+
+  // Constructor: start with no blocks allocated
+  ModbusStats() {
+    for (auto& b : STblocks) {
+      b.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  // Destructor: drop all blocks
+  ~ModbusStats() {
+    for (auto& b : STblocks) {
+      delete b.load(std::memory_order_relaxed);
+    }
+  }
+
+  // No copying - the blocks are owned by exactly one client or server
+  ModbusStats(const ModbusStats&) = delete;
+  ModbusStats& operator=(const ModbusStats&) = delete;
+
+  // countMessage: tally one message for serverID/functionCode
+  void countMessage(uint8_t serverID, uint8_t functionCode) {
+    Block *b = getBlock(serverID);
+    b->messages.fetch_add(1, std::memory_order_relaxed);
+    b->perFC[functionCode & 0x7F].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // countError: tally one error response for serverID
+  void countError(uint8_t serverID) {
+    getBlock(serverID)->errors.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // getSnapshot: copy the tallies for one serverID
+  Snapshot getSnapshot(uint8_t serverID) const {
+    Snapshot s;
+    Block *b = STblocks[serverID].load(std::memory_order_acquire);
+    // Anything gathered for this ID yet?
+    if (b) {
+      // Yes, copy out all tallies
+      s.messages = b->messages.load(std::memory_order_relaxed);
+      s.errors = b->errors.load(std::memory_order_relaxed);
+      for (uint8_t i = 0; i < 128; ++i) {
+        s.perFC[i] = b->perFC[i].load(std::memory_order_relaxed);
+      }
+    } else {
+      // No, deliver all zeroes
+      memset(&s, 0, sizeof(s));
+    }
+    return s;
+  }
+
+  // reset: zero out all gathered tallies (blocks are kept)
+  void reset() {
+    for (auto& blk : STblocks) {
+      Block *b = blk.load(std::memory_order_acquire);
+      if (b) {
+        b->messages.store(0, std::memory_order_relaxed);
+        b->errors.store(0, std::memory_order_relaxed);
+        for (auto& f : b->perFC) {
+          f.store(0, std::memory_order_relaxed);
+        }
+      }
+    }
+  }
+
+protected:
+  // One statistics block per served/addressed serverID
+  struct Block {
+    std::atomic<uint32_t> messages;
+    std::atomic<uint32_t> errors;
+    std::atomic<uint32_t> perFC[128];
+    Block() : messages(0), errors(0) {
+      for (auto& f : perFC) {
+        f.store(0, std::memory_order_relaxed);
+      }
+    }
+  };
+
+  // getBlock: find the block for a serverID, allocating it on first use.
+  // Concurrent first uses are resolved by compare-exchange - the loser
+  // deletes its allocation again.
+  Block *getBlock(uint8_t serverID) {
+    Block *b = STblocks[serverID].load(std::memory_order_acquire);
+    if (!b) {
+      Block *fresh = new Block();
+      if (STblocks[serverID].compare_exchange_strong(b, fresh, std::memory_order_acq_rel)) {
+        b = fresh;
+      } else {
+        // Another task was faster - use its block
+        delete fresh;
+      }
+    }
+    return b;
+  }
+
+  std::atomic<Block *> STblocks[256];  // statistics blocks by serverID
+};
+
+#endif  // _MODBUS_STATS_H
@@ -2,6 +2,7 @@
 // eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
 //               MIT license - see license.md for details
 // =================================================================================================
+#include <cstring>
 #include "options.h"
 #include "ModbusMessage.h"
 #include "RTUutils.h"
@@ -9,10 +10,89 @@
 // #define LOCAL_LOG_LEVEL LOG_LEVEL_VERBOSE
 #include "Logging.h"
 
-// calcCRC: calculate Modbus CRC16 on a given array of bytes
+#ifdef MODBUS_CRC16_EXTERNAL
+// calcCRC: route the CRC to an external (e.g. hardware-backed) implementation.
+// The implementation must use the Modbus polynomial 0xA001 (reflected)!
+extern uint16_t modbusCRC16(const uint8_t *data, uint16_t len);
+uint16_t RTUutils::calcCRC(const uint8_t *data, uint16_t len) {
+  return modbusCRC16(data, len);
+}
+
+// crcStep: advance a running CRC16 by one byte. An external block CRC cannot
+// be fed byte-wise, so the step is done in plain software here - at UART pace
+// the eight shifts per byte are immaterial.
+uint16_t RTUutils::crcStep(uint16_t crc, uint8_t data) {
+  crc ^= data;
+  for (uint8_t bit = 0; bit < 8; ++bit) {
+    crc = (crc >> 1) ^ ((crc & 1) ? 0xA001 : 0);
+  }
+  return crc;
+}
+#elif MODBUS_CRC_SLICES > 1
+namespace {
+// Slice tables for calcCRC: table[0] is the classic Modbus CRC16 table
+// (polynomial 0xA001, reflected), tables 1..N-1 extend it so the kernel can
+// fold MODBUS_CRC_SLICES bytes per loop step instead of one.
+struct CRCslices {
+  uint16_t table[MODBUS_CRC_SLICES][256];
+  CRCslices() {
+    for (uint16_t i = 0; i < 256; ++i) {
+      uint16_t crc = i;
+      for (uint8_t bit = 0; bit < 8; ++bit) {
+        crc = (crc >> 1) ^ ((crc & 1) ? 0xA001 : 0);
+      }
+      table[0][i] = crc;
+    }
+    for (uint16_t slice = 1; slice < MODBUS_CRC_SLICES; ++slice) {
+      for (uint16_t i = 0; i < 256; ++i) {
+        uint16_t crc = table[slice - 1][i];
+        table[slice][i] = (crc >> 8) ^ table[0][crc & 0xFF];
+      }
+    }
+  }
+};
+
+// crcSlices: the tables, built once on first use - C++11 guarantees thread-safe init
+const CRCslices& crcSlices() {
+  static const CRCslices cs;
+  return cs;
+}
+}  // namespace
+
+// calcCRC: calculate Modbus CRC16 on a given array of bytes, sliced variant
 uint16_t RTUutils::calcCRC(const uint8_t *data, uint16_t len) {
-  // CRC16 pre-calculated tables
-  const uint8_t crcHiTable[] = {
+  const CRCslices& cs = crcSlices();
+  uint16_t crc = 0xFFFF;
+
+  // Wide steps: fold MODBUS_CRC_SLICES bytes per iteration.
+  // The inner loop has constant bounds, so the compiler will unroll it.
+  while (len >= MODBUS_CRC_SLICES) {
+    crc ^= data[0] | (data[1] << 8);
+    uint16_t next = cs.table[MODBUS_CRC_SLICES - 1][crc & 0xFF]
+                  ^ cs.table[MODBUS_CRC_SLICES - 2][crc >> 8];
+    for (uint8_t k = 2; k < MODBUS_CRC_SLICES; ++k) {
+      next ^= cs.table[MODBUS_CRC_SLICES - 1 - k][data[k]];
+    }
+    crc = next;
+    data += MODBUS_CRC_SLICES;
+    len -= MODBUS_CRC_SLICES;
+  }
+
+  // Remaining tail bytes the classic way
+  while (len--) {
+    crc = (crc >> 8) ^ cs.table[0][(crc ^ *data++) & 0xFF];
+  }
+  return crc;
+}
+
+// crcStep: advance a running CRC16 by one byte, using the classic slice table
+uint16_t RTUutils::crcStep(uint16_t crc, uint8_t data) {
+  return (crc >> 8) ^ crcSlices().table[0][(crc ^ data) & 0xFF];
+}
+#else
+namespace {
+// CRC16 pre-calculated tables
+const uint8_t crcHiTable[] = {
     0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
     0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
     0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01,
@@ -33,7 +113,7 @@ uint16_t RTUutils::calcCRC(const uint8_t *data, uint16_t len) {
     0x40
   };
 
-  const uint8_t crcLoTable[] = {
+const uint8_t crcLoTable[] = {
     0x00, 0xC0, 0xC1, 0x01, 0xC3, 0x03, 0x02, 0xC2, 0xC6, 0x06, 0x07, 0xC7, 0x05, 0xC5, 0xC4,
     0x04, 0xCC, 0x0C, 0x0D, 0xCD, 0x0F, 0xCF, 0xCE, 0x0E, 0x0A, 0xCA, 0xCB, 0x0B, 0xC9, 0x09,
     0x08, 0xC8, 0xD8, 0x18, 0x19, 0xD9, 0x1B, 0xDB, 0xDA, 0x1A, 0x1E, 0xDE, 0xDF, 0x1F, 0xDD,
@@ -53,7 +133,10 @@ uint16_t RTUutils::calcCRC(const uint8_t *data, uint16_t len) {
     0x44, 0x84, 0x85, 0x45, 0x87, 0x47, 0x46, 0x86, 0x82, 0x42, 0x43, 0x83, 0x41, 0x81, 0x80,
     0x40
   };
+}  // namespace
 
+// calcCRC: calculate Modbus CRC16 on a given array of bytes
+uint16_t RTUutils::calcCRC(const uint8_t *data, uint16_t len) {
   register uint8_t crcHi = 0xFF;
   register uint8_t crcLo = 0xFF;
   register uint8_t index;
@@ -66,6 +149,15 @@ uint16_t RTUutils::calcCRC(const uint8_t *data, uint16_t len) {
   return (crcHi << 8 | crcLo);
 }
 
+// crcStep: advance a running CRC16 by one byte, using the same tables
+uint16_t RTUutils::crcStep(uint16_t crc, uint8_t data) {
+  uint8_t index = (crc & 0xFF) ^ data;
+  uint8_t crcLo = (crc >> 8) ^ crcHiTable[index];
+  uint8_t crcHi = crcLoTable[index];
+  return (crcHi << 8) | crcLo;
+}
+#endif
+
 // calcCRC: calculate Modbus CRC16 on a given message
 uint16_t RTUutils::calcCRC(ModbusMessage msg) {
   return calcCRC(msg.data(), msg.size());
@@ -102,12 +194,14 @@ void RTUutils::addCRC(ModbusMessage& raw) {
 }
 
 // calculateInterval: determine the minimal gap time between messages
-uint32_t RTUutils::calculateInterval(HardwareSerial& s, uint32_t overwrite) {
+uint32_t RTUutils::calculateInterval(HardwareSerial& s, uint32_t overwrite, bool highRate) {
   uint32_t interval = 0;
 
   // silent interval is at least 3.5x character time
   interval = 35000000UL / s.baudRate();  // 3.5 * 10 bits * 1000 µs * 1000 ms / baud
-  if (interval < 1750) interval = 1750;       // lower limit according to Modbus RTU standard
+  // The standard pins the interval to 1750µs for baud rates above 19200 -
+  // high-rate mode deliberately uses the true 3.5 character time instead
+  if (interval < 1750 && !highRate) interval = 1750;
   // User overwrite?
   if (overwrite > interval) {
     interval = overwrite;
@@ -115,6 +209,22 @@ uint32_t RTUutils::calculateInterval(HardwareSerial& s, uint32_t overwrite) {
   return interval;
 }
 
+// waitInterval: pass the time left of the silent interval since lastMicros
+void RTUutils::waitInterval(unsigned long lastMicros, uint32_t interval) {
+  uint32_t elapsed = (uint32_t)(micros() - lastMicros);
+  // Gap over already?
+  if (elapsed >= interval) return;
+  uint32_t remaining = interval - elapsed;
+  // Sleep the whole milliseconds except the last - delay() may overshoot by
+  // up to a tick, so the precision work is left to the busy-wait below
+  if (remaining >= 2000) {
+    delay(remaining / 1000 - 1);
+  }
+  // Busy-wait the final stretch, re-checking the clock - this is what makes
+  // sub-millisecond intervals on high-rate buses come out exact
+  while ((uint32_t)(micros() - lastMicros) < interval) { }
+}
+
 // UARTinit: modify the UART FIFO copy trigger threshold 
 // This is normally set to 112 by default, resulting in short messages not being 
 // recognized fast enough for higher Modbus bus speeds
@@ -161,56 +271,53 @@ int RTUutils::UARTinit(HardwareSerial& serial, int thresholdBytes) {
 
 // send: send a message via Serial, watching interval times - including CRC!
 void RTUutils::send(HardwareSerial& serial, unsigned long& lastMicros, uint32_t interval, RTScallback rts, const uint8_t *data, uint16_t len, bool ASCIImode) {
+  // Compute the CRC here - ASCII frames carry an LRC instead, added while encoding
+  send(serial, lastMicros, interval, rts, data, len, ASCIImode, ASCIImode ? 0 : calcCRC(data, len));
+}
+
+// send: as above, but with the frame's CRC16 precomputed (e.g. cached in a RequestTemplate)
+void RTUutils::send(HardwareSerial& serial, unsigned long& lastMicros, uint32_t interval, RTScallback rts, const uint8_t *data, uint16_t len, bool ASCIImode, uint16_t crc16) {
   // Clear serial buffers
   while (serial.available()) serial.read();
   
   // Treat ASCII differently
   if (ASCIImode) {
+#if !EMODBUS_ASCII
+    // ASCII support was pruned from this build
+    LOG_E("ASCII frame requested, but EMODBUS_NO_ASCII is set - not sent\n");
+    return;
+#else
+    // Yes, ASCII mode. Encode the complete frame - lead-in, data, LRC and
+    // lead-out - into one contiguous buffer, so the driver gets a single write
+    // instead of two calls per message byte
+    uint8_t frame[2 * 256 + 8];
+    // Sanity check - any valid Modbus message will fit
+    if (2u * len + 5 > sizeof(frame)) {
+      LOG_E("Oversized ASCII frame (%d bytes) - not sent\n", len);
+      return;
+    }
+    uint16_t frameLen = encodeASCII(data, len, frame);
+
     // Toggle rtsPin, if necessary
     rts(HIGH);
-    // Yes, ASCII mode. Send lead-in
-    serial.write(':');
-
-    uint16_t cnt = len;
-    uint8_t crc = 0;
-    uint8_t *cp = (uint8_t *)data;
-
-    // Loop over all bytes of the message
-    while (cnt--) {
-      // Write two nibbles as ASCII characters
-      serial.write(ASCIIwrite[(*cp >> 4) & 0x0F]);
-      serial.write(ASCIIwrite[*cp & 0x0F]);
-      // Advance CRC
-      crc += *cp;
-      // Next byte
-      cp++;
-    }
-    // Finalize CRC (2's complement)
-    crc = ~crc;
-    crc++;
-    // Write ist - two nibbles as ASCII characters
-    serial.write(ASCIIwrite[(crc >> 4) & 0x0F]);
-    serial.write(ASCIIwrite[crc & 0x0F]);
-    
-    // Send lead-out
-    serial.write("\r\n");
+    // Write the frame in one go
+    serial.write(frame, frameLen);
     serial.flush();
     // Toggle rtsPin, if necessary
     rts(LOW);
+#endif
   } else {
     // RTU mode
-    uint16_t crc16 = calcCRC(data, len);
-
     // Respect interval - we must not toggle rtsPin before
-    if (micros() - lastMicros < interval) delayMicroseconds(interval - (micros() - lastMicros));
+    waitInterval(lastMicros, interval);
 
     // Toggle rtsPin, if necessary
     rts(HIGH);
     // Write message
     serial.write(data, len);
-    // Write CRC in LSB order
-    serial.write(crc16 & 0xff);
-    serial.write((crc16 >> 8) & 0xFF);
+    // Write CRC in LSB order - one call, so the driver locks its TX buffer once
+    uint8_t crcBytes[2] = { (uint8_t)(crc16 & 0xFF), (uint8_t)((crc16 >> 8) & 0xFF) };
+    serial.write(crcBytes, 2);
     serial.flush();
     // Toggle rtsPin, if necessary
     rts(LOW);
@@ -227,8 +334,213 @@ void RTUutils::send(HardwareSerial& serial, unsigned long& lastMicros, uint32_t
   send(serial, lastMicros, interval, rts, raw.data(), raw.size(), ASCIImode);
 }
 
+#if EMODBUS_ASCII
+// encodeASCII: batch-encode a frame for ASCII mode in one pass
+uint16_t RTUutils::encodeASCII(const uint8_t *data, uint16_t len, uint8_t *out) {
+  // Byte-to-two-characters table, expanded once from ASCIIwrite
+  struct PairLUT {
+    uint8_t p[256][2];
+    PairLUT() {
+      for (uint16_t i = 0; i < 256; ++i) {
+        p[i][0] = ASCIIwrite[(i >> 4) & 0x0F];
+        p[i][1] = ASCIIwrite[i & 0x0F];
+      }
+    }
+  };
+  static const PairLUT lut;
+
+  uint8_t *op = out;
+  uint8_t crc = 0;
+
+  // Lead-in first
+  *op++ = ':';
+  // Two characters per message byte, advancing the LRC in the same pass
+  for (uint16_t i = 0; i < len; ++i) {
+    *op++ = lut.p[data[i]][0];
+    *op++ = lut.p[data[i]][1];
+    crc += data[i];
+  }
+  // Finalize LRC (2's complement) and append it
+  crc = ~crc;
+  crc++;
+  *op++ = lut.p[crc][0];
+  *op++ = lut.p[crc][1];
+  // Lead-out last
+  *op++ = '\r';
+  *op++ = '\n';
+  return op - out;
+}
+
+// decodeASCII: batch-decode the hex characters of an ASCII frame in one pass
+int32_t RTUutils::decodeASCII(const uint8_t *chars, uint16_t charCnt, uint8_t *out) {
+  // An odd number of characters cannot form complete bytes
+  if (charCnt & 1) return -(int32_t)PACKET_LENGTH_ERROR;
+
+  uint16_t cnt = charCnt / 2;
+  // Do we have a sensible frame length? (serverID, FC and LRC at least)
+  if (cnt < 3) return -(int32_t)PACKET_LENGTH_ERROR;
+
+  uint8_t crc = 0;
+  for (uint16_t i = 0; i < cnt; ++i) {
+    uint8_t hi = chars[2 * i];
+    uint8_t lo = chars[2 * i + 1];
+    // Both characters need to be hex digits
+    if ((hi | lo) & 0x80) return -(int32_t)ASCII_INVALID_CHAR;
+    hi = ASCIIread[hi];
+    lo = ASCIIread[lo];
+    if (hi > 0x0F || lo > 0x0F) return -(int32_t)ASCII_INVALID_CHAR;
+    // Assemble the byte and advance the LRC
+    out[i] = (hi << 4) | lo;
+    crc += out[i];
+  }
+  // A valid frame sums up to zero, LRC byte included
+  if (crc != 0) return -(int32_t)ASCII_CRC_ERR;
+
+  // Strip the LRC byte
+  return cnt - 1;
+}
+#endif  // EMODBUS_ASCII
+
+#if MODBUS_RTU_EVENT_RECEIVE
+namespace {
+// One waiter slot per UART for the event-driven receive path. A single task
+// receiving per bus is the design for both RTU client and server, so one
+// waiter each is sufficient.
+struct RXevent {
+  HardwareSerial *serial;     // UART this slot serves
+  TaskHandle_t waiter;        // task blocked in receiveRTUevent()
+  bool hooked;                // true once the UART event callback is installed
+};
+RXevent rxEvents[3] = {};
+
+// findRXevent: get (or claim) the slot for a serial interface
+RXevent *findRXevent(HardwareSerial& serial) {
+  for (auto& e : rxEvents) {
+    if (e.serial == &serial) return &e;
+  }
+  for (auto& e : rxEvents) {
+    if (!e.serial) {
+      e.serial = &serial;
+      return &e;
+    }
+  }
+  return nullptr;
+}
+}  // namespace
+
+// receiveRTUevent: event-driven RTU reception via the UART RX timeout event
+ModbusMessage RTUutils::receiveRTUevent(HardwareSerial& serial, uint32_t timeout, unsigned long& lastMicros, uint32_t interval, bool skipLeadingZeroBytes, const uint8_t *idFilter) {
+  const uint16_t BUFBLOCKSIZE(512);
+  uint8_t *buffer = new uint8_t[BUFBLOCKSIZE];
+  ModbusMessage rv;
+
+  RXevent *slot = findRXevent(serial);
+  // No free slot? More than 3 UARTs should not happen...
+  if (!slot) {
+    rv.push_back(UNDEFINED_ERROR);
+    delete[] buffer;
+    return rv;
+  }
+
+  // First use: hook the frame gap event of this UART
+  if (!slot->hooked) {
+    // Have the UART RX timeout match the Modbus interval.
+    // One symbol is a character time (11 bits); round up generously.
+    uint32_t symbols = (interval * (serial.baudRate() / 100)) / 110000 + 1;
+    if (symbols > 119) symbols = 119;
+    serial.setRxTimeout((uint8_t)symbols);
+    // The callback fires on RX timeout only, i.e. when the frame gap was
+    // detected in hardware - it runs in the UART event task, outside any ISR
+    serial.onReceive([slot]() {
+      if (slot->waiter) xTaskNotifyGive(slot->waiter);
+    }, true);
+    slot->hooked = true;
+    LOG_D("UART frame gap event hooked (%d symbols)\n", (int)symbols);
+  }
+  slot->waiter = xTaskGetCurrentTaskHandle();
+
+  // Timeout tracker
+  unsigned long TimeOut = millis();
+  uint16_t bufferPtr = 0;
+
+  while (true) {
+    // No complete frame in the driver buffer yet?
+    if (!serial.available()) {
+      // Sleep until the frame gap event (or check the timeout periodically)
+      if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(50)) == 0) {
+        if (millis() - TimeOut >= timeout) {
+          rv.push_back(TIMEOUT);
+          break;
+        }
+        continue;
+      }
+    }
+    // Frame gap detected - drain the driver buffer in bulk, not byte-by-byte
+    while (serial.available() && bufferPtr < BUFBLOCKSIZE) {
+      bufferPtr += serial.read(buffer + bufferPtr, BUFBLOCKSIZE - bufferPtr);
+    }
+    // Buffer full? Something fishy here - bail out!
+    if (bufferPtr >= BUFBLOCKSIZE) {
+      rv.push_back(PACKET_LENGTH_ERROR);
+      break;
+    }
+    // Skip leading zero bytes, if requested
+    uint16_t start = 0;
+    if (skipLeadingZeroBytes) {
+      while (start < bufferPtr && buffer[start] == 0) start++;
+      if (start) {
+        memmove(buffer, buffer + start, bufferPtr - start);
+        bufferPtr -= start;
+      }
+    }
+    // Nothing read (spurious event)? Keep waiting
+    if (bufferPtr == 0) continue;
+
+    // Frame addressing a foreign server by the pre-filter?
+    if (idFilter && !(idFilter[buffer[0] >> 3] & (1 << (buffer[0] & 0x07)))) {
+      // Yes. Drop it without CRC check or allocation and keep waiting
+      lastMicros = micros();
+      bufferPtr = 0;
+      continue;
+    }
+
+    // Frame complete. Note the time and check what we got
+    lastMicros = micros();
+    HEXDUMP_D("Raw buffer received", buffer, bufferPtr);
+    // Did we get a sensible buffer length?
+    if (bufferPtr >= 4) {
+      // Yes. Check CRC
+      if (!validCRC(buffer, bufferPtr)) {
+        // Ooops. CRC is wrong.
+        rv.push_back(CRC_ERROR);
+      } else {
+        // CRC was fine. Hand the buffer to the message as-is, less the CRC -
+        // no copy involved for spilled (>inline size) messages
+        rv.adopt(buffer, bufferPtr - 2, BUFBLOCKSIZE);
+        buffer = nullptr;
+      }
+    } else {
+      // No, packet was too short for anything usable. Return error
+      rv.push_back(PACKET_LENGTH_ERROR);
+    }
+    break;
+  }
+
+  slot->waiter = nullptr;
+  delete[] buffer;
+  return rv;
+}
+#endif
+
 // receive: get (any) message from Serial, taking care of timeout and interval
-ModbusMessage RTUutils::receive(HardwareSerial& serial, uint32_t timeout, unsigned long& lastMicros, uint32_t interval, bool ASCIImode, bool skipLeadingZeroBytes) {
+ModbusMessage RTUutils::receive(HardwareSerial& serial, uint32_t timeout, unsigned long& lastMicros, uint32_t interval, bool ASCIImode, bool skipLeadingZeroBytes, const uint8_t *idFilter) {
+#if MODBUS_RTU_EVENT_RECEIVE
+  // RTU frames are delivered by the UART frame gap event - no polling needed.
+  // ASCII mode has no silent-interval semantics and keeps the state machine.
+  if (!ASCIImode) {
+    return receiveRTUevent(serial, timeout, lastMicros, interval, skipLeadingZeroBytes, idFilter);
+  }
+#endif
   // Allocate initial receive buffer size: 1 block of BUFBLOCKSIZE bytes
   const uint16_t BUFBLOCKSIZE(512);
   uint8_t *buffer = new uint8_t[BUFBLOCKSIZE];
@@ -240,7 +552,7 @@ ModbusMessage RTUutils::receive(HardwareSerial& serial, uint32_t timeout, unsign
   register int b; 
 
   // State machine states, RTU mode
-  enum STATES : uint8_t { WAIT_DATA = 0, IN_PACKET, DATA_READ, FINISHED };
+  enum STATES : uint8_t { WAIT_DATA = 0, IN_PACKET, SKIP_DATA, DATA_READ, FINISHED };
 
   // State machine states, ASCII mode
   enum ASTATES : uint8_t { A_WAIT_DATA = 0, A_DATA, A_WAIT_LEAD_OUT, A_FINISHED };
@@ -254,9 +566,13 @@ ModbusMessage RTUutils::receive(HardwareSerial& serial, uint32_t timeout, unsign
   if (!ASCIImode) {
     // Yes.
     state = WAIT_DATA;
-    // interval tracker 
+    // interval tracker
     lastMicros = micros();
-  
+    // Running CRC, accumulated as the bytes arrive. A complete frame including
+    // its two trailing CRC bytes folds to 0x0000, so validity at end-of-frame
+    // is a single compare - no second pass over the buffer
+    uint16_t runCRC = 0xFFFF;
+
     while (state != FINISHED) {
       switch (state) {
       // WAIT_DATA: await first data byte, but watch timeout
@@ -269,8 +585,14 @@ ModbusMessage RTUutils::receive(HardwareSerial& serial, uint32_t timeout, unsign
           lastMicros = micros();
           // Do we need to skip it, if it is zero?
           if (b > 0 || !skipLeadingZeroBytes) {
-            // No, we can go process it regularly
-            state = IN_PACKET;
+            // No. Does the pre-filter rule the addressed server out?
+            if (idFilter && !(idFilter[b >> 3] & (1 << (b & 0x07)))) {
+              // Yes - drain the frame without buffering it
+              state = SKIP_DATA;
+            } else {
+              // No, we can go process it regularly
+              state = IN_PACKET;
+            }
           } 
         } else {
           // No, we had no byte. Just check the timeout period
@@ -278,7 +600,9 @@ ModbusMessage RTUutils::receive(HardwareSerial& serial, uint32_t timeout, unsign
             rv.push_back(TIMEOUT);
             state = FINISHED;
           }
-          delay(1);
+          // A sub-millisecond interval signals a high-rate bus - poll tight,
+          // a full tick of sleep would cost more than a whole frame takes
+          if (interval >= 1000) delay(1);
         }
         break;
       // IN_PACKET: read data until a gap of at least _interval time passed without another byte arriving
@@ -292,8 +616,9 @@ ModbusMessage RTUutils::receive(HardwareSerial& serial, uint32_t timeout, unsign
           // No, still in reading sequence
           // Did we get a byte?
           if (b >= 0) {
-            // Yes, collect it
+            // Yes, collect it and advance the CRC with it
             buffer[bufferPtr++] = b;
+            runCRC = crcStep(runCRC, (uint8_t)b);
             // Mark time of last byte
             lastMicros = micros();
             // Buffer full?
@@ -308,21 +633,35 @@ ModbusMessage RTUutils::receive(HardwareSerial& serial, uint32_t timeout, unsign
           b = serial.read();
         }
         break;
+      // SKIP_DATA: frame addresses a foreign server - drain it, no buffering, no CRC
+      case SKIP_DATA:
+        // Are we past the interval gap without another byte?
+        if (micros() - lastMicros >= interval) {
+          // Yes, the foreign frame is over. Report it like a timeout, to be ignored
+          LOG_V("%ldus without data\n", micros() - lastMicros);
+          rv.push_back(TIMEOUT);
+          state = FINISHED;
+        } else {
+          // No, still in reading sequence. Discard the byte and try the next
+          if (b >= 0) lastMicros = micros();
+          b = serial.read();
+        }
+        break;
       // DATA_READ: successfully gathered some data. Prepare return object.
       case DATA_READ:
         // Did we get a sensible buffer length?
         HEXDUMP_D("Raw buffer received", buffer, bufferPtr);
         if (bufferPtr >= 4)
         {
-          // Yes. Check CRC
-          if (!validCRC(buffer, bufferPtr)) {
+          // Yes. The CRC was accumulated during reception - a clean frame folds to zero
+          if (runCRC != 0) {
             // Ooops. CRC is wrong.
             rv.push_back(CRC_ERROR);
           } else {
-            // CRC was fine, Now allocate response object without the CRC
-            for (uint16_t i = 0; i < bufferPtr - 2; ++i) {
-              rv.push_back(buffer[i]);
-            }
+            // CRC was fine. Hand the buffer to the message as-is, less the CRC -
+            // no copy involved for spilled (>inline size) messages
+            rv.adopt(buffer, bufferPtr - 2, BUFBLOCKSIZE);
+            buffer = nullptr;
           }
         } else {
           // No, packet was too short for anything usable. Return error
@@ -339,18 +678,19 @@ ModbusMessage RTUutils::receive(HardwareSerial& serial, uint32_t timeout, unsign
       }
     }
   } else {
-    // We are in ASCII mode.
+#if !EMODBUS_ASCII
+    // ASCII support was pruned from this build
+    LOG_E("ASCII frame requested, but EMODBUS_NO_ASCII is set\n");
+    rv.push_back(ASCII_FRAME_ERR);
+#else
+    // We are in ASCII mode. The raw frame characters are gathered first - from
+    // the ':' lead-in up to the CR/LF lead-out - and the complete frame is
+    // batch-decoded in a single pass afterwards.
     state = A_WAIT_DATA;
 
-    // Track nibbles in a byte
-    bool byteComplete = true; 
-
     // Track bytes read
     bool hadBytes = false;
 
-    // ASCII crc byte
-    uint8_t crc = 0;
-
     while (state != A_FINISHED) {
       // Always watch timeout - 1s
       if (millis() - TimeOut >= timeout) {
@@ -370,58 +710,38 @@ ModbusMessage RTUutils::receive(HardwareSerial& serial, uint32_t timeout, unsign
           // First reset timeout
           TimeOut = millis();
           // Is it a valid character?
-          if ((b & 0x80) || ASCIIread[b] == 0xFF) {
+          if ((b & 0x80) || (uint8_t)ASCIIread[b] == 0xFF) {
             // No. Report error and leave.
             rv.clear();
             rv.push_back(ASCII_INVALID_CHAR);
             hadBytes = false;
             state = A_FINISHED;
           } else {
-            // Yes, is valid. Furtheron use interpreted byte
-            b = ASCIIread[b];
             switch (state) {
             // A_WAIT_DATA: await lead-in byte ':'
             case A_WAIT_DATA:
               // Is it the lead-in?
-              if (b == 0xF0) {
+              if (b == ':') {
                 // Yes, proceed to data read state
                 state = A_DATA;
+                bufferPtr = 0;
               }
               // byte was consumed in any case
               hadBytes = false;
               break;
-            // A_DATA: read data as it comes
+            // A_DATA: gather the raw frame characters as they come
             case A_DATA:
               // Lead-out byte 1 received?
-              if (b == 0xF1) {
-                // Yes. Was last buffer byte completed?
-                if (byteComplete) {
-                  // Yes. Move to final state
-                  state = A_WAIT_LEAD_OUT;
-                } else {
-                  // No, signal with error
-                  rv.push_back(PACKET_LENGTH_ERROR);
-                  state = A_FINISHED;
-                }
+              if (b == '\r') {
+                // Yes. Move to final state
+                state = A_WAIT_LEAD_OUT;
               } else {
-                // No lead-out, must be data byte.
-                // Is it valid?
-                if (b < 0xF0) {
-                  // Yes. Add it into current buffer byte
-                  buffer[bufferPtr] <<= 4;
-                  buffer[bufferPtr] += (b & 0x0F);
-                  // Advance nibble
-                  byteComplete = !byteComplete;
-                  // Was it the second of the byte?
-                  if (byteComplete) {
-                    // Yes. Advance CRC and move buffer pointer by one
-                    crc += buffer[bufferPtr];
-                    bufferPtr++;
-                    buffer[bufferPtr] = 0;
-                  }
-                } else {
-                  // No, garbage. report error
-                  rv.push_back(ASCII_INVALID_CHAR);
+                // No, must be a frame character - keep it for the batch decode
+                buffer[bufferPtr++] = b;
+                // Buffer full?
+                if (bufferPtr >= BUFBLOCKSIZE) {
+                  // Yes. Something fishy here - bail out!
+                  rv.push_back(PACKET_LENGTH_ERROR);
                   state = A_FINISHED;
                 }
               }
@@ -429,27 +749,18 @@ ModbusMessage RTUutils::receive(HardwareSerial& serial, uint32_t timeout, unsign
               break;
             // A_WAIT_LEAD_OUT: await \n
             case A_WAIT_LEAD_OUT:
-              if (b == 0xF2) {
-                // Lead-out byte 2 received. Transfer buffer to returned message
+              if (b == '\n') {
+                // Lead-out byte 2 received. Decode the frame in one pass, in
+                // place - a decoded byte never overtakes its two characters
                 HEXDUMP_D("Raw buffer received", buffer, bufferPtr);
-                // Did we get a sensible buffer length?
-                if (bufferPtr >= 3)
-                {
-                  // Yes. Was the CRC calculated correctly?
-                  if (crc == 0) {
-                    // Yes, reduce buffer by 1 to get rid of CRC byte...
-                    bufferPtr--;
-                    // Move data into returned message
-                    for (uint16_t i = 0; i < bufferPtr; ++i) {
-                      rv.push_back(buffer[i]);
-                    }
-                  } else {
-                    // No, CRC calculation seems to have failed
-                    rv.push_back(ASCII_CRC_ERR);
-                  }
+                int32_t cnt = decodeASCII(buffer, bufferPtr, buffer);
+                // Did the frame decode cleanly?
+                if (cnt >= 0) {
+                  // Yes, move data into returned message - LRC already stripped
+                  rv.append(buffer, cnt);
                 } else {
-                  // No, packet was too short for anything usable. Return error
-                  rv.push_back(PACKET_LENGTH_ERROR);
+                  // No, report the decode error
+                  rv.push_back((Error)-cnt);
                 }
               } else {
                 // No lead out byte 2, but something else - report error.
@@ -470,6 +781,7 @@ ModbusMessage RTUutils::receive(HardwareSerial& serial, uint32_t timeout, unsign
         }
       }
     }
+#endif  // EMODBUS_ASCII
   }
   // Deallocate buffer
   delete[] buffer;
@@ -479,8 +791,9 @@ ModbusMessage RTUutils::receive(HardwareSerial& serial, uint32_t timeout, unsign
   return rv;
 }
 
+#if EMODBUS_ASCII
 // Lower 7 bit ASCII characters - all invalid are set to 0xFF
-const char RTUutils::ASCIIread[] = { 
+const char RTUutils::ASCIIread[] = {
   /* 00-07 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 
   /* 08-0F */ 0xFF, 0xFF, 0xF2, 0xFF, 0xFF, 0xF1, 0xFF, 0xFF,  // LF + CR
   /* 10-17 */ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 
@@ -500,6 +813,7 @@ const char RTUutils::ASCIIread[] = {
 };
 
 // Writable ASCII chars for hex digits
-const char RTUutils::ASCIIwrite[] = { 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 
-                                      0x38, 0x39, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46 
+const char RTUutils::ASCIIwrite[] = { 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37,
+                                      0x38, 0x39, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46
 };
+#endif  // EMODBUS_ASCII
@@ -31,6 +31,12 @@ public:
 // calcCRC: calculate the CRC16 value for a given block of data
   static uint16_t calcCRC(ModbusMessage msg);
 
+// crcStep: advance a running CRC16 by a single byte. Seed with 0xFFFF.
+// Feeding a complete frame including its two trailing CRC bytes yields 0x0000,
+// so reception can accumulate the CRC as bytes arrive and check validity at
+// end-of-frame with one compare - no second pass over the data.
+  static uint16_t crcStep(uint16_t crc, uint8_t data);
+
 // validCRC #1: check the CRC in a block of data for validity
   static bool validCRC(const uint8_t *data, uint16_t len);
 
@@ -46,28 +52,68 @@ public:
 // addCRC: extend a RTUMessage by a valid CRC
   static void addCRC(ModbusMessage& raw);
 
-// calculateInterval: determine the minimal gap time between messages
-  static uint32_t calculateInterval(HardwareSerial& s, uint32_t overwrite);
+// calculateInterval: determine the minimal gap time between messages.
+// The standard fixes 1750µs as the floor for baud rates above 19200; with
+// highRate set the true 3.5 character time is used instead - ~76µs at
+// 460800 baud - so a fast bus can actually run at line rate
+  static uint32_t calculateInterval(HardwareSerial& s, uint32_t overwrite, bool highRate = false);
+
+// waitInterval: pass the time left of the silent interval since lastMicros.
+// Whole milliseconds beyond the next one are slept as task delay, the final
+// sub-millisecond stretch is busy-waited - µs precision without burning the
+// CPU for long user-configured gaps
+  static void waitInterval(unsigned long lastMicros, uint32_t interval);
 
 // RTSauto: dummy callback for auto half duplex RS485 boards
   inline static void RTSauto(bool level) { return; } // NOLINT
 
 protected:
+#if EMODBUS_ASCII
 // Printable characters for ASCII protocol: 012345678ABCDEF
   static const char ASCIIwrite[];
   static const char ASCIIread[];
+#endif
+
+#if MODBUS_RTU_EVENT_RECEIVE
+// receiveRTUevent: event-driven RTU reception - the UART RX timeout event
+// (frame gap detected by the UART itself) wakes the task, no polling loop.
+// Used by receive() in RTU mode; the polling state machine remains the
+// fallback for ASCII mode and older cores.
+  static ModbusMessage receiveRTUevent(HardwareSerial& serial, uint32_t timeout, unsigned long& lastMicros, uint32_t interval, bool skipLeadingZeroBytes, const uint8_t *idFilter = nullptr);
+#endif
 
   RTUutils() = delete;
 
-// UARTinit: modify the UART FIFO copy trigger threshold 
+// UARTinit: modify the UART FIFO copy trigger threshold
   static int UARTinit(HardwareSerial& serial, int thresholdBytes = 1);
 
+#if EMODBUS_ASCII
+// encodeASCII: batch-encode a frame for ASCII mode - lead-in, data bytes and LRC
+// as hex character pairs from a 256-entry byte-to-chars LUT, lead-out - in one
+// pass over a contiguous buffer. 'out' must hold 2 * len + 5 characters.
+// Returns the number of characters written.
+  static uint16_t encodeASCII(const uint8_t *data, uint16_t len, uint8_t *out);
+
+// decodeASCII: batch-decode the hex characters of an ASCII frame (lead-in and
+// lead-out already stripped) into bytes, accumulating the LRC in the same pass.
+// Returns the number of payload bytes (LRC byte stripped), or -(Error) if a
+// character was invalid, the LRC check failed or the frame was malformed.
+  static int32_t decodeASCII(const uint8_t *chars, uint16_t charCnt, uint8_t *out);
+#endif
+
 // receive: get a Modbus message from serial, maintaining timeouts etc.
-  static ModbusMessage receive(HardwareSerial& serial, uint32_t timeout, unsigned long& lastMicros, uint32_t interval, bool ASCIImode, bool skipLeadingZeroBytes = false);
+// idFilter, if given, is a 256-bit bitmap of serverIDs worth receiving (RTU mode
+// only): a frame whose first byte has no bit set is drained without buffering or
+// CRC check and reported as TIMEOUT, to be ignored by the caller.
+  static ModbusMessage receive(HardwareSerial& serial, uint32_t timeout, unsigned long& lastMicros, uint32_t interval, bool ASCIImode, bool skipLeadingZeroBytes = false, const uint8_t *idFilter = nullptr);
 
 // send: send a Modbus message in either format (ModbusMessage or data/len)
   static void send(HardwareSerial& serial, unsigned long& lastMicros, uint32_t interval, RTScallback r, const uint8_t *data, uint16_t len, bool ASCIImode);
   static void send(HardwareSerial& serial, unsigned long& lastMicros, uint32_t interval, RTScallback r, ModbusMessage raw, bool ASCIImode);
+// send: variant with the frame's CRC16 precomputed - e.g. cached in a
+// RequestTemplate - skipping the per-send CRC pass. Ignored in ASCII mode,
+// where the frame carries an LRC instead.
+  static void send(HardwareSerial& serial, unsigned long& lastMicros, uint32_t interval, RTScallback r, const uint8_t *data, uint16_t len, bool ASCIImode, uint16_t crc16);
 };
 
 #endif
@@ -0,0 +1,262 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#include <cstring>
+#include "RegisterImage.h"
+
+#undef LOCAL_LOG_LEVEL
+#include "Logging.h"
+
+using namespace Modbus;  // NOLINT
+
+// Constructor: start with an empty image
+RegisterImage::RegisterImage() :
+  RInextToken(0) { }
+
+// Destructor: release all block storage
+RegisterImage::~RegisterImage() {
+  LOCK_GUARD(lg, RIlock);
+  for (auto& block : RIblocks) {
+    delete[] block.values;
+  }
+}
+
+// addBlock: attach a block of registers for a serverID
+bool RegisterImage::addBlock(uint8_t serverID, uint16_t firstAddress, uint16_t numRegisters) {
+  // An empty block makes no sense
+  if (numRegisters == 0) {
+    LOG_E("Empty block rejected (%02X/%04X)\n", serverID, firstAddress);
+    return false;
+  }
+  // Does the block exceed the 16 bit address space?
+  if ((uint32_t)firstAddress + numRegisters > 0x10000) {
+    LOG_E("Block exceeds address space (%02X/%04X, %d regs)\n", serverID, firstAddress, numRegisters);
+    return false;
+  }
+  LOCK_GUARD(lg, RIlock);
+  // Check for overlaps with blocks of the same serverID
+  for (auto& block : RIblocks) {
+    if (block.serverID != serverID) continue;
+    if (firstAddress < block.first + block.numRegs && block.first < firstAddress + numRegisters) {
+      LOG_E("Block overlaps attached block (%02X/%04X)\n", serverID, block.first);
+      return false;
+    }
+  }
+  // All fine - attach it, zero-initialized, sequence starting at 1
+  ImageBlock block;
+  block.serverID = serverID;
+  block.first = firstAddress;
+  block.numRegs = numRegisters;
+  block.values = new uint16_t[numRegisters]();
+  block.seq = 1;
+  for (auto& span : block.history) {
+    span.seq = 0;
+  }
+  block.histNext = 0;
+  RIblocks.push_back(block);
+  LOG_D("Block attached (%02X/%04X, %d regs)\n", serverID, firstAddress, numRegisters);
+  return true;
+}
+
+// removeBlock: detach a block again
+bool RegisterImage::removeBlock(uint8_t serverID, uint16_t firstAddress) {
+  LOCK_GUARD(lg, RIlock);
+  for (auto block = RIblocks.begin(); block != RIblocks.end(); ++block) {
+    if (block->serverID == serverID && block->first == firstAddress) {
+      // Remember the block's span - bindings of other blocks must survive
+      uint16_t numRegs = block->numRegs;
+      delete[] block->values;
+      RIblocks.erase(block);
+      // Drop the bindings that pointed into the removed block
+      for (auto tb = RItokens.begin(); tb != RItokens.end();) {
+        if (tb->serverID == serverID && tb->address >= firstAddress && tb->address < firstAddress + numRegs) {
+          tb = RItokens.erase(tb);
+        } else {
+          ++tb;
+        }
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+// findBlock: locate the block covering [address, address+words) - caller holds RIlock!
+RegisterImage::ImageBlock *RegisterImage::findBlock(uint8_t serverID, uint16_t address, uint16_t words) {
+  for (auto& block : RIblocks) {
+    if (block.serverID != serverID) continue;
+    if (address >= block.first && (uint32_t)address + words <= (uint32_t)block.first + block.numRegs) {
+      return &block;
+    }
+  }
+  return nullptr;
+}
+
+// bindToken: get the (stable) token for a read of firstAddress on serverID
+uint32_t RegisterImage::bindToken(uint8_t serverID, uint16_t firstAddress) {
+  LOCK_GUARD(lg, RIlock);
+  // Is the address covered at all?
+  if (!findBlock(serverID, firstAddress, 1)) {
+    LOG_E("No attached block covers %02X/%04X\n", serverID, firstAddress);
+    return 0;
+  }
+  // Was a token for this spot handed out before?
+  for (auto& tb : RItokens) {
+    if (tb.serverID == serverID && tb.address == firstAddress) {
+      // Yes. Return the same one - cyclic polls bind once
+      return tb.token;
+    }
+  }
+  // No - mint a fresh one. The 'RI' brand keeps the token space apart from
+  // typical application-chosen values
+  TokenBinding tb;
+  tb.token = 0x52490000 | ++RInextToken;
+  tb.serverID = serverID;
+  tb.address = firstAddress;
+  RItokens.push_back(tb);
+  LOG_D("Token %08X bound to %02X/%04X\n", tb.token, serverID, firstAddress);
+  return tb.token;
+}
+
+// storeSpan: write words into a block, tracking the changed span - caller holds RIlock!
+void RegisterImage::storeSpan(ImageBlock *block, uint16_t address, const uint8_t *words, uint16_t numWords) {
+  uint16_t changedFrom = 0xFFFF;
+  uint16_t changedTo = 0;
+  uint16_t *target = block->values + (address - block->first);
+  // One pass: compare and store, noting the outermost changed addresses
+  for (uint16_t i = 0; i < numWords; ++i) {
+    uint16_t value = (words[2 * i] << 8) | words[2 * i + 1];
+    if (target[i] != value) {
+      target[i] = value;
+      if (changedFrom == 0xFFFF) changedFrom = address + i;
+      changedTo = address + i;
+    }
+  }
+  // Did anything change?
+  if (changedFrom != 0xFFFF) {
+    // Yes. Advance the sequence and file the span in the history ring
+    block->seq++;
+    ChangeSpan& span = block->history[block->histNext];
+    span.seq = block->seq;
+    span.from = changedFrom;
+    span.to = changedTo;
+    block->histNext = (block->histNext + 1) % RI_HISTORY;
+  }
+}
+
+// applyResponse: store the registers of a read response under a bound token
+bool RegisterImage::applyResponse(uint32_t token, ModbusMessage& response) {
+  // Error responses carry no data worth storing
+  if (response.getError() != SUCCESS) {
+    return false;
+  }
+  // Only FC 03/04 read responses have the register layout we expect
+  uint8_t fc = response.getFunctionCode();
+  if (fc != READ_HOLD_REGISTER && fc != READ_INPUT_REGISTER) {
+    return false;
+  }
+  // Plausible length? (serverID, FC, count byte, at least one register)
+  if (response.size() < 5) {
+    return false;
+  }
+  uint16_t numWords = response[2] / 2;
+  if (response.size() < (uint16_t)(3 + numWords * 2)) {
+    return false;
+  }
+  LOCK_GUARD(lg, RIlock);
+  // Look the binding up
+  for (auto& tb : RItokens) {
+    if (tb.token == token) {
+      // Found it. The covering block must (still) exist and hold the span
+      ImageBlock *block = findBlock(tb.serverID, tb.address, numWords);
+      if (!block) {
+        LOG_E("Response for %02X/%04X exceeds attached block\n", tb.serverID, tb.address);
+        return false;
+      }
+      // Move the registers in straight off the response buffer
+      storeSpan(block, tb.address, response.data() + 3, numWords);
+      return true;
+    }
+  }
+  return false;
+}
+
+// setValue: single-register application write
+bool RegisterImage::setValue(uint8_t serverID, uint16_t address, uint16_t value) {
+  LOCK_GUARD(lg, RIlock);
+  ImageBlock *block = findBlock(serverID, address, 1);
+  if (!block) return false;
+  // Reuse the span tracking - wire byte order is MSB first
+  uint8_t words[2] = { (uint8_t)((value >> 8) & 0xFF), (uint8_t)(value & 0xFF) };
+  storeSpan(block, address, words, 1);
+  return true;
+}
+
+// getValue: single-register read, 0 if not covered
+uint16_t RegisterImage::getValue(uint8_t serverID, uint16_t address) {
+  LOCK_GUARD(lg, RIlock);
+  ImageBlock *block = findBlock(serverID, address, 1);
+  if (!block) return 0;
+  return block->values[address - block->first];
+}
+
+// getValues: bulk copy out of one block
+bool RegisterImage::getValues(uint8_t serverID, uint16_t address, uint16_t *dest, uint16_t words) {
+  LOCK_GUARD(lg, RIlock);
+  ImageBlock *block = findBlock(serverID, address, words);
+  if (!block) return false;
+  memcpy(dest, block->values + (address - block->first), words * sizeof(uint16_t));
+  return true;
+}
+
+// sequence: current change sequence of a block
+uint32_t RegisterImage::sequence(uint8_t serverID, uint16_t firstAddress) {
+  LOCK_GUARD(lg, RIlock);
+  for (auto& block : RIblocks) {
+    if (block.serverID == serverID && block.first == firstAddress) {
+      return block.seq;
+    }
+  }
+  return 0;
+}
+
+// changedRange: span of registers changed since the caller's last visit
+bool RegisterImage::changedRange(uint8_t serverID, uint16_t firstAddress, uint32_t& seenSeq, uint16_t& fromAddress, uint16_t& toAddress) {
+  LOCK_GUARD(lg, RIlock);
+  for (auto& block : RIblocks) {
+    if (block.serverID != serverID || block.first != firstAddress) continue;
+    // Nothing happened since the caller's last visit?
+    if (seenSeq >= block.seq) {
+      return false;
+    }
+    // Did the caller lag behind farther than the history reaches?
+    if (block.seq - seenSeq > RI_HISTORY || seenSeq == 0) {
+      // Yes - be safe and report the whole block
+      fromAddress = block.first;
+      toAddress = block.first + block.numRegs - 1;
+      seenSeq = block.seq;
+      return true;
+    }
+    // Union the spans of all updates the caller has not seen yet
+    uint16_t from = 0xFFFF;
+    uint16_t to = 0;
+    for (auto& span : block.history) {
+      if (span.seq > seenSeq && span.seq <= block.seq) {
+        if (span.from < from) from = span.from;
+        if (span.to > to) to = span.to;
+      }
+    }
+    seenSeq = block.seq;
+    // The history must cover the gap - if not (cannot happen), report all
+    if (from == 0xFFFF) {
+      fromAddress = block.first;
+      toAddress = block.first + block.numRegs - 1;
+    } else {
+      fromAddress = from;
+      toAddress = to;
+    }
+    return true;
+  }
+  return false;
+}
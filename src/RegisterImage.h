@@ -0,0 +1,127 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _REGISTER_IMAGE_H
+#define _REGISTER_IMAGE_H
+
+#include "options.h"
+#include <vector>
+#include "ModbusMessage.h"
+#if USE_MUTEX
+#include <mutex>      // NOLINT
+#endif
+
+// RegisterImage: canonical last-known register store for data concentrator setups -
+// poll many devices, keep their register images, serve them upstream.
+// Blocks of registers are attached per serverID, a token bound via bindToken()
+// ties a poll response to its place in the image, and applyResponse() moves the
+// registers of a FC 0x03/0x04 response in directly - no application-side map,
+// no full copy per update.
+// Every block carries a sequence counter that advances only when an update
+// actually changed a register, plus a short history of changed address spans.
+// changedRange() hands an upstream consumer the span of registers changed since
+// its last visit, so it copies deltas only - typically nothing at all, as most
+// poll cycles return unchanged data.
+// All methods are thread-safe; poll responses and upstream queries may come
+// from different tasks.
+class RegisterImage {
+public:
+  // Constructor/destructor
+  RegisterImage();
+  ~RegisterImage();
+
+  // No copying - tokens and consumers refer to this very image
+  RegisterImage(const RegisterImage&) = delete;
+  RegisterImage& operator=(const RegisterImage&) = delete;
+
+  // addBlock: attach a block of numRegisters registers starting at firstAddress
+  // for the given serverID. Storage is allocated here and zero-initialized.
+  // Returns false if the block is empty, exceeds the address space or overlaps
+  // an already attached block of the same serverID.
+  bool addBlock(uint8_t serverID, uint16_t firstAddress, uint16_t numRegisters);
+
+  // removeBlock: detach the block starting at firstAddress again
+  bool removeBlock(uint8_t serverID, uint16_t firstAddress);
+
+  // bindToken: get the token tying a read request for firstAddress on serverID
+  // to its spot in the image. Use it as the request token and hand it to
+  // applyResponse() together with the response. Repeated calls with the same
+  // parameters return the same token, so cyclic polls bind once.
+  // Returns 0 if no attached block covers the address.
+  uint32_t bindToken(uint8_t serverID, uint16_t firstAddress);
+
+  // applyResponse: store the registers of a FC 0x03/0x04 read response under a
+  // bound token. Error responses and unknown tokens are ignored (return false).
+  // Returns true if the response was stored - whether or not anything changed.
+  bool applyResponse(uint32_t token, ModbusMessage& response);
+
+  // setValue/getValue: single-register application access
+  bool setValue(uint8_t serverID, uint16_t address, uint16_t value);
+  uint16_t getValue(uint8_t serverID, uint16_t address);
+
+  // getValues: copy 'words' registers starting at address into dest.
+  // Returns false if the span is not covered by one attached block.
+  bool getValues(uint8_t serverID, uint16_t address, uint16_t *dest, uint16_t words);
+
+  // sequence: current change sequence number of the block starting at
+  // firstAddress - advances by one for every update that changed a register.
+  // Returns 0 if there is no such block (a live block starts at 1).
+  uint32_t sequence(uint8_t serverID, uint16_t firstAddress);
+
+  // changedRange: report the span of registers changed since the caller's last
+  // visit. seenSeq is the sequence number the caller saw last (start with 0 for
+  // "everything") and is advanced to the current one. Returns true with the
+  // changed span in fromAddress/toAddress (inclusive), or false if nothing
+  // changed - or no such block exists. If the caller lagged behind farther than
+  // the kept change history, the full block span is reported to stay safe.
+  bool changedRange(uint8_t serverID, uint16_t firstAddress, uint32_t& seenSeq, uint16_t& fromAddress, uint16_t& toAddress);
+
+protected:
+  // Number of change spans kept per block. A consumer polling at least once per
+  // RI_HISTORY image updates always gets exact deltas; a slower one falls back
+  // to the full block span.
+  static constexpr uint8_t RI_HISTORY = 8;
+
+  // One change record: the span an update with this sequence number touched
+  struct ChangeSpan {
+    uint32_t seq;                // Sequence number of the update
+    uint16_t from;               // First changed register address
+    uint16_t to;                 // Last changed register address
+  };
+
+  // One attached register block
+  struct ImageBlock {
+    uint8_t serverID;            // Device this block mirrors
+    uint16_t first;              // First register address of the block
+    uint16_t numRegs;            // Number of registers in the block
+    uint16_t *values;            // Register storage, owned by the image
+    uint32_t seq;                // Change sequence, starts at 1
+    ChangeSpan history[RI_HISTORY]; // Ring of recent change spans
+    uint8_t histNext;            // Next ring slot to overwrite
+  };
+
+  // findBlock: locate the block covering [address, address+words) - caller holds RIlock!
+  ImageBlock *findBlock(uint8_t serverID, uint16_t address, uint16_t words);
+
+  // storeSpan: write words into a block, tracking the changed span and
+  // advancing the sequence if anything differed - caller holds RIlock!
+  void storeSpan(ImageBlock *block, uint16_t address, const uint8_t *words, uint16_t numWords);
+
+  std::vector<ImageBlock> RIblocks;  // All attached blocks
+
+  // One token binding: token value and the bound image location
+  struct TokenBinding {
+    uint32_t token;              // The bound token
+    uint8_t serverID;            // Bound device
+    uint16_t address;            // Bound first register address
+  };
+  std::vector<TokenBinding> RItokens; // All handed-out bindings
+  uint32_t RInextToken;          // Running token counter
+
+#if USE_MUTEX
+  std::mutex RIlock;             // Mutex protecting blocks and bindings
+#endif
+};
+
+#endif
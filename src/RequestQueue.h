@@ -0,0 +1,162 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _REQUEST_QUEUE_H
+#define _REQUEST_QUEUE_H
+
+#include <cstdint>
+#include <atomic>
+
+// RequestQueue: bounded lock-free multi-producer/single-consumer ring of pointers.
+// Replaces the mutex-guarded std::queue on the client request path, where several
+// application tasks enqueue via addRequest() while one worker task consumes -
+// the queue mutex was a priority-inversion hazard there.
+// Producers only ever touch the head counter and their claimed cell, so push()
+// never blocks on the consumer; peek()/pop()/clear() are reserved for the single
+// consumer task. Each cell carries a sequence number (Vyukov scheme) that tells
+// producers and consumer apart from a wrapped-around ring.
+// Where several tasks share the consuming end - the async server's worker
+// pool - popMC() claims the tail via CAS instead; see there.
+template <typename T>
+class RequestQueue {
+public:
+  // Constructor: size the ring for at least 'limit' entries (rounded up to a power of two)
+  explicit RequestQueue(uint16_t limit) :
+    RQcells(nullptr),
+    RQmask(1),
+    RQhead(0),
+    RQtail(0) {
+    // Round the capacity up to the next power of two for cheap index masking
+    uint32_t cap = 2;
+    while (cap < limit) {
+      cap <<= 1;
+    }
+    RQmask = cap - 1;
+    RQcells = new Cell[cap];
+    for (uint32_t i = 0; i < cap; ++i) {
+      RQcells[i].seq.store(i, std::memory_order_relaxed);
+      RQcells[i].data = nullptr;
+    }
+  }
+
+  // Destructor: drop the ring. All queued objects must have been popped before!
+  ~RequestQueue() {
+    delete[] RQcells;
+  }
+
+  // No copying - the ring is owned by exactly one client
+  RequestQueue(const RequestQueue&) = delete;
+  RequestQueue& operator=(const RequestQueue&) = delete;
+
+  // push: add an entry at the tail end. Any task may call this.
+  // Returns false if the ring is full - the entry is not taken over then.
+  bool push(T *entry) {
+    uint32_t pos = RQhead.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = RQcells[pos & RQmask];
+      uint32_t seq = cell.seq.load(std::memory_order_acquire);
+      int32_t diff = (int32_t)(seq - pos);
+      // Is the cell free for this ticket?
+      if (diff == 0) {
+        // Yes. Try to claim it
+        if (RQhead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.data = entry;
+          cell.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+        // Claim lost to another producer - pos was reloaded, try again
+      } else if (diff < 0) {
+        // Cell still holds an unconsumed entry from the previous lap - ring is full
+        return false;
+      } else {
+        // Another producer was faster - catch up
+        pos = RQhead.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // peek: glance at the front entry without removing it. Consumer task only!
+  T *peek() {
+    uint32_t pos = RQtail.load(std::memory_order_relaxed);
+    Cell& cell = RQcells[pos & RQmask];
+    uint32_t seq = cell.seq.load(std::memory_order_acquire);
+    // Is the front entry complete?
+    if ((int32_t)(seq - (pos + 1)) < 0) {
+      // No, queue is empty (or the producer is still writing)
+      return nullptr;
+    }
+    return cell.data;
+  }
+
+  // pop: remove and return the front entry, nullptr if none. Consumer task only!
+  T *pop() {
+    uint32_t pos = RQtail.load(std::memory_order_relaxed);
+    Cell& cell = RQcells[pos & RQmask];
+    uint32_t seq = cell.seq.load(std::memory_order_acquire);
+    // Is the front entry complete?
+    if ((int32_t)(seq - (pos + 1)) < 0) {
+      // No, queue is empty (or the producer is still writing)
+      return nullptr;
+    }
+    T *entry = cell.data;
+    // Mark the cell free for the next lap
+    cell.seq.store(pos + RQmask + 1, std::memory_order_release);
+    RQtail.store(pos + 1, std::memory_order_relaxed);
+    return entry;
+  }
+
+  // popMC: multi-consumer variant of pop() - several tasks may take from the
+  // queue concurrently (the async server's worker pool does). The tail is
+  // claimed via CAS, mirroring the producer side, so no two consumers can
+  // receive the same entry. Do not mix with peek()/pop() on the same queue.
+  T *popMC() {
+    uint32_t pos = RQtail.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = RQcells[pos & RQmask];
+      uint32_t seq = cell.seq.load(std::memory_order_acquire);
+      int32_t diff = (int32_t)(seq - (pos + 1));
+      // Is the front entry complete?
+      if (diff == 0) {
+        // Yes. Try to claim it
+        if (RQtail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          T *entry = cell.data;
+          // Mark the cell free for the next lap
+          cell.seq.store(pos + RQmask + 1, std::memory_order_release);
+          return entry;
+        }
+        // Claim lost to another consumer - pos was reloaded, try again
+      } else if (diff < 0) {
+        // Queue is empty (or the producer is still writing)
+        return nullptr;
+      } else {
+        // Another consumer was faster - catch up
+        pos = RQtail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // size: number of queued entries (approximate while producers are active)
+  inline uint32_t size() const {
+    uint32_t head = RQhead.load(std::memory_order_relaxed);
+    uint32_t tail = RQtail.load(std::memory_order_relaxed);
+    return head - tail;
+  }
+
+  // empty: is the queue empty? (approximate while producers are active)
+  inline bool empty() const { return size() == 0; }
+
+protected:
+  // One ring cell: entry pointer plus the lap-tracking sequence number
+  struct Cell {
+    std::atomic<uint32_t> seq;
+    T *data;
+  };
+
+  Cell *RQcells;                 // The ring storage
+  uint32_t RQmask;               // Capacity - 1 (capacity is a power of two)
+  std::atomic<uint32_t> RQhead;  // Producer ticket counter
+  std::atomic<uint32_t> RQtail;  // Consumer position
+};
+
+#endif  // _REQUEST_QUEUE_H
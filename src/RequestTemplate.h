@@ -0,0 +1,56 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _REQUEST_TEMPLATE_H
+#define _REQUEST_TEMPLATE_H
+
+#include <utility>
+#include "ModbusMessage.h"
+
+// RequestTemplate: a request validated and rendered exactly once, for polling
+// loops that issue the same messages cycle after cycle. create() runs the same
+// parameter checks and byte assembly as the variadic addRequest() generators,
+// but only at setup time - every subsequent addRequest(template, token) merely
+// copies the prebuilt bytes into the queue. A transport may additionally cache
+// wire extras in the template: the RTU client stores the frame's CRC16 on
+// first enqueue and reuses it for every send.
+class RequestTemplate {
+ public:
+  // Empty template - invalid until assigned from create()
+  RequestTemplate() :
+    TPerror(EMPTY_MESSAGE),
+    TPcrc(0),
+    TPcrcValid(false) {}
+
+  // create: validate and render the request, mirroring the setMessage() overloads
+  template <typename... Args>
+  static RequestTemplate create(Args&&... args) {
+    RequestTemplate t;
+    t.TPerror = t.TPmsg.setMessage(std::forward<Args>(args) ...);
+    return t;
+  }
+
+  // valid/error: outcome of the one-time validation
+  bool valid() const { return TPerror == SUCCESS; }
+  Error error() const { return TPerror; }
+
+  // message: the prebuilt request bytes
+  const ModbusMessage& message() const { return TPmsg; }
+
+  // Transport-side CRC cache, maintained by the RTU client
+  bool crcCached() const { return TPcrcValid; }
+  uint16_t crc() const { return TPcrc; }
+  void cacheCRC(uint16_t crc16) const {
+    TPcrc = crc16;
+    TPcrcValid = true;
+  }
+
+ protected:
+  ModbusMessage TPmsg;       // The rendered request
+  Error TPerror;             // Result of the one-time validation
+  mutable uint16_t TPcrc;        // CRC16 of the rendered frame, RTU only
+  mutable bool TPcrcValid;       // Has TPcrc been computed yet?
+};
+
+#endif
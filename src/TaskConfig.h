@@ -0,0 +1,34 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _TASK_CONFIG_H
+#define _TASK_CONFIG_H
+
+#include "options.h"
+
+#if HAS_FREERTOS
+extern "C" {
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+}
+
+// TaskConfig: tuning knobs for the worker tasks created in the begin()/start()
+// calls of clients and servers. Every creation site has working defaults, but
+// some deployments need more: an RTU worker losing its core to the WiFi
+// housekeeping tasks blows the inter-frame timing unless its priority is
+// raised above them, and oversized stacks can be shrunk to reclaim RAM once
+// the class' stackHighWaterMark() has shown the real usage.
+struct TaskConfig {
+  UBaseType_t priority;     // FreeRTOS task priority
+  uint32_t stackSize;       // Task stack size in bytes
+  int coreID;               // Core to pin the task to, -1 = scheduler's choice
+
+  TaskConfig(UBaseType_t prio, uint32_t stack, int core = -1) :
+    priority(prio),
+    stackSize(stack),
+    coreID(core) {}
+};
+#endif  // HAS_FREERTOS
+
+#endif
@@ -0,0 +1,126 @@
+// =================================================================================================
+// eModbus: Copyright 2020 by Michael Harwerth, Bert Melis and the contributors to eModbus
+//               MIT license - see license.md for details
+// =================================================================================================
+#ifndef _TIMER_WHEEL_H
+#define _TIMER_WHEEL_H
+
+#include <cstdint>
+#include <vector>
+
+// TimerWheel: fixed-slot timer wheel for per-request timeout tracking.
+// With request pipelining, scanning every in-flight request for expiry on each
+// worker loop turn costs O(N) per turn. The wheel hashes each deadline into one
+// of TWnumSlots slots of TWtickMs width; advancing the hand touches only the
+// slots the time actually passed, so a tick is O(1) amortized per scheduled
+// entry. Deadlines beyond one wheel revolution carry a rounds counter instead
+// of extra wheel levels - Modbus timeouts are bounded to seconds, so a second
+// hierarchy level would never see use.
+// The wheel is not thread-safe; it is meant to live inside a single worker
+// task or behind the caller's existing lock.
+template <typename T>
+class TimerWheel {
+public:
+  // Constructor: tickMs is the timeout granularity, numSlots the wheel size.
+  // The defaults resolve the usual 2000ms timeout to within 10ms and cover
+  // 1280ms per revolution.
+  explicit TimerWheel(uint32_t tickMs = 10, uint16_t numSlots = 128) :
+    TWslots(numSlots),
+    TWtickMs(tickMs ? tickMs : 1),
+    TWlastTick(0),
+    TWhand(0),
+    TWcount(0) { }
+
+  // No copying - entries belong to exactly one wheel
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  // schedule: file an item to expire timeoutMs from now (a millis() value)
+  void schedule(T item, uint32_t timeoutMs, uint32_t now) {
+    // Was the wheel empty? Then the tick tracker may be stale - re-anchor it,
+    // so advance() does not spin catching up with the idle time
+    if (TWcount == 0) {
+      TWlastTick = now;
+    }
+    // Round up to full ticks, so an entry never expires before its time
+    uint32_t ticks = timeoutMs / TWtickMs + 1;
+    Entry e;
+    e.item = item;
+    // An exact multiple of the slot count lands on the hand's current slot,
+    // which already counts as one full revolution - hence the -1
+    e.rounds = (uint16_t)((ticks - 1) / TWslots.size());
+    TWslots[(TWhand + ticks) % TWslots.size()].push_back(e);
+    TWcount++;
+  }
+
+  // cancel: remove an item again (its response arrived in time).
+  // Returns true if the item was found.
+  bool cancel(const T& item) {
+    for (auto& slot : TWslots) {
+      for (auto e = slot.begin(); e != slot.end(); ++e) {
+        if (e->item == item) {
+          slot.erase(e);
+          TWcount--;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // advance: move the hand up to 'now' (a millis() value), appending all
+  // expired items to 'expired'
+  void advance(uint32_t now, std::vector<T>& expired) {
+    // Nothing scheduled? Just keep the tick tracker current
+    if (TWcount == 0) {
+      TWlastTick = now;
+      return;
+    }
+    while (now - TWlastTick >= TWtickMs) {
+      TWlastTick += TWtickMs;
+      TWhand = (TWhand + 1) % TWslots.size();
+      auto& slot = TWslots[TWhand];
+      for (auto e = slot.begin(); e != slot.end();) {
+        // Still rounds to go before this entry is due?
+        if (e->rounds) {
+          // Yes - one revolution closer now
+          e->rounds--;
+          ++e;
+        } else {
+          // No - it expired
+          expired.push_back(e->item);
+          e = slot.erase(e);
+          TWcount--;
+        }
+      }
+    }
+  }
+
+  // clear: drop all scheduled entries (connection went down etc.)
+  void clear() {
+    for (auto& slot : TWslots) {
+      slot.clear();
+    }
+    TWcount = 0;
+  }
+
+  // pending: number of scheduled entries
+  uint32_t pending() { return TWcount; }
+
+  // tickMs: the wheel's timeout granularity - a sensible upper wait bound for
+  // callers that sleep between advance() calls
+  uint32_t tickMs() { return TWtickMs; }
+
+protected:
+  struct Entry {
+    T item;                    // The scheduled item
+    uint16_t rounds;           // Full wheel revolutions left before expiry
+  };
+  std::vector<std::vector<Entry>> TWslots; // One entry list per wheel slot
+  uint32_t TWtickMs;           // Milliseconds per slot
+  uint32_t TWlastTick;         // Time the hand moved last
+  uint16_t TWhand;             // Slot the hand points at
+  uint32_t TWcount;            // Number of scheduled entries
+};
+
+#endif
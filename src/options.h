@@ -49,6 +49,72 @@ typedef std::chrono::steady_clock clk;
 #endif
 
 /* === COMMON MACROS === */
+// Event-driven RTU frame reception: on ESP32 Arduino cores 2.0 and up the UART
+// RX timeout event (the frame gap, detected by the UART itself) wakes the
+// receiving task via task notification instead of the polling state machine in
+// RTUutils::receive(). Set to 0 to force the classic polling loop.
+#ifndef MODBUS_RTU_EVENT_RECEIVE
+#if defined(ESP32) && defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 2
+#define MODBUS_RTU_EVENT_RECEIVE 1
+#else
+#define MODBUS_RTU_EVENT_RECEIVE 0
+#endif
+#endif
+
+// Number of slice tables the RTU CRC16 kernel (RTUutils::calcCRC) works with.
+// 4 or 8 process that many bytes per loop step at the cost of 512 bytes RAM per
+// table; 1 falls back to the classic byte-wise loop. Hosted Linux builds default
+// to 8, MCUs to 4.
+// Alternatively define MODBUS_CRC16_EXTERNAL to route calcCRC to a user-provided
+//   uint16_t modbusCRC16(const uint8_t *data, uint16_t len);
+// e.g. to use a hardware CRC unit. Mind that the unit must implement the Modbus
+// polynomial 0xA001 (reflected) - the ESP32 ROM CRC functions use CCITT and are
+// NOT suitable!
+#ifndef MODBUS_CRC_SLICES
+#if IS_LINUX
+#define MODBUS_CRC_SLICES 8
+#else
+#define MODBUS_CRC_SLICES 4
+#endif
+#endif
+
+// Deferred logging: with the flag set to 1, the LOG_*/HEXDUMP_* macros put a
+// compact record into a lock-free ring buffer instead of writing to the log
+// device synchronously, and a low-priority drain task does the actual I/O.
+// This keeps diagnostics from stalling the worker tasks long enough to distort
+// the RTU inter-frame timing they are meant to observe. Needs a one-time
+// startDeferredLogging() call (see Logging.h); off by default.
+#ifndef MODBUS_DEFERRED_LOGGING
+#define MODBUS_DEFERRED_LOGGING 0
+#endif
+
+// Latency histogram instrumentation for client transactions: with the flag set
+// to 1, every request is timestamped at enqueue, send, receive and handler
+// dispatch, and the durations are tallied into per-serverID log-scale
+// histograms readable via ModbusClient::getLatencyStats(). Costs a micros()
+// call and one atomic increment per phase; off by default.
+#ifndef MODBUS_LATENCY_STATS
+#define MODBUS_LATENCY_STATS 0
+#endif
+
+// Protocol-variant pruning: by default the library compiles with ModbusASCII
+// support and the float/double add()/get() conversions included. Define
+// EMODBUS_NO_ASCII and/or EMODBUS_NO_FLOAT (e.g. via build_flags) to compile
+// the unused variant out entirely - tables, conversion code and mode branches -
+// saving flash on modules that never use it. With ASCII pruned,
+// useModbusASCII() logs an error and the protocol stays RTU.
+#ifdef EMODBUS_NO_ASCII
+#define EMODBUS_ASCII 0
+#else
+#define EMODBUS_ASCII 1
+#endif
+
+#ifdef EMODBUS_NO_FLOAT
+#define EMODBUS_FLOAT 0
+#else
+#define EMODBUS_FLOAT 1
+#endif
+
 #if USE_MUTEX
 #define LOCK_GUARD(x,y) std::lock_guard<std::mutex> x(y);
 #else